@@ -0,0 +1,71 @@
+/*
+ *  Injectors - Benchmark helpers
+ *
+ *  Copyright (C) 2014 LINK/2012 <dma_2012@hotmail.com>
+ *
+ *  This software is provided 'as-is', without any express or implied
+ *  warranty. In no event will the authors be held liable for any damages
+ *  arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *     1. The origin of this software must not be misrepresented; you must not
+ *     claim that you wrote the original software. If you use this software
+ *     in a product, an acknowledgment in the product documentation would be
+ *     appreciated but is not required.
+ *
+ *     2. Altered source versions must be plainly marked as such, and must not be
+ *     misrepresented as being the original software.
+ *
+ *     3. This notice may not be removed or altered from any source
+ *     distribution.
+ *
+ */
+#pragma once
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <sys/mman.h>
+
+namespace bench
+{
+    // Keeps the compiler from optimizing @value away
+    template<class T>
+    inline void keep(const T& value)
+    {
+        asm volatile("" : : "r"(&value) : "memory");
+    }
+
+    // Runs @fn @iterations times and returns the best average of a few rounds, in nanoseconds per run
+    template<class F>
+    double ns_per_op(size_t iterations, F fn)
+    {
+        double best = 1e300;
+        for(int round = 0; round < 5; ++round)
+        {
+            auto begin = std::chrono::steady_clock::now();
+            for(size_t i = 0; i < iterations; ++i) fn();
+            auto end = std::chrono::steady_clock::now();
+            double ns = std::chrono::duration<double, std::nano>(end - begin).count() / double(iterations);
+            if(ns < best) best = ns;
+        }
+        return best;
+    }
+
+    // Maps @size bytes of code memory, left read and execute only
+    inline uint8_t* map_code(size_t size, uintptr_t at = 0)
+    {
+        void* p = mmap((void*)(at), size, PROT_READ|PROT_WRITE|PROT_EXEC, MAP_PRIVATE|MAP_ANONYMOUS|(at? MAP_FIXED : 0), -1, 0);
+        if(p == MAP_FAILED) return nullptr;
+        mprotect(p, size, PROT_READ|PROT_EXEC);
+        return (uint8_t*)(p);
+    }
+
+    inline void report(const char* name, double ns)
+    {
+        std::printf("%-48s %12.1f ns\n", name, ns);
+    }
+}
@@ -0,0 +1,75 @@
+// inplace_delegate against std::function, memory per functor and call latency
+#include <injector/delegate.hpp>
+#include <atomic>
+#include <functional>
+#include <new>
+#include <cstdlib>
+#include "bench.hpp"
+using namespace injector;
+
+// Counts the bytes allocated by the program
+static std::atomic<size_t> allocated(0);
+
+void* operator new(size_t size)
+{
+    allocated.fetch_add(size, std::memory_order_relaxed);
+    if(void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+// A functor with @Size bytes of captures
+template<size_t Size>
+struct capture
+{
+    uintptr_t values[Size / sizeof(uintptr_t)];
+    int operator()(int x) const { return x + int(values[0]); }
+};
+
+// Bytes taken by a @Delegate holding a capture<Size>, itself and what it allocated
+template<class Delegate, size_t Size>
+static size_t memory()
+{
+    const size_t before = allocated.load();
+    Delegate d = capture<Size>{ { 1 } };
+    bench::keep(d);
+    return sizeof(d) + allocated.load() - before;
+}
+
+template<class Delegate, size_t Size>
+static double latency()
+{
+    Delegate d = capture<Size>{ { 1 } };
+    int x = 0;
+    return bench::ns_per_op(10000000, [&] { bench::keep(d); x = d(x); bench::keep(x); });
+}
+
+template<size_t Size>
+static void run()
+{
+    typedef std::function<int(int)> function;
+    typedef inplace_delegate<int(int)> delegate;
+    std::printf("%-12zu %8zu B %8zu B %10.2f ns %10.2f ns\n", Size,
+                memory<function, Size>(), memory<delegate, Size>(), latency<function, Size>(), latency<delegate, Size>());
+}
+
+int main()
+{
+    std::printf("%-12s %10s %10s %13s %13s\n", "captures", "function", "delegate", "function", "delegate");
+    run<8>();
+    run<16>();
+    run<24>();
+    run<32>();
+    run<40>();
+    run<64>();
+    return 0;
+}
@@ -0,0 +1,51 @@
+// Throughput of the table driven length decoder over the code of the loaded modules
+#include <injector/disasm.hpp>
+#include <link.h>
+#include <vector>
+#include "bench.hpp"
+using namespace injector;
+
+struct code_range { const uint8_t* begin; size_t size; };
+
+static int collect(dl_phdr_info* info, size_t, void* data)
+{
+    auto& ranges = *(std::vector<code_range>*)(data);
+    for(int i = 0; i < info->dlpi_phnum; ++i)
+    {
+        const ElfW(Phdr)& ph = info->dlpi_phdr[i];
+        if(ph.p_type == PT_LOAD && (ph.p_flags & PF_X))
+            ranges.push_back(code_range { (const uint8_t*)(info->dlpi_addr + ph.p_vaddr), size_t(ph.p_memsz) });
+    }
+    return 0;
+}
+
+int main()
+{
+    std::vector<code_range> ranges;
+    dl_iterate_phdr(collect, &ranges);
+
+    size_t bytes = 0, instructions = 0;
+    for(auto& r : ranges) bytes += r.size;
+
+    // Linear sweep, invalid bytes are skipped one at a time
+    double ns = bench::ns_per_op(1, [&] {
+        instructions = 0;
+        for(auto& r : ranges)
+        {
+            const uint8_t* p = r.begin;
+            const uint8_t* end = r.begin + r.size - 15;
+            while(p < end)
+            {
+                size_t n = GetInstructionLength(p);
+                p += n? n : 1;
+                ++instructions;
+            }
+        }
+    });
+
+    bench::keep(instructions);
+    std::printf("%zu code bytes, %zu instructions\n", bytes, instructions);
+    bench::report("per instruction", ns / double(instructions));
+    std::printf("%-48s %12.1f MB/s\n", "throughput", double(bytes) / (ns / 1e9) / 1e6);
+    return 0;
+}
@@ -0,0 +1,80 @@
+// scoped_dispatcher with 1, 2, 4 and 8 handlers, against calling the handlers and the function directly, and function_hooker
+#include <injector/dispatcher.hpp>
+#include <list>
+#include "bench.hpp"
+using namespace injector;
+
+// The code page, two functions of int(int) calling the same one (sub rsp, 8; call original; add rsp, 8; ret)
+static const uintptr_t page_addr = 0x200000000;
+static const uintptr_t site_addr = page_addr + 4;
+static const uintptr_t hooker_site_addr = page_addr + 32 + 4;
+static const uintptr_t original_addr = page_addr + 64;  // lea eax, [rdi+1]; ret
+
+using hook = function_hooker<hooker_site_addr, int(int)>;
+
+static int counter;
+
+// Handlers which can't be inlined into the direct calls
+__attribute__((noinline)) static void handler(int x)
+{
+    counter += x;
+    bench::keep(counter);
+}
+
+static void (*const handlers[8])(int) = { handler, handler, handler, handler, handler, handler, handler, handler };
+
+int main()
+{
+    static const uint8_t caller[] = { 0x48, 0x83, 0xEC, 0x08, 0xE8, 0, 0, 0, 0, 0x48, 0x83, 0xC4, 0x08, 0xC3 };
+    static const uint8_t original[] = { 0x8D, 0x47, 0x01, 0xC3 };
+    uint8_t* page = bench::map_code(4096, page_addr);
+    if(page != (uint8_t*)(page_addr))
+    {
+        std::fprintf(stderr, "can't map the code page at %p\n", (void*)(page_addr));
+        return 1;
+    }
+    WriteMemoryRaw(raw_ptr(page_addr), (void*)(caller), sizeof(caller), true);
+    WriteMemoryRaw(raw_ptr(page_addr + 32), (void*)(caller), sizeof(caller), true);
+    WriteMemoryRaw(raw_ptr(original_addr), (void*)(original), sizeof(original), true);
+    MakeCALL(raw_ptr(site_addr), raw_ptr(original_addr));
+    MakeCALL(raw_ptr(hooker_site_addr), raw_ptr(original_addr));
+
+    const size_t iterations = 10000000;
+    auto fn = (int(*)(int))(page_addr);
+    auto hooker_fn = (int(*)(int))(page_addr + 32);
+    auto original_fn = (int(*)(int))(original_addr);
+    int x = 0;
+
+    bench::report("no hook", bench::ns_per_op(iterations, [&] { x = fn(x); bench::keep(x); }));
+
+    scoped_dispatcher<void(*)(int)> d;
+    d.add(handler);
+    d.make_dispatcher(raw_ptr(site_addr));
+
+    std::list<hook> hooks;
+    for(size_t count : { 1, 2, 4, 8 })
+    {
+        while(d.size() < count)
+            d.add(handler);
+        while(hooks.size() < count)
+        {
+            hooks.emplace_back();
+            hooks.back().make_call([](hook::func_type next, int x) { handler(x); return next(x); });
+        }
+
+        char label[64];
+        std::snprintf(label, sizeof(label), "direct calls, %zu handler(s)", count);
+        bench::report(label, bench::ns_per_op(iterations, [&] {
+            for(size_t i = 0; i < count; ++i) handlers[i](x);
+            x = original_fn(x);
+            bench::keep(x);
+        }));
+
+        std::snprintf(label, sizeof(label), "scoped_dispatcher, %zu handler(s)", count);
+        bench::report(label, bench::ns_per_op(iterations, [&] { x = fn(x); bench::keep(x); }));
+
+        std::snprintf(label, sizeof(label), "function_hooker, %zu hook(s)", count);
+        bench::report(label, bench::ns_per_op(iterations / 10, [&] { x = hooker_fn(x); bench::keep(x); }));
+    }
+    return 0;
+}
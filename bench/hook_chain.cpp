@@ -0,0 +1,122 @@
+// Calls thought a function_hooker chain of 1, 2, 4 and 8 hooks, against the chain built on every call from before
+#include <injector/hooking.hpp>
+#include <atomic>
+#include <functional>
+#include <list>
+#include <new>
+#include <cstdlib>
+#include "bench.hpp"
+using namespace injector;
+
+// Counts every allocation of the program
+static std::atomic<size_t> allocations(0);
+
+void* operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if(void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+// The code page, two functions of int(int) calling the same one (sub rsp, 8; call original; add rsp, 8; ret)
+static const uintptr_t page_addr = 0x200000000;
+static const uintptr_t site_addr = page_addr + 4;
+static const uintptr_t old_site_addr = page_addr + 32 + 4;
+static const uintptr_t original_addr = page_addr + 64;  // lea eax, [rdi+1]; ret
+
+using hook = function_hooker<site_addr, int(int)>;
+
+// The chain as call_hooks built it before: a std::function per hook per call, wrapping the next one
+namespace old_chain
+{
+    using func_type    = std::function<int(int)>;
+    using functor_type = std::function<int(func_type, int&)>;
+
+    std::list<std::pair<const void*, functor_type>> assoc;
+    int (*original)(int);
+
+    int call_hooks(int& x)
+    {
+        if(assoc.size() == 0)
+            return original(x);
+
+        func_type first = [](int x) -> int { return original(x); };
+        if(assoc.size() == 1)
+            return assoc.begin()->second(std::move(first), x);
+
+        func_type next = std::move(first);
+        for(auto it = assoc.begin(); it != assoc.end(); ++it)
+        {
+            auto& functor = it->second;
+            next = [functor, next](int x) -> int { return functor(next, x); };
+        }
+        return next(x);
+    }
+
+    int call(int x)
+    {
+        return call_hooks(x);
+    }
+}
+
+static void report(const char* name, size_t hooks, size_t iterations, int (*fn)(int))
+{
+    char label[64];
+    std::snprintf(label, sizeof(label), "%s, %zu hook(s)", name, hooks);
+
+    int x = 0;
+    const size_t before = allocations.load();
+    double ns = bench::ns_per_op(iterations, [&] { x = fn(x); bench::keep(x); });
+    const double per_call = double(allocations.load() - before) / double(5 * iterations);
+    std::printf("%-48s %12.1f ns %10.2f allocs/call\n", label, ns, per_call);
+}
+
+int main()
+{
+    static const uint8_t caller[] = { 0x48, 0x83, 0xEC, 0x08, 0xE8, 0, 0, 0, 0, 0x48, 0x83, 0xC4, 0x08, 0xC3 };
+    static const uint8_t original[] = { 0x8D, 0x47, 0x01, 0xC3 };
+    uint8_t* page = bench::map_code(4096, page_addr);
+    if(page != (uint8_t*)(page_addr))
+    {
+        std::fprintf(stderr, "can't map the code page at %p\n", (void*)(page_addr));
+        return 1;
+    }
+    WriteMemoryRaw(raw_ptr(page_addr), (void*)(caller), sizeof(caller), true);
+    WriteMemoryRaw(raw_ptr(page_addr + 32), (void*)(caller), sizeof(caller), true);
+    WriteMemoryRaw(raw_ptr(original_addr), (void*)(original), sizeof(original), true);
+    MakeCALL(raw_ptr(site_addr), raw_ptr(original_addr));
+    MakeCALL(raw_ptr(old_site_addr), raw_ptr(original_addr));
+
+    const size_t iterations = 1000000;
+    auto fn = (int(*)(int))(page_addr);
+    auto old_fn = (int(*)(int))(page_addr + 32);
+
+    report("no hook", 0, iterations, fn);
+
+    old_chain::original = (int(*)(int))(original_addr);
+    MakeCALL(raw_ptr(old_site_addr), raw_ptr(old_chain::call));
+
+    std::list<hook> hooks;
+    for(size_t count : { 1, 2, 4, 8 })
+    {
+        while(hooks.size() < count)
+        {
+            hooks.emplace_back();
+            hooks.back().make_call([](hook::func_type next, int x) { return next(x) + 1; });
+            old_chain::assoc.emplace_back(&hooks.back(), [](old_chain::func_type next, int& x) { return next(x) + 1; });
+        }
+        report("function_hooker", count, iterations, fn);
+        report("std::function chain per call (before)", count, iterations, old_fn);
+    }
+    return 0;
+}
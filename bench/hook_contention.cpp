@@ -0,0 +1,83 @@
+// Calls thought a hooked site from many threads, against call_hooks copying the shared_ptr of instance() on every call as before
+#include <injector/hooking.hpp>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "bench.hpp"
+using namespace injector;
+
+// The code page, two functions of int(int) calling the same one (sub rsp, 8; call original; add rsp, 8; ret)
+static const uintptr_t page_addr = 0x200000000;
+static const uintptr_t site_addr = page_addr + 4;
+static const uintptr_t old_site_addr = page_addr + 32 + 4;
+static const uintptr_t original_addr = page_addr + 64;  // lea eax, [rdi+1]; ret
+
+using hook = function_hooker<site_addr, int(int)>;
+using manager_type = hook::manager_type;
+
+// What call_hooks did before, taking a reference on the manager for the call
+static int old_call(int x)
+{
+    auto manager = manager_type::instance();
+    bench::keep(manager);
+    return manager_type::call_hooks(x);
+}
+
+// Wall time per call (all threads together) with @threads threads calling @fn for a while
+static double run(size_t threads, int (*fn)(int))
+{
+    std::atomic<bool> stop(false);
+    std::atomic<size_t> total(0);
+    std::vector<std::thread> callers;
+
+    auto begin = std::chrono::steady_clock::now();
+    for(size_t t = 0; t < threads; ++t)
+    {
+        callers.emplace_back([&] {
+            size_t n = 0;
+            int x = 0;
+            while(!stop.load(std::memory_order_relaxed))
+            {
+                for(int i = 0; i < 256; ++i, ++n)
+                    x = fn(x);
+            }
+            bench::keep(x);
+            total += n;
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    stop = true;
+    for(auto& t : callers) t.join();
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count();
+    return ns / double(total.load());
+}
+
+int main()
+{
+    static const uint8_t caller[] = { 0x48, 0x83, 0xEC, 0x08, 0xE8, 0, 0, 0, 0, 0x48, 0x83, 0xC4, 0x08, 0xC3 };
+    static const uint8_t original[] = { 0x8D, 0x47, 0x01, 0xC3 };
+    uint8_t* page = bench::map_code(4096, page_addr);
+    if(page != (uint8_t*)(page_addr))
+    {
+        std::fprintf(stderr, "can't map the code page at %p\n", (void*)(page_addr));
+        return 1;
+    }
+    WriteMemoryRaw(raw_ptr(page_addr), (void*)(caller), sizeof(caller), true);
+    WriteMemoryRaw(raw_ptr(page_addr + 32), (void*)(caller), sizeof(caller), true);
+    WriteMemoryRaw(raw_ptr(original_addr), (void*)(original), sizeof(original), true);
+    MakeCALL(raw_ptr(site_addr), raw_ptr(original_addr));
+
+    hook h;
+    h.make_call([](hook::func_type next, int x) { return next(x) + 1; });
+    MakeCALL(raw_ptr(old_site_addr), raw_ptr(old_call));
+
+    auto fn = (int(*)(int))(page_addr);
+    auto old_fn = (int(*)(int))(page_addr + 32);
+
+    std::printf("hardware threads: %u\n", std::thread::hardware_concurrency());
+    std::printf("%-12s %20s %20s\n", "threads", "function_hooker", "refcount (before)");
+    for(size_t threads : { 1, 2, 4, 8 })
+        std::printf("%-12zu %17.1f ns %17.1f ns\n", threads, run(threads, fn), run(threads, old_fn));
+    return 0;
+}
@@ -0,0 +1,97 @@
+// Signature scanning over a 32MB buffer, the kernels against a naive loop
+// and the scaling of the parallel scans with 1, 2, 4 and 8 threads
+#include <injector/injector.hpp>
+#include <injector/pattern.hpp>
+#include <vector>
+#include <thread>
+#include <cstring>
+#include "bench.hpp"
+using namespace injector;
+
+static const size_t buffer_size = 32 << 20;
+
+// Compares byte by byte at every position, what most scanners do
+static const uint8_t* naive_scan(const uint8_t* begin, const uint8_t* end, const uint8_t* bytes, const char* mask, size_t size)
+{
+    for(const uint8_t* p = begin; p + size <= end; ++p)
+    {
+        size_t i = 0;
+        while(i < size && (mask[i] == '?' || p[i] == bytes[i])) ++i;
+        if(i == size) return p;
+    }
+    return nullptr;
+}
+
+static void report_gbs(const char* name, double ns)
+{
+    std::printf("%-48s %12.2f GB/s\n", name, double(buffer_size) / ns);
+}
+
+int main()
+{
+    // Looks like code, plenty of E8s and 8Bs to keep the anchors busy
+    std::vector<uint8_t> buffer(buffer_size);
+    uint32_t seed = 12345;
+    for(auto& b : buffer)
+    {
+        seed = seed * 1103515245 + 12345;
+        uint8_t r = uint8_t(seed >> 16);
+        b = (r < 16? 0xE8 : r < 32? 0x8B : r < 40? 0x45 : r);
+    }
+
+    const uint8_t bytes[] = { 0xE8, 0, 0, 0, 0, 0x8B, 0x45, 0, 0x85, 0xC0, 0x74 };
+    const char*   mask    = "x????xx?xxx";
+    const byte_pattern pattern(bytes, mask);
+
+    // Found only at the very end
+    memcpy(&buffer[buffer_size - sizeof(bytes)], bytes, sizeof(bytes));
+    const uint8_t* begin = buffer.data();
+    const uint8_t* end = begin + buffer_size;
+    const uint8_t* expected = end - sizeof(bytes);
+
+    const uint8_t* found = nullptr;
+    report_gbs("naive loop", bench::ns_per_op(1, [&] { found = naive_scan(begin, end, bytes, mask, sizeof(bytes)); }));
+    if(found != expected) std::printf("naive loop failed\n");
+
+    struct { const char* name; pattern_kernel kernel; } kernels[] =
+    {
+        { "FindPattern (scalar)",   pattern_kernel::scalar },
+        { "FindPattern (horspool)", pattern_kernel::horspool },
+        { "FindPattern (sse2)",     pattern_kernel::sse2 },
+        { "FindPattern (avx2)",     pattern_kernel::avx2 },
+        { "FindPattern (automatic)", pattern_kernel::automatic },
+    };
+
+    for(auto& k : kernels)
+    {
+        if(k.kernel == pattern_kernel::avx2 && !__builtin_cpu_supports("avx2"))
+            continue;
+        memory_pointer_raw p;
+        report_gbs(k.name, bench::ns_per_op(1, [&] { p = FindPattern(raw_ptr(begin), raw_ptr(end), pattern, k.kernel); }));
+        if(p.get<const uint8_t>() != expected) std::printf("%s failed\n", k.name);
+    }
+
+    // A batch of patterns none of which is in the buffer, so every chunk gets scanned to the end
+    pattern_batch batch;
+    for(uint32_t i = 0; i < 200; ++i)
+    {
+        uint8_t sig[12] = { 0xE8, 0, 0, 0, 0, 0x8B, 0x45 };
+        memcpy(&sig[7], &i, sizeof(i));
+        sig[11] = 0xC3;
+        batch.add(byte_pattern(sig, "x????xxxxxxx"));
+    }
+
+    std::printf("hardware threads: %u\n", std::thread::hardware_concurrency());
+    for(size_t threads : { 1, 2, 4, 8 })
+    {
+        char name[64];
+        memory_pointer_raw p;
+        std::snprintf(name, sizeof(name), "FindPatternParallel, %zu threads", threads);
+        report_gbs(name, bench::ns_per_op(1, [&] { p = FindPatternParallel(raw_ptr(begin), raw_ptr(end), pattern, threads); }));
+        if(p.get<const uint8_t>() != expected) std::printf("%s failed\n", name);
+
+        std::snprintf(name, sizeof(name), "pattern_batch (200 patterns), %zu threads", threads);
+        report_gbs(name, bench::ns_per_op(1, [&] { batch.reset(); batch.scan(raw_ptr(begin), raw_ptr(end), threads); }));
+    }
+    return 0;
+}
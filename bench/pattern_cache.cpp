@@ -0,0 +1,73 @@
+// Resolving a batch of patterns on a cold start (scanning, then saving the cache) against a warm start (from the cache)
+#include <injector/injector.hpp>
+#include <injector/pattern.hpp>
+#include <injector/pattern_cache.hpp>
+#include <cstdio>
+#include <string>
+#include <functional>
+#include <unistd.h>
+#include <dlfcn.h>
+#include "bench.hpp"
+using namespace injector;
+
+int main()
+{
+    // The C library is big enough to be worth caching, unlike this executable
+    Dl_info info;
+    if(!dladdr((void*)(&std::printf), &info)) return 1;
+    const memory_pointer_raw module = raw_ptr(info.dli_fbase);
+
+    // Patterns taken from its code, with the operand bytes in the middle left as wildcards
+    std::vector<byte_pattern> patterns;
+    auto sections = GetModuleSections(module);
+    for(auto& range : sections)
+    {
+        const uint8_t* begin = (const uint8_t*)(range.begin);
+        const size_t size = size_t(range.end - range.begin);
+        for(size_t offset = 0; offset + 16 <= size && patterns.size() < 200; offset += size / 200 + 1)
+            patterns.emplace_back(begin + offset, "xxxx????xxxxxxxx");
+    }
+
+    const std::string path = "/tmp/injector_bench_cache_" + std::to_string(getpid()) + ".bin";
+    std::remove(path.c_str());
+
+    auto make_batch = [&] {
+        pattern_batch batch;
+        for(auto& p : patterns) batch.add(p);
+        return batch;
+    };
+
+    // A process starting up is run only once, so time single runs instead of the best of many
+    auto once = [](const char* name, const std::function<void()>& fn) {
+        auto begin = std::chrono::steady_clock::now();
+        fn();
+        bench::report(name, std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count());
+    };
+
+    std::printf("%zu patterns over %s\n", patterns.size(), info.dli_fname);
+
+    once("no cache (FindPattern for each)", [&] {
+        for(auto& p : patterns)
+        {
+            auto r = FindPatternInModule(p, module);
+            bench::keep(r);
+        }
+    });
+
+    once("cold start (no cache file, scan and save)", [&] {
+        pattern_cache cache(path.c_str(), module);
+        auto batch = make_batch();
+        cache.resolve(batch);
+        cache.save();
+    });
+
+    once("warm start (from the cache file)", [&] {
+        pattern_cache cache(path.c_str(), module);
+        auto batch = make_batch();
+        cache.resolve(batch);
+        if(cache.get_statistics().misses) std::printf("unexpected misses: %zu\n", cache.get_statistics().misses);
+    });
+
+    std::remove(path.c_str());
+    return 0;
+}
@@ -0,0 +1,100 @@
+// Compile time translation against memory_pointer translating at runtime, call overhead and code size
+// Built twice, the second time with INJECTOR_GVM_STATIC_VERSION fixing the version at compile time
+#define INJECTOR_GVM_HAS_TRANSLATOR
+#include <injector/injector.hpp>
+#include <injector/gvm/static_translator.hpp>
+#include <dlfcn.h>
+#include <link.h>
+#include "bench.hpp"
+using namespace injector;
+
+constexpr uintptr_t rows[][3] =
+{
+    { 0x401000, 0x401010, 0x401400 },
+    { 0x402000, 0x402010, 0x402400 },
+    { 0x403000, 0x403010, 0x403400 },
+    { 0x404000, 0x404010, 0x404400 },
+    { 0x405000, 0x405010, 0x405400 },
+    { 0x406000, 0x406010, 0x406400 },
+    { 0x407000, 0x407010, 0x407400 },
+    { 0x408000, 0x408010, 0x408400 },
+};
+constexpr static_translation_table<3> table(rows);
+static_assert(table.is_sorted(), "rows must be sorted");
+
+namespace injector
+{
+    void* address_manager::translator(void* p)
+    {
+        return table.translate(p);
+    }
+}
+
+// Each of those translates the 8 addresses of the table and sums them up
+extern "C" __attribute__((noinline)) uintptr_t sum_static()
+{
+    return INJECTOR_STATIC_ADDRESS(table, 0x401000) + INJECTOR_STATIC_ADDRESS(table, 0x402000)
+         + INJECTOR_STATIC_ADDRESS(table, 0x403000) + INJECTOR_STATIC_ADDRESS(table, 0x404000)
+         + INJECTOR_STATIC_ADDRESS(table, 0x405000) + INJECTOR_STATIC_ADDRESS(table, 0x406000)
+         + INJECTOR_STATIC_ADDRESS(table, 0x407000) + INJECTOR_STATIC_ADDRESS(table, 0x408000);
+}
+
+extern "C" __attribute__((noinline)) uintptr_t sum_memory_pointer()
+{
+    return uintptr_t(memory_pointer(0x401000).get<void>()) + uintptr_t(memory_pointer(0x402000).get<void>())
+         + uintptr_t(memory_pointer(0x403000).get<void>()) + uintptr_t(memory_pointer(0x404000).get<void>())
+         + uintptr_t(memory_pointer(0x405000).get<void>()) + uintptr_t(memory_pointer(0x406000).get<void>())
+         + uintptr_t(memory_pointer(0x407000).get<void>()) + uintptr_t(memory_pointer(0x408000).get<void>());
+}
+
+extern "C" __attribute__((noinline)) uintptr_t sum_table_translate()
+{
+    return uintptr_t(table.translate((void*)(0x401000))) + uintptr_t(table.translate((void*)(0x402000)))
+         + uintptr_t(table.translate((void*)(0x403000))) + uintptr_t(table.translate((void*)(0x404000)))
+         + uintptr_t(table.translate((void*)(0x405000))) + uintptr_t(table.translate((void*)(0x406000)))
+         + uintptr_t(table.translate((void*)(0x407000))) + uintptr_t(table.translate((void*)(0x408000)));
+}
+
+extern "C" __attribute__((noinline)) uintptr_t sum_raw()
+{
+    return raw_ptr(0x401400).as_int() + raw_ptr(0x402400).as_int() + raw_ptr(0x403400).as_int() + raw_ptr(0x404400).as_int()
+         + raw_ptr(0x405400).as_int() + raw_ptr(0x406400).as_int() + raw_ptr(0x407400).as_int() + raw_ptr(0x408400).as_int();
+}
+
+// Size of the code of a function, from the dynamic symbol table (the executable exports its symbols)
+static size_t code_size(void* fn)
+{
+    Dl_info info;
+    const ElfW(Sym)* sym = nullptr;
+    if(dladdr1(fn, &info, (void**)(&sym), RTLD_DL_SYMENT) && sym)
+        return size_t(sym->st_size);
+    return 0;
+}
+
+int main()
+{
+    static_translation_version() = 2;
+
+#ifdef INJECTOR_GVM_STATIC_VERSION
+    std::printf("version fixed at compile time\n");
+#else
+    std::printf("version chosen at runtime\n");
+#endif
+
+    struct { const char* name; uintptr_t (*fn)(); } cases[] =
+    {
+        { "raw constants",                  sum_raw },
+        { "INJECTOR_STATIC_ADDRESS",        sum_static },
+        { "static_translation_table::translate", sum_table_translate },
+        { "memory_pointer(addr).get()",     sum_memory_pointer },
+    };
+
+    for(auto& c : cases)
+    {
+        if(c.fn() != sum_raw()) std::printf("%s gives the wrong addresses\n", c.name);
+        uintptr_t r;
+        double ns = bench::ns_per_op(1 << 22, [&] { r = c.fn(); bench::keep(r); });
+        std::printf("%-48s %12.1f ns %8zu bytes\n", c.name, ns, code_size((void*)(c.fn)));
+    }
+    return 0;
+}
@@ -0,0 +1,38 @@
+// Writing N patches one by one with virtual protect against queueing them into a patch_transaction
+#include <injector/injector.hpp>
+#include <injector/transaction.hpp>
+#include "bench.hpp"
+using namespace injector;
+
+int main()
+{
+    const size_t pages = 64;
+    const size_t page_size = GetPageSize();
+    uint8_t* code = bench::map_code(pages * page_size);
+    if(!code) return 1;
+
+    std::printf("%zu pages\n", pages);
+    for(size_t n : { size_t(16), size_t(256), size_t(4096) })
+    {
+        const size_t stride = (pages * page_size) / n;
+        char name[64];
+
+        double plain = bench::ns_per_op(10, [&] {
+            for(size_t i = 0; i < n; ++i)
+                WriteMemory<uint32_t>(code + i * stride, uint32_t(i), true);
+        });
+
+        double batched = bench::ns_per_op(10, [&] {
+            patch_transaction tx;
+            for(size_t i = 0; i < n; ++i)
+                tx.write<uint32_t>(code + i * stride, uint32_t(i));
+            tx.commit();
+        });
+
+        std::snprintf(name, sizeof(name), "%zu patches, WriteMemory", n);
+        bench::report(name, plain);
+        std::snprintf(name, sizeof(name), "%zu patches, patch_transaction", n);
+        bench::report(name, batched);
+    }
+    return 0;
+}
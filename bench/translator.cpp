@@ -0,0 +1,130 @@
+// Address translation with 50k map entries, the flattened table against the old list of std::map lookups,
+// where translate_many starts being worth it over translating one by one,
+// and address_manager::translate_address frozen against going thought the translation cache
+#define INJECTOR_GVM_HAS_TRANSLATOR
+#define INJECTOR_GVM_TRANSLATION_CACHE 64   // Measured against the frozen table
+#include <injector/injector.hpp>
+#include <injector/gvm/translator.hpp>
+#include <list>
+#include <map>
+#include <vector>
+#include <algorithm>
+#include "bench.hpp"
+using namespace injector;
+
+namespace injector
+{
+    void* address_manager::translator(void* p)
+    {
+        return address_translator_manager::singleton().translator(p);
+    }
+}
+
+// What the manager did before flattening: walk the list of translators doing a lower_bound on each map
+static void* old_translate(const std::list<const std::map<memory_pointer_raw, memory_pointer_raw>*>& maps, void* p_)
+{
+    const memory_pointer_raw p = raw_ptr(p_);
+    for(auto map : maps)
+    {
+        auto it = map->lower_bound(p);
+        if(it != map->end())
+        {
+            if(it->first != p) --it;
+            auto diff = (p - it->first).as_int();
+            if(diff <= injector_translator::max_ptr_dist)
+                return (it->second + raw_ptr(diff)).get();
+        }
+    }
+    return nullptr;
+}
+
+struct bench_translator : address_translator
+{
+    bench_translator(size_t first, size_t count, size_t stride) : address_translator(false)
+    {
+        for(size_t i = first; i < count; i += stride)
+            map[raw_ptr(0x400000 + i * 16)] = raw_ptr(0x8000000 + i * 16);
+        enable();
+    }
+
+    const std::map<memory_pointer_raw, memory_pointer_raw>& get_map() const { return map; }
+};
+
+int main()
+{
+    const size_t entries = 50000;
+
+    // Random lookups, about half of them land between entries and miss
+    std::vector<void*> lookups(1 << 16);
+    uint32_t seed = 1;
+    for(auto& p : lookups)
+    {
+        seed = seed * 1103515245 + 12345;
+        p = (void*)(uintptr_t(0x400000 + (seed >> 8) % (entries * 16)));
+    }
+
+    for(size_t translators : { 1, 4 })
+    {
+        std::list<std::unique_ptr<bench_translator>> owned;
+        std::list<const std::map<memory_pointer_raw, memory_pointer_raw>*> maps;
+        for(size_t i = 0; i < translators; ++i)
+        {
+            owned.emplace_back(new bench_translator(i, entries, translators));
+            maps.push_front(&owned.back()->get_map());
+        }
+
+        auto& mgr = address_translator_manager::singleton();
+        size_t k = 0;
+        void* r = nullptr;
+        char name[96];
+
+        std::printf("%zu entries in %zu translator(s)\n", entries, translators);
+        std::snprintf(name, sizeof(name), "old list + std::map lookup");
+        bench::report(name, bench::ns_per_op(1 << 22, [&] { r = old_translate(maps, lookups[k++ & 0xFFFF]); bench::keep(r); }));
+        std::snprintf(name, sizeof(name), "address_translator_manager::translator");
+        bench::report(name, bench::ns_per_op(1 << 22, [&] { r = mgr.translator(lookups[k++ & 0xFFFF]); bench::keep(r); }));
+        std::snprintf(name, sizeof(name), "address_manager::translate_address (cached)");
+        bench::report(name, bench::ns_per_op(1 << 22, [&] { r = address_manager::translate_address(lookups[k++ & 0xFFFF]); bench::keep(r); }));
+
+        for(size_t i = 0; i < lookups.size(); ++i)
+        {
+            if(old_translate(maps, lookups[i]) != mgr.translator(lookups[i]))
+            {
+                std::printf("mismatch at %p\n", lookups[i]);
+                break;
+            }
+        }
+    }
+
+    // translate_many against a loop of translator(), per address, the threshold is forced to zero to always sort and merge-walk
+    bench_translator tr(0, entries, 1);
+    auto& mgr = address_translator_manager::singleton();
+    std::vector<void*> out(lookups.size());
+    std::printf("batch_threshold is %zu\n", address_translator_manager::batch_threshold);
+    std::printf("%-12s %16s %16s\n", "addresses", "one by one", "translate_many");
+    for(size_t count = 16; count <= lookups.size(); count *= 2)
+    {
+        const size_t rounds = std::max<size_t>(1, (1 << 20) / count);
+        double single = bench::ns_per_op(rounds, [&] {
+            for(size_t i = 0; i < count; ++i) out[i] = mgr.translator(lookups[i]);
+            bench::keep(out[0]);
+        });
+        double many = bench::ns_per_op(rounds, [&] {
+            mgr.translate_many(lookups.data(), out.data(), count, 0);
+            bench::keep(out[0]);
+        });
+        std::printf("%-12zu %13.1f ns %13.1f ns\n", count, single / double(count), many / double(count));
+    }
+
+    // A few hot addresses (the cache hits) and random ones (the cache misses)
+    size_t k = 0;
+    void* r = nullptr;
+    for(int frozen = 0; frozen < 2; ++frozen)
+    {
+        if(frozen) mgr.freeze();
+        std::printf("translate_address, %s\n", frozen? "frozen" : "not frozen");
+        bench::report("16 hot addresses", bench::ns_per_op(1 << 22, [&] { r = address_manager::translate_address(lookups[k++ & 0xF]); bench::keep(r); }));
+        bench::report("random addresses", bench::ns_per_op(1 << 22, [&] { r = address_manager::translate_address(lookups[k++ & 0xFFFF]); bench::keep(r); }));
+    }
+    return 0;
+}
@@ -0,0 +1,77 @@
+// Translations from many threads, with and without a thread changing the translators meanwhile
+#define INJECTOR_GVM_HAS_TRANSLATOR
+#include <injector/injector.hpp>
+#include <injector/gvm/translator.hpp>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "bench.hpp"
+using namespace injector;
+
+namespace injector
+{
+    void* address_manager::translator(void* p)
+    {
+        return address_translator_manager::singleton().translator(p);
+    }
+}
+
+struct bench_translator : address_translator
+{
+    bench_translator(uintptr_t from, size_t count) : address_translator(false)
+    {
+        for(size_t i = 0; i < count; ++i)
+            map[raw_ptr(from + i * 16)] = raw_ptr(from + 0x1000000 + i * 16);
+        enable();
+    }
+};
+
+// Wall time per translation (all threads together) with @threads threads translating for a while, and @writer changing the translators meanwhile
+static double run(size_t threads, bool writer)
+{
+    auto& mgr = address_translator_manager::singleton();
+    bench_translator toggled(0x8000000, 1000);
+    std::atomic<bool> stop(false);
+    std::atomic<size_t> total(0);
+    std::vector<std::thread> readers;
+
+    auto begin = std::chrono::steady_clock::now();
+    for(size_t t = 0; t < threads; ++t)
+    {
+        readers.emplace_back([&, t] {
+            size_t n = 0, k = t;
+            void* r;
+            while(!stop.load(std::memory_order_relaxed))
+            {
+                for(int i = 0; i < 256; ++i, ++n)
+                {
+                    r = mgr.translator((void*)(0x400000 + ((k++ * 7919) % 50000) * 16));
+                    bench::keep(r);
+                }
+            }
+            total += n;
+        });
+    }
+
+    size_t changes = 0;
+    while(std::chrono::steady_clock::now() - begin < std::chrono::milliseconds(300))
+    {
+        if(writer) toggled.enable((changes++ & 1) != 0);
+        std::this_thread::yield();
+    }
+
+    stop = true;
+    for(auto& t : readers) t.join();
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count();
+    return ns / double(total.load());
+}
+
+int main()
+{
+    bench_translator big(0x400000, 50000);
+    std::printf("hardware threads: %u\n", std::thread::hardware_concurrency());
+    std::printf("%-12s %20s %20s\n", "threads", "no writer", "toggling writer");
+    for(size_t threads : { 1, 2, 4, 8 })
+        std::printf("%-12zu %17.1f ns %17.1f ns\n", threads, run(threads, false), run(threads, true));
+    return 0;
+}
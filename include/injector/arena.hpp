@@ -0,0 +1,356 @@
+/*
+ *  Injectors - Executable Memory Arena
+ *
+ *  Copyright (C) 2014 LINK/2012 <dma_2012@hotmail.com>
+ *
+ *  This software is provided 'as-is', without any express or implied
+ *  warranty. In no event will the authors be held liable for any damages
+ *  arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *     1. The origin of this software must not be misrepresented; you must not
+ *     claim that you wrote the original software. If you use this software
+ *     in a product, an acknowledgment in the product documentation would be
+ *     appreciated but is not required.
+ *
+ *     2. Altered source versions must be plainly marked as such, and must not be
+ *     misrepresented as being the original software.
+ *
+ *     3. This notice may not be removed or altered from any source
+ *     distribution.
+ *
+ */
+#pragma once
+#include "injector.hpp"
+#include <vector>
+#include <map>
+#include <mutex>
+#include <algorithm>
+#include <utility>
+
+namespace injector
+{
+    /*
+     *  AllocateExecutableMemory
+     *      Allocates @size bytes of memory which can be executed, read and written
+     *      If @nearby is not null, tries to place the memory in the rel32 reach of it (always the case in 32 bits)
+     *      Returns nullptr on failure
+     */
+    inline void* AllocateExecutableMemory(size_t size, memory_pointer_raw nearby = nullptr)
+    {
+#ifdef _WIN32
+        if(sizeof(void*) == 8 && !nearby.is_null())
+        {
+            // Walk thought the free regions around @nearby looking for one we can allocate at
+            SYSTEM_INFO si;
+            GetSystemInfo(&si);
+            const uintptr_t granularity = si.dwAllocationGranularity;
+            const uintptr_t origin = nearby.as_int() & ~(granularity - 1);
+            const uintptr_t reach  = 0x7FFF0000;
+
+            for(int dir = -1; dir <= 1; dir += 2)
+            {
+                uintptr_t addr = origin;
+                while(dir < 0? (addr > granularity && origin - addr < reach) : (addr - origin < reach))
+                {
+                    MEMORY_BASIC_INFORMATION mbi;
+                    if(VirtualQuery((void*)(addr), &mbi, sizeof(mbi)) == 0)
+                        break;
+
+                    if(mbi.State == MEM_FREE)
+                    {
+                        if(void* p = VirtualAlloc((void*)(addr), size, MEM_RESERVE | MEM_COMMIT, PAGE_EXECUTE_READWRITE))
+                            return p;
+                    }
+
+                    if(dir < 0) addr = (uintptr_t(mbi.AllocationBase? mbi.AllocationBase : mbi.BaseAddress) - 1) & ~(granularity - 1);
+                    else        addr = (uintptr_t(mbi.BaseAddress) + mbi.RegionSize + granularity - 1) & ~(granularity - 1);
+                }
+            }
+            return nullptr;
+        }
+        return VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_EXECUTE_READWRITE);
+#else
+        const int prot = PROT_READ | PROT_WRITE | PROT_EXEC;
+
+        if(sizeof(void*) == 8 && !nearby.is_null())
+        {
+            const uintptr_t reach = 0x7FFF0000;
+            const uintptr_t origin = nearby.as_int();
+            auto distance = [&](uintptr_t c) -> uintptr_t     // Farthest the memory would get from @nearby if placed at @c
+            {
+                const uintptr_t first = c > origin? c - origin : origin - c;
+                const uintptr_t last  = c + size > origin? c + size - origin : origin - (c + size);
+                return std::max(first, last);
+            };
+
+            // Another thread may map something into a hole before we do, in which case we go on with the next one, and once
+            // all of them are gone the holes are looked for again (they're smaller now, but likely still there).
+            // Kernels not knowing about MAP_FIXED_NOREPLACE take the address as a hint and may place the memory elsewhere.
+#ifdef MAP_FIXED_NOREPLACE
+            const int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE;
+#else
+            const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#endif
+            for(int attempt = 0; attempt < 16; ++attempt)
+            {
+                // The ends of the unmapped holes in reach of @nearby, the closest first
+                std::vector<std::pair<uintptr_t, uintptr_t>> holes;     // Distance, address
+                uintptr_t prev_end = GetPageSize() * 16;
+                if(FILE* f = fopen("/proc/self/maps", "r"))
+                {
+                    char line[512];
+                    unsigned long long begin, end;
+                    while(fgets(line, sizeof(line), f))
+                    {
+                        if(sscanf(line, "%llx-%llx", &begin, &end) != 2)
+                            continue;
+                        if(begin > prev_end && begin - prev_end >= size)
+                        {
+                            // Candidates are the beginning and the end of the hole
+                            uintptr_t candidates[2] = { prev_end, uintptr_t(begin - size) & ~uintptr_t(GetPageSize() - 1) };
+                            for(uintptr_t c : candidates)
+                            {
+                                if(distance(c) < reach) holes.emplace_back(distance(c), c);
+                            }
+                        }
+                        prev_end = uintptr_t(end);
+                    }
+                    fclose(f);
+                }
+                if(holes.empty())
+                    break;
+                std::sort(holes.begin(), holes.end());
+
+                for(auto& hole : holes)
+                {
+                    void* p = mmap((void*)(hole.second), size, prot, flags, -1, 0);
+                    if(p == (void*)(hole.second))
+                        return p;
+                    if(p != MAP_FAILED)
+                        munmap(p, size);
+                }
+            }
+            return nullptr;
+        }
+
+        void* p = mmap(nullptr, size, prot, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        return p == MAP_FAILED? nullptr : p;
+#endif
+    }
+
+    /*
+     *  FreeExecutableMemory
+     *      Frees the memory at @p with size @size allocated by AllocateExecutableMemory
+     */
+    inline void FreeExecutableMemory(void* p, size_t size)
+    {
+#ifdef _WIN32
+        (void) size;
+        VirtualFree(p, 0, MEM_RELEASE);
+#else
+        munmap(p, size);
+#endif
+#ifdef INJECTOR_CACHE_PROTECTION
+        // Whatever gets mapped here next comes with its own protection
+        protection_map::singleton().forget(p, size);
+#endif
+    }
+
+
+
+    /*
+     *  executable_arena
+     *      Allocator for generated code (trampolines, thunks, ...)
+     *      Stubs are packed next to each other in a few pages instead of taking a page each, which saves memory and iTLB entries.
+     *      The pages are placed in the rel32 reach of the address the stub is near to, if asked to.
+     *      All the pages are freed when the arena gets destroyed, make sure no thread is running a stub by then.
+     */
+    class executable_arena
+    {
+        public:
+            static const size_t alignment = 16;     // Every stub begins at a multiple of this
+
+            struct statistics
+            {
+                size_t pages;       // Number of system pages the arena holds
+                size_t reserved;    // Bytes the arena holds
+                size_t used;        // Bytes taken by live stubs (including alignment)
+                size_t stubs;       // Number of live stubs
+
+                // Average footprint of a stub
+                size_t bytes_per_stub() const { return stubs? used / stubs : 0; }
+            };
+
+        private:
+            struct chunk
+            {
+                uint8_t* base;
+                size_t   size;
+                size_t   top;       // Bump pointer, offset of the next free byte
+                size_t   used;      // Bytes taken by live stubs
+                size_t   stubs;     // Number of live stubs
+            };
+
+            std::vector<chunk>  chunks;
+            size_t              chunk_size;
+            mutable std::mutex  mutex;
+
+            static size_t align(size_t n)
+            {
+                return (n + alignment - 1) & ~(alignment - 1);
+            }
+
+            // Checks whether the whole chunk @c is in the rel32 reach of @nearby
+            static bool in_reach(const chunk& c, memory_pointer_raw nearby)
+            {
+                if(sizeof(void*) == 4 || nearby.is_null()) return true;
+                const uintptr_t reach = 0x7FFF0000;
+                const uintptr_t p = nearby.as_int(), b = uintptr_t(c.base), e = uintptr_t(c.base) + c.size;
+                return (p > b? p - b : b - p) < reach && (p > e? p - e : e - p) < reach;
+            }
+
+        public:
+            // Constructs an arena which allocates its pages in blocks of @chunk_size bytes
+            // The default is the smallest block the system can give (the allocation granularity on Windows, a page otherwise)
+            explicit executable_arena(size_t chunk_size = 0)
+            {
+            #ifdef _WIN32
+                SYSTEM_INFO si;
+                GetSystemInfo(&si);
+                const size_t granularity = si.dwAllocationGranularity;
+            #else
+                const size_t granularity = GetPageSize();
+            #endif
+                this->chunk_size = (chunk_size + granularity - 1) / granularity * granularity;
+                if(this->chunk_size == 0) this->chunk_size = granularity;
+            }
+
+            executable_arena(const executable_arena&) = delete;
+            executable_arena& operator=(const executable_arena&) = delete;
+
+            ~executable_arena()
+            {
+                for(auto& c : chunks)
+                    FreeExecutableMemory(c.base, c.size);
+            }
+
+            // Allocates @size bytes for a stub, in the rel32 reach of @nearby if it isn't null
+            // Returns nullptr on failure
+            void* allocate(size_t size, memory_pointer_raw nearby = nullptr)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                size = align(size);
+
+                // Most recent chunks are the most likely to have room
+                for(auto it = chunks.rbegin(); it != chunks.rend(); ++it)
+                {
+                    if(it->size - it->top >= size && in_reach(*it, nearby))
+                        return take(*it, size);
+                }
+
+                chunk c = { nullptr, (size + chunk_size - 1) / chunk_size * chunk_size, 0, 0, 0 };
+                c.base = (uint8_t*) AllocateExecutableMemory(c.size, nearby);
+                if(c.base == nullptr)
+                    return nullptr;
+
+                chunks.push_back(c);
+                return take(chunks.back(), size);
+            }
+
+            // Gives back the stub at @p with size @size
+            // The pages are given back to the system once all of their stubs are gone
+            void deallocate(void* p, size_t size)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                size = align(size);
+
+                for(auto it = chunks.begin(); it != chunks.end(); ++it)
+                {
+                    if((uint8_t*)(p) >= it->base && (uint8_t*)(p) < it->base + it->size)
+                    {
+                        it->used -= size;
+                        if(--it->stubs == 0)
+                        {
+                            FreeExecutableMemory(it->base, it->size);
+                            chunks.erase(it);
+                        }
+                        else if((uint8_t*)(p) + size == it->base + it->top)
+                        {
+                            it->top -= size;    // Was the last stub, its space can be reused
+                        }
+                        return;
+                    }
+                }
+            }
+
+            // Gets the memory footprint of the arena
+            statistics get_statistics() const
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                statistics s = { 0, 0, 0, 0 };
+                for(auto& c : chunks)
+                {
+                    s.reserved += c.size;
+                    s.used     += c.used;
+                    s.stubs    += c.stubs;
+                }
+                s.pages = s.reserved / GetPageSize();
+                return s;
+            }
+
+            // The arena used by the library itself (detour trampolines, relay thunks, ...)
+            // It's never destroyed, because stubs may still be reached while the static objects get destroyed.
+            static executable_arena& singleton()
+            {
+                static executable_arena* arena = new executable_arena();
+                return *arena;
+            }
+
+        private:
+            static void* take(chunk& c, size_t size)
+            {
+                void* p = c.base + c.top;
+                c.top  += size;
+                c.used += size;
+                c.stubs++;
+                return p;
+            }
+    };
+
+
+    /*
+     *  GetRelayThunk
+     *      Gets a thunk in the rel32 reach of @end_of_instruction which jumps into @dest (using a 14 bytes absolute jump)
+     *      Thunks are shared by every branch going into the same @dest and live forever. Returns nullptr on failure.
+     */
+    inline memory_pointer_raw GetRelayThunk(memory_pointer_tr end_of_instruction, memory_pointer_raw dest)
+    {
+        static std::mutex mutex;
+        static std::multimap<uintptr_t, uint8_t*> thunks;   // Destination -> thunks into it
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto range = thunks.equal_range(dest.as_int());
+        for(auto it = range.first; it != range.second; ++it)
+        {
+            if(IsRelativeOffsetReachable(raw_ptr(it->second), end_of_instruction))
+                return it->second;
+        }
+
+        uint8_t* thunk = (uint8_t*) executable_arena::singleton().allocate(14, end_of_instruction.get<void>());
+        if(thunk == nullptr)
+            return nullptr;
+
+        // jmp qword ptr [rip+0], followed by the absolute destination
+        const uint8_t code[6] = { 0xFF, 0x25, 0x00, 0x00, 0x00, 0x00 };
+        uint64_t abs = dest.as_int();
+        memcpy(&thunk[0], code, sizeof(code));
+        memcpy(&thunk[6], &abs, sizeof(abs));
+
+        thunks.emplace(dest.as_int(), thunk);
+        return thunk;
+    }
+}
@@ -0,0 +1,354 @@
+/*
+ *  Injectors - Inplace Delegate
+ *
+ *  Copyright (C) 2014 LINK/2012 <dma_2012@hotmail.com>
+ *
+ *  This software is provided 'as-is', without any express or implied
+ *  warranty. In no event will the authors be held liable for any damages
+ *  arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *     1. The origin of this software must not be misrepresented; you must not
+ *     claim that you wrote the original software. If you use this software
+ *     in a product, an acknowledgment in the product documentation would be
+ *     appreciated but is not required.
+ *
+ *     2. Altered source versions must be plainly marked as such, and must not be
+ *     misrepresented as being the original software.
+ *
+ *     3. This notice may not be removed or altered from any source
+ *     distribution.
+ *
+ */
+#pragma once
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/*
+ *  A replacement for std::function with a buffer sized for the job: a functor which fits lives inside the delegate,
+ *  only a bigger one goes to the heap (once, when stored, never when called or moved).
+ *
+ *      inplace_delegate<int(int)>              d = [&](int x) { return x + y; };
+ *      inplace_delegate<int(int), 64>          a bigger buffer for bigger captures
+ *      inplace_delegate<int(int), 32, false>   move only, accepts functors which can't be copied
+ *
+ *  Use inplace_delegate<...>::fits<F>() on a static_assert to make sure a functor is stored inline.
+ *  Calling it is a single indirect call, there's no check for emptiness (an empty delegate aborts).
+ */
+
+#ifndef INJECTOR_DELEGATE_SIZE
+#define INJECTOR_DELEGATE_SIZE (4 * sizeof(void*))
+#endif
+
+namespace injector
+{
+    template<class Signature, size_t Capacity = INJECTOR_DELEGATE_SIZE, bool Copyable = true>
+    class inplace_delegate;
+
+    namespace injector_delegate
+    {
+        // Leaves the copy constructor and assignment of inplace_delegate deleted for the move only ones, so traits see it
+        template<bool Copyable>
+        struct copy_control
+        {};
+
+        template<>
+        struct copy_control<false>
+        {
+            copy_control() = default;
+            copy_control(const copy_control&) = delete;
+            copy_control(copy_control&&) = default;
+            copy_control& operator=(const copy_control&) = delete;
+            copy_control& operator=(copy_control&&) = default;
+        };
+
+        template<class Signature, size_t Capacity, bool Copyable>
+        class delegate_base;
+
+        /*
+         *  delegate_base
+         *      Everything of inplace_delegate but deleting the copy operations
+         */
+        template<class Ret, class ...Args, size_t Capacity, bool Copyable>
+        class delegate_base<Ret(Args...), Capacity, Copyable>
+        {
+            private:
+                // Scalars go to the functor by value (in registers), anything else by reference so it's moved only once
+                template<class T>
+                using param = typename std::conditional<std::is_scalar<T>::value, T, T&&>::type;
+
+                typedef typename std::aligned_storage<(Capacity < sizeof(void*)? sizeof(void*) : Capacity)>::type storage_type;
+                typedef Ret (*invoker_type)(const void* functor, param<Args>... args);
+
+                // How to copy, move and destroy the stored functor, nullptr when it's trivially copyable (memcpy does it all)
+                // Moving leaves nothing to destroy in the source.
+                struct manager_type
+                {
+                    void (*copy)(void* dst, const void* src);
+                    void (*move)(void* dst, void* src);
+                    void (*destroy)(void* p);
+                };
+
+                storage_type        storage;
+                invoker_type        invoker;
+                const manager_type* manager;
+
+                static Ret empty_invoke(const void*, param<Args>...)
+                {
+                    std::abort();
+                }
+
+                // Functors stored inline
+
+                template<class F>
+                static Ret invoke(const void* functor, param<Args>... args)
+                {
+                    return (*(F*)(functor))(std::forward<Args>(args)...);
+                }
+
+                template<class F>
+                static void copy(void* dst, const void* src, std::true_type)
+                {
+                    new (dst) F(*(const F*)(src));
+                }
+
+                template<class F>
+                static void copy(void*, const void*, std::false_type)
+                {}
+
+                template<class F>
+                static void copy(void* dst, const void* src)
+                {
+                    copy<F>(dst, src, std::integral_constant<bool, Copyable>());
+                }
+
+                template<class F>
+                static void move(void* dst, void* src)
+                {
+                    new (dst) F(std::move(*(F*)(src)));
+                    ((F*)(src))->~F();
+                }
+
+                template<class F>
+                static void destroy(void* p)
+                {
+                    ((F*)(p))->~F();
+                }
+
+                // Functors on the heap, the storage holds a pointer to them
+
+                template<class F>
+                static Ret invoke_heap(const void* functor, param<Args>... args)
+                {
+                    return (**(F* const*)(functor))(std::forward<Args>(args)...);
+                }
+
+                template<class F>
+                static void copy_heap(void* dst, const void* src, std::true_type)
+                {
+                    *(F**)(dst) = new F(**(F* const*)(src));
+                }
+
+                template<class F>
+                static void copy_heap(void*, const void*, std::false_type)
+                {}
+
+                template<class F>
+                static void copy_heap(void* dst, const void* src)
+                {
+                    copy_heap<F>(dst, src, std::integral_constant<bool, Copyable>());
+                }
+
+                template<class F>
+                static void move_heap(void* dst, void* src)
+                {
+                    *(F**)(dst) = *(F**)(src);
+                }
+
+                template<class F>
+                static void destroy_heap(void* p)
+                {
+                    delete *(F**)(p);
+                }
+
+                // Trivial functors stored inline have no manager
+                template<class F>
+                static const manager_type* manager_for(std::true_type, std::true_type)
+                {
+                    return nullptr;
+                }
+
+                // Constant initialized, getting it needs no guard
+                template<class F>
+                static const manager_type* manager_for(std::true_type, std::false_type)
+                {
+                    static const manager_type m = { copy<F>, move<F>, destroy<F> };
+                    return &m;
+                }
+
+                template<class F, class Trivial>
+                static const manager_type* manager_for(std::false_type, Trivial)
+                {
+                    static const manager_type m = { copy_heap<F>, move_heap<F>, destroy_heap<F> };
+                    return &m;
+                }
+
+                // Constructs the functor @F from @functor inside the storage
+                template<class F, class T>
+                void store(T&& functor, std::true_type)
+                {
+                    new (&storage) F(std::forward<T>(functor));
+                    this->invoker = invoke<F>;
+                }
+
+                // Constructs the functor @F from @functor on the heap
+                template<class F, class T>
+                void store(T&& functor, std::false_type)
+                {
+                    *(F**)(&storage) = new F(std::forward<T>(functor));
+                    this->invoker = invoke_heap<F>;
+                }
+
+                // Takes the functor of @rhs, which is left empty, this must be in the empty state
+                void steal(delegate_base& rhs) noexcept
+                {
+                    this->invoker = rhs.invoker, this->manager = rhs.manager;
+                    if(manager) manager->move(&storage, &rhs.storage);
+                    else        std::memcpy(&storage, &rhs.storage, sizeof(storage));
+                    rhs.invoker = empty_invoke, rhs.manager = nullptr;
+                }
+
+                // Copies the functor of @rhs, this must be in the empty state
+                void clone(const delegate_base& rhs)
+                {
+                    if(rhs.manager) rhs.manager->copy(&storage, &rhs.storage);
+                    else            std::memcpy(&storage, &rhs.storage, sizeof(storage));
+                    this->invoker = rhs.invoker, this->manager = rhs.manager;
+                }
+
+            public:
+                static const size_t capacity = Capacity;
+
+                // Checks whether the functor @F would be stored inline, moving it can't throw either
+                template<class F>
+                static constexpr bool fits()
+                {
+                    return sizeof(F) <= sizeof(storage_type)
+                        && std::alignment_of<F>::value <= std::alignment_of<storage_type>::value
+                        && std::is_nothrow_move_constructible<F>::value;
+                }
+
+                delegate_base() noexcept : storage(), invoker(empty_invoke), manager(nullptr)
+                {}
+
+                template<class F>
+                delegate_base(F&& functor) : storage()
+                {
+                    typedef typename std::decay<F>::type functor_type;
+                    static_assert(!Copyable || std::is_copy_constructible<functor_type>::value,
+                                  "Functor can't be copied, use a move only inplace_delegate");
+
+                    typedef std::integral_constant<bool, fits<functor_type>()> inline_type;
+                    this->store<functor_type>(std::forward<F>(functor), inline_type());
+                    this->manager = manager_for<functor_type>(inline_type(), std::integral_constant<bool,
+                                        std::is_trivially_copyable<functor_type>::value && std::is_trivially_destructible<functor_type>::value>());
+                }
+
+                delegate_base(const delegate_base& rhs)
+                {
+                    this->clone(rhs);
+                }
+
+                delegate_base(delegate_base&& rhs) noexcept
+                {
+                    this->steal(rhs);
+                }
+
+                ~delegate_base()
+                {
+                    if(manager) manager->destroy(&storage);
+                }
+
+                delegate_base& operator=(const delegate_base& rhs)
+                {
+                    if(this != &rhs)
+                    {
+                        delegate_base copy(rhs);
+                        this->reset();
+                        this->steal(copy);
+                    }
+                    return *this;
+                }
+
+                delegate_base& operator=(delegate_base&& rhs) noexcept
+                {
+                    if(this != &rhs)
+                    {
+                        this->reset();
+                        this->steal(rhs);
+                    }
+                    return *this;
+                }
+
+                // Destroys the functor, leaving the delegate empty
+                void reset() noexcept
+                {
+                    if(manager) manager->destroy(&storage);
+                    this->invoker = empty_invoke, this->manager = nullptr;
+                }
+
+                // Checks whether there's a functor in here
+                explicit operator bool() const
+                {
+                    return invoker != empty_invoke;
+                }
+
+                // Calls the functor, which must exist
+                Ret operator()(Args... args) const
+                {
+                    return invoker(&storage, std::forward<Args>(args)...);
+                }
+        };
+    }
+
+    /*
+     *  inplace_delegate
+     *      Type erased functor of signature Ret(Args...) stored in Capacity bytes, or on the heap if it doesn't fit
+     */
+    template<class Ret, class ...Args, size_t Capacity, bool Copyable>
+    class inplace_delegate<Ret(Args...), Capacity, Copyable>
+        : public injector_delegate::delegate_base<Ret(Args...), Capacity, Copyable>,
+          private injector_delegate::copy_control<Copyable>
+    {
+        private:
+            using base = injector_delegate::delegate_base<Ret(Args...), Capacity, Copyable>;
+
+        public:
+            inplace_delegate() = default;
+
+            inplace_delegate(std::nullptr_t) noexcept
+            {}
+
+            template<class F, class = typename std::enable_if<!std::is_same<typename std::decay<F>::type, inplace_delegate>::value>::type>
+            inplace_delegate(F&& functor) : base(std::forward<F>(functor))
+            {}
+
+            inplace_delegate(const inplace_delegate&) = default;
+            inplace_delegate(inplace_delegate&&) = default;
+            inplace_delegate& operator=(const inplace_delegate&) = default;
+            inplace_delegate& operator=(inplace_delegate&&) = default;
+
+            inplace_delegate& operator=(std::nullptr_t) noexcept
+            {
+                this->reset();
+                return *this;
+            }
+    };
+}
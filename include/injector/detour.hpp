@@ -0,0 +1,303 @@
+/*
+ *  Injectors - Inline Function Detours
+ *
+ *  Copyright (C) 2014 LINK/2012 <dma_2012@hotmail.com>
+ *
+ *  This software is provided 'as-is', without any express or implied
+ *  warranty. In no event will the authors be held liable for any damages
+ *  arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *     1. The origin of this software must not be misrepresented; you must not
+ *     claim that you wrote the original software. If you use this software
+ *     in a product, an acknowledgment in the product documentation would be
+ *     appreciated but is not required.
+ *
+ *     2. Altered source versions must be plainly marked as such, and must not be
+ *     misrepresented as being the original software.
+ *
+ *     3. This notice may not be removed or altered from any source
+ *     distribution.
+ *
+ */
+#pragma once
+#include "injector.hpp"
+#include "hooking.hpp"
+#include "arena.hpp"
+
+/*
+ *  A detour replaces the first instructions of a function with a jump into the hook, those instructions are moved into
+ *  a trampoline which then jumps back into the rest of the function. Calling the trampoline is the same as calling
+ *  the original function, so this gives one hook for the function instead of one hook for every one of its call sites.
+ */
+
+namespace injector
+{
+    // Lowest level stuff (instruction relocation) goes on the following namespace
+    // PRIVATE! Skip this, not interesting for you.
+    namespace injector_detour
+    {
+        static const size_t max_stolen      = 32;   // Max bytes taken from the function (patch size + an instruction)
+        static const size_t max_trampoline  = 128;  // Enough for any relocation of max_stolen bytes plus the jump back
+
+        // Checks whether a rel32 in a instruction ending at @from can reach @to
+        inline bool fits_rel32(uintptr_t from, uintptr_t to)
+        {
+            intptr_t diff = intptr_t(to - from);
+            return diff == intptr_t(int32_t(diff));
+        }
+
+        // Writes into @out a jump which, placed at @at, goes into @dest. Returns the size of the jump
+        inline size_t emit_jmp(uint8_t* out, uintptr_t at, uintptr_t dest)
+        {
+            if(fits_rel32(at + 5, dest))
+            {
+                int32_t rel = int32_t(dest - (at + 5));
+                out[0] = 0xE9;
+                memcpy(&out[1], &rel, 4);
+                return 5;
+            }
+            else
+            {
+                // jmp qword ptr [rip+0], followed by the absolute destination
+                const uint8_t code[6] = { 0xFF, 0x25, 0x00, 0x00, 0x00, 0x00 };
+                uint64_t abs = dest;
+                memcpy(&out[0], code, sizeof(code));
+                memcpy(&out[6], &abs, sizeof(abs));
+                return 14;
+            }
+        }
+
+        // Checks whether the instruction is just filling (NOPs or INT3s)
+        inline bool is_padding(const x86_instruction& ins)
+        {
+            return (ins.opcode_map == 0 && (ins.opcode == 0x90 || ins.opcode == 0xCC))
+                || (ins.opcode_map == 1 && ins.opcode == 0x1F);
+        }
+
+        // Copies the instructions at @src (at least @min_size bytes of them) into @out, fixing anything relative to the
+        // instruction pointer as if @out was at @out_addr, and appends a jump back into the rest of the code at @src.
+        // Returns the amount of bytes taken from @src or zero if the instructions could not be relocated.
+        // The size of the relocated code is given to @out_size.
+        inline size_t relocate(const uint8_t* src, size_t min_size, uint8_t* out, uintptr_t out_addr, size_t& out_size)
+        {
+            // Find out how many bytes are going to be taken, a branch into any of them can't be relocated (not only into
+            // the first @min_size ones, e.g. a jump over the LOCK prefix of the last instruction)
+            size_t total = 0;
+            while(total < min_size)
+            {
+                size_t length = GetInstructionLength(src + total);
+                if(length == 0) return 0;
+                total += length;
+            }
+
+            const uintptr_t src_begin = uintptr_t(src), src_end = uintptr_t(src) + total;
+            uint8_t* dst = out;
+            auto addr_of = [&](const uint8_t* p) { return out_addr + uintptr_t(p - out); };
+            size_t stolen = 0;
+            bool ended = false;     // Reached a instruction which doesn't continue into the next one?
+
+            while(stolen < min_size)
+            {
+                x86_instruction ins;
+                const uint8_t* ip = src + stolen;
+                if(DecodeInstruction(ip, ins) == 0)
+                    return 0;
+
+                if(ended)
+                {
+                    // After the function ends we may only take padding
+                    if(!is_padding(ins)) return 0;
+                }
+                else if(ins.relative)
+                {
+                    uintptr_t target = uintptr_t(GetBranchTarget(ip, ins));
+                    if(target >= src_begin && target < src_end)     // Branches into the code we're replacing
+                        return 0;
+
+                    int32_t rel;
+                    if(ins.branch == x86_branch::jmp || ins.branch == x86_branch::call)
+                    {
+                        *dst++ = (ins.branch == x86_branch::call? 0xE8 : 0xE9);
+                    }
+                    else if(ins.opcode_map == 0 && (ins.opcode & 0xF0) == 0x70)     // Jcc rel8 turns into Jcc rel32
+                    {
+                        *dst++ = 0x0F;
+                        *dst++ = 0x80 | (ins.opcode & 0x0F);
+                    }
+                    else if(ins.opcode_map == 1 && ins.imm_size == 4)               // Jcc rel32
+                    {
+                        *dst++ = 0x0F;
+                        *dst++ = ins.opcode;
+                    }
+                    else    // LOOPcc, JCXZ or branches with 16 bits operand size
+                        return 0;
+
+                    if(!fits_rel32(addr_of(dst) + 4, target))
+                        return 0;
+                    rel = int32_t(target - (addr_of(dst) + 4));
+                    memcpy(dst, &rel, 4);
+                    dst += 4;
+                }
+                else
+                {
+                    memcpy(dst, ip, ins.length);
+                    if(ins.rip_relative)
+                    {
+                        int32_t disp;
+                        memcpy(&disp, ip + ins.disp_offset, 4);
+                        uintptr_t target = uintptr_t(ip) + ins.length + disp;
+                        if(target >= src_begin && target < src_end)
+                            return 0;
+                        if(!fits_rel32(addr_of(dst) + ins.length, target))
+                            return 0;
+                        disp = int32_t(target - (addr_of(dst) + ins.length));
+                        memcpy(dst + ins.disp_offset, &disp, 4);
+                    }
+                    dst += ins.length;
+                }
+
+                if(ins.branch == x86_branch::jmp || ins.branch == x86_branch::jmp_indirect || ins.branch == x86_branch::ret)
+                    ended = true;
+
+                stolen += ins.length;
+            }
+
+            if(!ended)
+                dst += emit_jmp(dst, addr_of(dst), uintptr_t(src) + stolen);
+
+            out_size = size_t(dst - out);
+            return stolen;
+        }
+
+        // Builds a trampoline for the function at @at which gets detoured into @dest
+        // Outputs the bytes to be written at the function into @patch (with size @out_stolen) and the trampoline size to @out_size
+        inline uint8_t* prepare(memory_pointer_tr at, memory_pointer_raw dest, uint8_t (&patch)[max_stolen],
+                                size_t& out_stolen, size_t& out_size, bool vp)
+        {
+            auto& arena = executable_arena::singleton();
+            uint8_t code[max_trampoline];
+
+            // In x86-64 the hook may be too far, go thought a relay thunk then, or use the 14 bytes long jump as the last resort
+            uint8_t jmp[14];
+            auto target = GetReachableDestination(at + 5, dest);
+            size_t jmp_size = emit_jmp(jmp, at.as_int(), target.is_null()? dest.as_int() : target.as_int());
+
+            scoped_unprotect xprotect(at, vp? max_stolen : 0);
+
+            // Find out how big the trampoline is, then relocate again for the place it'll actually live at
+            if(relocate(at.get<uint8_t>(), jmp_size, code, at.as_int(), out_size) == 0)
+                return nullptr;
+
+            const size_t size = out_size;
+            uint8_t* trampoline = (uint8_t*) arena.allocate(size, at.get<void>());
+            if(trampoline == nullptr)
+                return nullptr;
+
+            out_stolen = relocate(at.get<uint8_t>(), jmp_size, code, uintptr_t(trampoline), out_size);
+            if(out_stolen == 0 || out_stolen > max_stolen || out_size > size)
+            {
+                arena.deallocate(trampoline, size);
+                return nullptr;
+            }
+            memcpy(trampoline, code, out_size);
+            out_size = size;
+
+            // Jump into the hook, with the leftovers of the last instruction NOPed
+            memcpy(patch, jmp, jmp_size);
+            memset(patch + jmp_size, 0x90, out_stolen - jmp_size);
+            return trampoline;
+        }
+    }
+
+
+    /*
+     *  MakeDetour
+     *      Redirects the function at @at into @dest by taking over its first instructions
+     *      Returns a pointer that can be called to run the original function (the trampoline), or nullptr on failure
+     *      The trampoline lives forever, see scoped_detour for a version which can be undone
+     */
+    inline memory_pointer_raw MakeDetour(memory_pointer_tr at, memory_pointer_raw dest, bool vp = true)
+    {
+        uint8_t patch[injector_detour::max_stolen];
+        size_t  size, trampoline_size;
+        if(void* trampoline = injector_detour::prepare(at, dest, patch, size, trampoline_size, vp))
+        {
+            WriteMemoryRaw(at, patch, size, vp);
+            return trampoline;
+        }
+        return nullptr;
+    }
+
+    /*
+     *  RAII wrapper for MakeDetour
+     *  Make sure no thread is running the trampoline by the time this gets restored
+     */
+    class scoped_detour : public scoped_basic<injector_detour::max_stolen>
+    {
+        private:
+            using base = scoped_basic<injector_detour::max_stolen>;
+            void*  trampoline = nullptr;
+            size_t trampoline_size = 0;
+
+        public:
+            // Detours the function at @at into @dest and returns the trampoline into the original function (nullptr on failure)
+            memory_pointer_raw make_detour(memory_pointer_tr at, memory_pointer_raw dest, bool vp = true)
+            {
+                uint8_t patch[injector_detour::max_stolen];
+                size_t  size;
+
+                this->restore();
+                if(void* trampoline = injector_detour::prepare(at, dest, patch, size, this->trampoline_size, vp))
+                {
+                    this->save(at, size, vp);
+                    WriteMemoryRaw(at, patch, size, vp);
+                    this->trampoline = trampoline;
+                }
+                return this->trampoline;
+            }
+
+            // Gets the trampoline into the original function
+            memory_pointer_raw original() const
+            {
+                return this->trampoline;
+            }
+
+            // Restores the function and frees the trampoline
+            virtual void restore()
+            {
+                base::restore();
+                if(this->trampoline)
+                {
+                    executable_arena::singleton().deallocate(this->trampoline, this->trampoline_size);
+                    this->trampoline = nullptr;
+                }
+            }
+
+            // Constructors, move constructors, assigment operators........
+            scoped_detour() = default;
+            scoped_detour(const scoped_detour&) = delete;
+            scoped_detour(scoped_detour&& rhs) : base(std::move(rhs)), trampoline(rhs.trampoline), trampoline_size(rhs.trampoline_size)
+            { rhs.trampoline = nullptr; }
+            scoped_detour& operator=(const scoped_detour& rhs) = delete;
+            scoped_detour& operator=(scoped_detour&& rhs)
+            {
+                this->restore();
+                base::operator=(std::move(rhs));
+                std::swap(this->trampoline, rhs.trampoline);
+                std::swap(this->trampoline_size, rhs.trampoline_size);
+                return *this;
+            }
+
+            scoped_detour(memory_pointer_tr at, memory_pointer_raw dest, bool vp = true)
+            { make_detour(at, dest, vp); }
+
+            ~scoped_detour()
+            {
+                this->restore();
+            }
+    };
+}
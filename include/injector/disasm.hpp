@@ -0,0 +1,364 @@
+/*
+ *  Injectors - x86 / x86-64 Instruction Length Decoder
+ *
+ *  Copyright (C) 2014 LINK/2012 <dma_2012@hotmail.com>
+ *
+ *  This software is provided 'as-is', without any express or implied
+ *  warranty. In no event will the authors be held liable for any damages
+ *  arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *     1. The origin of this software must not be misrepresented; you must not
+ *     claim that you wrote the original software. If you use this software
+ *     in a product, an acknowledgment in the product documentation would be
+ *     appreciated but is not required.
+ *
+ *     2. Altered source versions must be plainly marked as such, and must not be
+ *     misrepresented as being the original software.
+ *
+ *     3. This notice may not be removed or altered from any source
+ *     distribution.
+ *
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/*
+ *  This isn't a full disassembler, it only finds out the layout of an instruction (prefixes, opcode, ModRM, SIB,
+ *  displacement and immediate) which is what we need to know the instruction length and where a branch goes to.
+ *  The decoding is driven by the opcode tables below, one entry of flags for each opcode byte.
+ */
+
+namespace injector
+{
+    // Lowest level stuff (opcode tables) goes on the following namespace
+    // PRIVATE! Skip this, not interesting for you.
+    namespace injector_disasm
+    {
+        enum : uint16_t
+        {
+            M   = 0x0001,   // Has a ModRM byte
+            I8  = 0x0002,   // Has a 8 bits immediate
+            I16 = 0x0004,   // Has a 16 bits immediate
+            IZ  = 0x0008,   // Has a 16 or 32 bits immediate (operand size)
+            IV  = 0x0010,   // Has a 16, 32 or 64 bits immediate (operand size, REX.W)
+            AM  = 0x0020,   // Has a memory offset immediate (address size)
+            R8  = 0x0040,   // Has a 8 bits relative branch displacement
+            RZ  = 0x0080,   // Has a 16 or 32 bits relative branch displacement
+            P   = 0x0100,   // Is a legacy prefix
+            X   = 0x0200,   // Invalid opcode
+            X64 = 0x0400,   // Invalid opcode in 64 bits mode
+            G   = 0x0800,   // Group 3 (F6, F7), only TEST has an immediate
+            ESC = 0x1000,   // Escapes into another opcode map or may be a VEX/XOP/EVEX prefix
+        };
+
+        template<class = void>
+        struct tables
+        {
+            // One byte opcodes
+            static constexpr uint16_t map0[256] =
+            {
+                /*       0       1       2       3       4       5       6       7       8       9       A       B       C       D       E       F  */
+                /* 0 */  M,      M,      M,      M,      I8,     IZ,     X64,    X64,    M,      M,      M,      M,      I8,     IZ,     X64,    ESC,
+                /* 1 */  M,      M,      M,      M,      I8,     IZ,     X64,    X64,    M,      M,      M,      M,      I8,     IZ,     X64,    X64,
+                /* 2 */  M,      M,      M,      M,      I8,     IZ,     P,      X64,    M,      M,      M,      M,      I8,     IZ,     P,      X64,
+                /* 3 */  M,      M,      M,      M,      I8,     IZ,     P,      X64,    M,      M,      M,      M,      I8,     IZ,     P,      X64,
+                /* 4 */  0,      0,      0,      0,      0,      0,      0,      0,      0,      0,      0,      0,      0,      0,      0,      0,
+                /* 5 */  0,      0,      0,      0,      0,      0,      0,      0,      0,      0,      0,      0,      0,      0,      0,      0,
+                /* 6 */  X64,    X64,    M|ESC,  M,      P,      P,      P,      P,      IZ,     M|IZ,   I8,     M|I8,   0,      0,      0,      0,
+                /* 7 */  R8,     R8,     R8,     R8,     R8,     R8,     R8,     R8,     R8,     R8,     R8,     R8,     R8,     R8,     R8,     R8,
+                /* 8 */  M|I8,   M|IZ,   M|I8|X64, M|I8, M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M|ESC,
+                /* 9 */  0,      0,      0,      0,      0,      0,      0,      0,      0,      0,   I16|IZ|X64, 0,     0,      0,      0,      0,
+                /* A */  AM,     AM,     AM,     AM,     0,      0,      0,      0,      I8,     IZ,     0,      0,      0,      0,      0,      0,
+                /* B */  I8,     I8,     I8,     I8,     I8,     I8,     I8,     I8,     IV,     IV,     IV,     IV,     IV,     IV,     IV,     IV,
+                /* C */  M|I8,   M|I8,   I16,    0,      M|ESC,  M|ESC,  M|I8,   M|IZ,   I16|I8, 0,      I16,    0,      0,      I8,     X64,    0,
+                /* D */  M,      M,      M,      M,      I8|X64, I8|X64, X,      0,      M,      M,      M,      M,      M,      M,      M,      M,
+                /* E */  R8,     R8,     R8,     R8,     I8,     I8,     I8,     I8,     RZ,     RZ,  I16|IZ|X64, R8,    0,      0,      0,      0,
+                /* F */  P,      0,      P,      P,      0,      0,      M|G,    M|G,    0,      0,      0,      0,      0,      0,      M,      M,
+            };
+
+            // Two bytes opcodes (0F xx)
+            static constexpr uint16_t map1[256] =
+            {
+                /*       0       1       2       3       4       5       6       7       8       9       A       B       C       D       E       F  */
+                /* 0 */  M,      M,      M,      M,      X,      0,      0,      0,      0,      0,      X,      0,      X,      M,      0,      M|I8,
+                /* 1 */  M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,
+                /* 2 */  M,      M,      M,      M,      X,      X,      X,      X,      M,      M,      M,      M,      M,      M,      M,      M,
+                /* 3 */  0,      0,      0,      0,      0,      0,      X,      0,      ESC,    X,      ESC,    X,      X,      X,      X,      X,
+                /* 4 */  M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,
+                /* 5 */  M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,
+                /* 6 */  M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,
+                /* 7 */  M|I8,   M|I8,   M|I8,   M|I8,   M,      M,      M,      0,      M,      M,      X,      X,      M,      M,      M,      M,
+                /* 8 */  RZ,     RZ,     RZ,     RZ,     RZ,     RZ,     RZ,     RZ,     RZ,     RZ,     RZ,     RZ,     RZ,     RZ,     RZ,     RZ,
+                /* 9 */  M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,
+                /* A */  0,      0,      0,      M,      M|I8,   M,      X,      X,      0,      0,      0,      M,      M|I8,   M,      M,      M,
+                /* B */  M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M|I8,   M,      M,      M,      M,      M,
+                /* C */  M,      M,      M|I8,   M,      M|I8,   M|I8,   M|I8,   M,      0,      0,      0,      0,      0,      0,      0,      0,
+                /* D */  M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,
+                /* E */  M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,
+                /* F */  M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,
+            };
+        };
+
+        template<class T> constexpr uint16_t tables<T>::map0[256];
+        template<class T> constexpr uint16_t tables<T>::map1[256];
+    }
+
+    /*
+     *  x86_branch
+     *      Kind of control transfer an instruction does
+     */
+    enum class x86_branch : uint8_t
+    {
+        none,           // Not a branch
+        jmp,            // JMP rel8/rel32
+        call,           // CALL rel32
+        jcc,            // Jcc rel8/rel32, LOOPcc and JCXZ
+        jmp_indirect,   // JMP r/m
+        call_indirect,  // CALL r/m
+        ret,            // RET, RETF
+    };
+
+    /*
+     *  x86_instruction
+     *      Layout of a decoded instruction, all offsets are relative to the first byte of the instruction
+     */
+    struct x86_instruction
+    {
+        uint8_t     length;         // Length of the instruction in bytes, zero if it could not be decoded
+        uint8_t     opcode;         // The last opcode byte
+        uint8_t     opcode_map;     // 0 for one byte opcodes, 1 for 0F xx, 2 for 0F 38 xx, 3 for 0F 3A xx
+        uint8_t     modrm;          // The ModRM byte, if has_modrm
+        uint8_t     rex;            // The REX prefix, zero if none
+        uint8_t     disp_offset;    // Offset and size of the ModRM displacement
+        uint8_t     disp_size;
+        uint8_t     imm_offset;     // Offset and size of the immediate (or relative branch displacement)
+        uint8_t     imm_size;
+        bool        has_modrm;
+        bool        rip_relative;   // The ModRM memory operand is relative to the next instruction (x86-64 only)
+        bool        relative;       // The immediate is a displacement relative to the next instruction
+        x86_branch  branch;
+
+        // ModRM fields
+        uint8_t mod() const { return modrm >> 6; }
+        uint8_t reg() const { return (modrm >> 3) & 7; }
+        uint8_t rm() const  { return modrm & 7; }
+    };
+
+    /*
+     *  DecodeInstruction
+     *      Decodes the layout of the instruction at @code into @out in either 32 bits or 64 bits (@x64) mode
+     *      Returns the instruction length or zero if it is invalid
+     */
+    inline size_t DecodeInstruction(const uint8_t* code, x86_instruction& out, bool x64 = sizeof(void*) == 8)
+    {
+        using namespace injector_disasm;
+        static const size_t max_length = 15;
+
+        const uint8_t* p = code;
+        bool opsize16 = false, addrsize = false;
+        uint16_t flags;
+
+        memset(&out, 0, sizeof(out));
+
+        // Legacy prefixes and REX
+        for(;; ++p)
+        {
+            if(size_t(p - code) >= max_length)
+                return 0;
+            else if(tables<>::map0[*p] & P)
+            {
+                if(*p == 0x66) opsize16 = true;
+                if(*p == 0x67) addrsize = true;
+                out.rex = 0;                    // REX must be the last prefix, otherwise it's ignored
+            }
+            else if(x64 && (*p & 0xF0) == 0x40)
+                out.rex = *p;
+            else
+                break;
+        }
+
+        const bool rex_w = (out.rex & 0x08) != 0;
+        out.opcode = *p++;
+        flags = tables<>::map0[out.opcode];
+
+        if(flags & ESC)
+        {
+            const bool vex_or_evex = (out.opcode == 0x8F)? (*p & 0x1F) >= 8 :     // XOP has a map select of 8 or above
+                                     (out.opcode != 0x0F && (x64 || (*p >> 6) == 3));
+
+            if(out.opcode == 0x0F)
+            {
+                out.opcode_map = 1;
+                out.opcode = *p++;
+                flags = tables<>::map1[out.opcode];
+                if(flags & ESC)
+                {
+                    out.opcode_map = (out.opcode == 0x38? 2 : 3);
+                    out.opcode = *p++;
+                    flags = (out.opcode_map == 2? M : M|I8);
+                }
+            }
+            else if(vex_or_evex)
+            {
+                // VEX (C4, C5), XOP (8F) and EVEX (62) encoded instructions, all of them have a ModRM except VZEROUPPER/VZEROALL
+                if(out.opcode == 0xC5)                          out.opcode_map = 1, p += 1;
+                else if(out.opcode == 0xC4 || out.opcode == 0x8F) out.opcode_map = p[0] & 0x1F, p += 2;
+                else                                            out.opcode_map = p[0] & 0x07, p += 3;
+
+                out.opcode = *p++;
+                switch(out.opcode_map)
+                {
+                    case 1:  flags = (tables<>::map1[out.opcode] & I8) | (out.opcode == 0x77? 0 : M); break;
+                    case 3:  flags = M|I8; break;
+                    case 8:  flags = M|I8; break;   // XOP maps
+                    case 10: flags = M|IZ; break;
+                    default: flags = M; break;
+                }
+            }
+        }
+
+        if((flags & X) || (x64 && (flags & X64)))
+            return 0;
+
+        // ModRM, SIB and displacement
+        if(flags & M)
+        {
+            out.has_modrm = true;
+            out.modrm = *p++;
+
+            size_t disp = 0;
+            if(!x64 && addrsize)
+            {
+                // 16 bits addressing
+                if(out.mod() == 0 && out.rm() == 6)  disp = 2;
+                else if(out.mod() == 1)               disp = 1;
+                else if(out.mod() == 2)               disp = 2;
+            }
+            else if(out.mod() != 3)
+            {
+                if(out.rm() == 4 && (*p++ & 7) == 5 && out.mod() == 0)
+                    disp = 4;
+                else if(out.mod() == 0 && out.rm() == 5)
+                    disp = 4, out.rip_relative = x64;
+                else if(out.mod() == 1)
+                    disp = 1;
+                else if(out.mod() == 2)
+                    disp = 4;
+            }
+
+            out.disp_offset = uint8_t(p - code);
+            out.disp_size = uint8_t(disp);
+            p += disp;
+        }
+
+        // Immediates
+        size_t imm = 0;
+        if(flags & G)   imm = (out.reg() < 2? (out.opcode == 0xF6? 1 : opsize16? 2 : 4) : 0);
+        if(flags & I8)  imm += 1;
+        if(flags & I16) imm += 2;
+        if(flags & IZ)  imm += (opsize16? 2 : 4);
+        if(flags & IV)  imm += (rex_w? 8 : opsize16? 2 : 4);
+        if(flags & AM)  imm += (x64? (addrsize? 4 : 8) : (addrsize? 2 : 4));
+        if(flags & R8)  imm += 1;
+        if(flags & RZ)  imm += (!x64 && opsize16? 2 : 4);
+
+        out.imm_offset = uint8_t(p - code);
+        out.imm_size = uint8_t(imm);
+        out.relative = (flags & (R8|RZ)) != 0;
+        p += imm;
+
+        if(size_t(p - code) > max_length)
+            return 0;
+        out.length = uint8_t(p - code);
+
+        // Find out the kind of branch
+        if(out.opcode_map == 0)
+        {
+            switch(out.opcode)
+            {
+                case 0xE8:
+                    out.branch = x86_branch::call;
+                    break;
+                case 0xE9: case 0xEB:
+                    out.branch = x86_branch::jmp;
+                    break;
+                case 0xC2: case 0xC3: case 0xCA: case 0xCB:
+                    out.branch = x86_branch::ret;
+                    break;
+                case 0xFF:
+                    if(out.reg() == 2 || out.reg() == 3) out.branch = x86_branch::call_indirect;
+                    if(out.reg() == 4 || out.reg() == 5) out.branch = x86_branch::jmp_indirect;
+                    break;
+                default:
+                    if((out.opcode & 0xF0) == 0x70 || (out.opcode & 0xFC) == 0xE0)
+                        out.branch = x86_branch::jcc;
+                    break;
+            }
+        }
+        else if(out.opcode_map == 1 && (out.opcode & 0xF0) == 0x80)
+        {
+            out.branch = x86_branch::jcc;
+        }
+
+        return out.length;
+    }
+
+    /*
+     *  GetInstructionLength
+     *      Gets the length of the instruction at @code, zero if it is invalid
+     */
+    inline size_t GetInstructionLength(const uint8_t* code, bool x64 = sizeof(void*) == 8)
+    {
+        x86_instruction ins;
+        return DecodeInstruction(code, ins, x64);
+    }
+
+    /*
+     *  GetRelativeImmediate
+     *      Gets the sign extended relative displacement of the decoded branch @ins at @code
+     */
+    inline intptr_t GetRelativeImmediate(const uint8_t* code, const x86_instruction& ins)
+    {
+        switch(ins.imm_size)
+        {
+            case 1: return intptr_t(int8_t(code[ins.imm_offset]));
+            case 2: { int16_t v; memcpy(&v, code + ins.imm_offset, 2); return v; }
+            case 4: { int32_t v; memcpy(&v, code + ins.imm_offset, 4); return v; }
+        }
+        return 0;
+    }
+
+    /*
+     *  GetBranchTarget
+     *      Gets the destination of the decoded branch instruction @ins which is at @code
+     *      Only knows relative branches and indirect branches thought an absolute (or RIP-relative) memory address,
+     *      returns nullptr for everything else.
+     */
+    inline void* GetBranchTarget(const uint8_t* code, const x86_instruction& ins)
+    {
+        const uint8_t* next = code + ins.length;
+
+        if(ins.relative)
+            return (void*)(next + GetRelativeImmediate(code, ins));
+
+        if((ins.branch == x86_branch::jmp_indirect || ins.branch == x86_branch::call_indirect)
+        && (ins.reg() == 2 || ins.reg() == 4) && ins.mod() == 0 && ins.rm() == 5)
+        {
+            int32_t disp;
+            memcpy(&disp, code + ins.disp_offset, sizeof(disp));
+
+            void* target;
+            const uint8_t* slot = ins.rip_relative? next + disp : (const uint8_t*)(uintptr_t)(uint32_t)(disp);
+            memcpy(&target, slot, sizeof(target));
+            return target;
+        }
+
+        return nullptr;
+    }
+}
@@ -0,0 +1,442 @@
+/*
+ *  Injectors - Call Dispatchers
+ *
+ *  Copyright (C) 2014 LINK/2012 <dma_2012@hotmail.com>
+ *
+ *  This software is provided 'as-is', without any express or implied
+ *  warranty. In no event will the authors be held liable for any damages
+ *  arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *     1. The origin of this software must not be misrepresented; you must not
+ *     claim that you wrote the original software. If you use this software
+ *     in a product, an acknowledgment in the product documentation would be
+ *     appreciated but is not required.
+ *
+ *     2. Altered source versions must be plainly marked as such, and must not be
+ *     misrepresented as being the original software.
+ *
+ *     3. This notice may not be removed or altered from any source
+ *     distribution.
+ *
+ */
+#pragma once
+#include "injector.hpp"
+#include "hooking.hpp"
+#include "arena.hpp"
+#include "detour.hpp"   // for injector_detour::emit_jmp
+#include <type_traits>
+#include <vector>
+
+/*
+ *  A dispatcher is a bit of machine code generated for a call site which calls every handler with the arguments given to
+ *  the call, then jumps into the original function, whose return value is the one the game gets. There's no shim and no
+ *  indirect call in the way, so the overhead of a hook is a few instructions above calling its handler directly.
+ *  Handlers observe the call (or change what its pointer arguments point to), they can't skip the original function or
+ *  replace its return value; use function_hooker for that.
+ *
+ *      scoped_dispatcher<void(*)(int, float)> d;
+ *      d.make_dispatcher(0x53E550);
+ *      d.add([](int a, float b) { ... });
+ *
+ *  Whenever the handlers change a new dispatcher gets generated and the call site is atomically pointed into it, so threads
+ *  running the game never see a half written call. The old dispatchers are kept until restore(), as some thread may still be
+ *  inside one of them. In x86-64 the arguments must be scalars (integers, floating points, pointers or references).
+ */
+
+namespace injector
+{
+    // Lowest level stuff (code generation) goes on the following namespace
+    // PRIVATE! Skip this, not interesting for you.
+    namespace injector_dispatcher
+    {
+        static const size_t max_args = 32;
+
+        // What the code generator has to know about the arguments of a handler
+        struct signature
+        {
+            size_t count;               // Number of arguments
+            bool   floats[max_args];    // Whether each argument goes in a vector register (x86-64)
+            size_t stack;               // Size of all the arguments in the stack (x86)
+        };
+
+        template<class A>
+        struct arg_info
+        {
+            using value_type = typename std::conditional<std::is_reference<A>::value, void*, A>::type;
+            static_assert(sizeof(void*) == 4 || std::is_scalar<value_type>::value,
+                          "The arguments of a dispatcher handler must be scalars in x86-64");
+            static_assert(!std::is_same<value_type, long double>::value, "long double arguments aren't supported");
+
+            static const bool   is_float = std::is_floating_point<value_type>::value;
+            static const size_t size     = (sizeof(value_type) + 3) & ~size_t(3);
+        };
+
+        template<class ...A>
+        inline signature make_signature()
+        {
+            static_assert(sizeof...(A) <= max_args, "Too many arguments for a dispatcher handler");
+            const bool   floats[] = { false, arg_info<A>::is_float... };
+            const size_t sizes[]  = { 0, arg_info<A>::size... };
+
+            signature s = { sizeof...(A), {}, 0 };
+            for(size_t i = 0; i < sizeof...(A); ++i)
+            {
+                s.floats[i] = floats[i + 1];
+                s.stack    += sizes[i + 1];
+            }
+            return s;
+        }
+
+        template<class Handler>
+        struct handler_traits;
+
+        template<class Ret, class ...Args>
+        struct handler_traits<Ret(*)(Args...)>
+        {
+            static signature get() { return make_signature<Args...>(); }
+        };
+
+    #if defined(_WIN32) && !defined(_WIN64)    // The following calling conventions are a Windows thing
+        template<class Ret, class ...Args>
+        struct handler_traits<Ret(__stdcall*)(Args...)>
+        {
+            static signature get() { return make_signature<Args...>(); }
+        };
+
+        template<class Ret, class ...Args>
+        struct handler_traits<Ret(__fastcall*)(Args...)>
+        {
+            static signature get() { return make_signature<Args...>(); }
+        };
+
+        template<class Ret, class ...Args>
+        struct handler_traits<Ret(__thiscall*)(Args...)>
+        {
+            static signature get() { return make_signature<Args...>(); }
+        };
+    #endif
+
+        // Appends machine code to a buffer which is going to live at @base
+        struct emitter
+        {
+            std::vector<uint8_t>& code;
+            uintptr_t             base;     // Zero while only finding out the size, everything is assumed to be far then
+
+            void byte(uint8_t b)            { code.push_back(b); }
+            void bytes(std::initializer_list<uint8_t> b) { code.insert(code.end(), b.begin(), b.end()); }
+            void imm32(int32_t v)           { code.insert(code.end(), (uint8_t*)(&v), (uint8_t*)(&v) + 4); }
+            void imm64(uint64_t v)          { code.insert(code.end(), (uint8_t*)(&v), (uint8_t*)(&v) + 8); }
+            uintptr_t here() const          { return base + code.size(); }
+
+            // Checks whether a rel32 ending @size bytes from here can reach @dest
+            bool near(uintptr_t dest, size_t size) const
+            {
+                return base != 0 && injector_detour::fits_rel32(here() + size, dest);
+            }
+
+            // Jumps into @dest, with the longest jump while finding out the size
+            void jmp(uintptr_t dest)
+            {
+                uint8_t buf[14];
+                code.insert(code.end(), buf, buf + (base? injector_detour::emit_jmp(buf, here(), dest) : sizeof(buf)));
+            }
+        };
+
+    #if defined(_M_X64) || defined(__x86_64__)
+        // Generates a dispatcher at @base (zero to find out its size) calling @handlers and then jumping into @original
+        //      push rbp; mov rbp, rsp; sub rsp, frame; <save the argument registers>
+        //      for each handler: <copy the stack arguments>; call handler; <restore the argument registers>
+        //      leave; jmp original
+        inline void emit(std::vector<uint8_t>& code, uintptr_t base, const signature& sig,
+                         const std::vector<uintptr_t>& handlers, uintptr_t original)
+        {
+            emitter e = { code, base };
+        #ifdef _WIN32
+            const uint8_t gprs[] = { 1, 2, 8, 9 };              // rcx, rdx, r8, r9
+            const size_t  max_gpr = 4, max_xmm = 4, shadow = 32;
+        #else
+            const uint8_t gprs[] = { 7, 6, 2, 1, 8, 9 };        // rdi, rsi, rdx, rcx, r8, r9
+            const size_t  max_gpr = 6, max_xmm = 8, shadow = 0;
+        #endif
+
+            // Find out the argument registers (xmm ones are 16 onwards) and how many arguments are in the stack
+            uint8_t saved[max_args];
+            size_t  nsaved = 0, ngpr = 0, nxmm = 0, nstack = 0;
+            for(size_t i = 0; i < sig.count; ++i)
+            {
+            #ifdef _WIN32
+                ngpr = nxmm = i;                                // Arguments take the registers by position
+            #endif
+                if(sig.floats[i] && nxmm < max_xmm)         saved[nsaved++] = uint8_t(16 + nxmm++);
+                else if(!sig.floats[i] && ngpr < max_gpr)   saved[nsaved++] = gprs[ngpr++];
+                else                                        ++nstack;
+            }
+
+            const int32_t frame = int32_t((8 * (nsaved + nstack) + shadow + 15) & ~size_t(15));
+            auto slot = [](size_t k) { return -int32_t(8 * (k + 1)); };
+
+            // Moves the argument registers into their slots (@store) or back from them
+            auto move_args = [&](bool store)
+            {
+                for(size_t k = 0; k < nsaved; ++k)
+                {
+                    const uint8_t r = saved[k];
+                    if(r >= 16)
+                        e.bytes({ uint8_t(store? 0x66 : 0xF3), 0x0F, uint8_t(store? 0xD6 : 0x7E), uint8_t(0x85 | ((r - 16) << 3)) });
+                    else
+                        e.bytes({ uint8_t(0x48 | (r >= 8? 0x04 : 0)), uint8_t(store? 0x89 : 0x8B), uint8_t(0x85 | ((r & 7) << 3)) });
+                    e.imm32(slot(k));
+                }
+            };
+
+            e.bytes({ 0x55, 0x48, 0x89, 0xE5, 0x48, 0x81, 0xEC });  // push rbp; mov rbp, rsp; sub rsp, frame
+            e.imm32(frame);
+            move_args(true);
+
+            for(uintptr_t h : handlers)
+            {
+                for(size_t j = 0; j < nstack; ++j)
+                {
+                    e.bytes({ 0x48, 0x8B, 0x85 });                  // mov rax, [rbp + 16 + shadow + 8j]
+                    e.imm32(int32_t(16 + shadow + 8 * j));
+                    e.bytes({ 0x48, 0x89, 0x84, 0x24 });            // mov [rsp + shadow + 8j], rax
+                    e.imm32(int32_t(shadow + 8 * j));
+                }
+
+                if(e.near(h, 5))
+                {
+                    e.byte(0xE8);                                   // call rel32
+                    e.imm32(int32_t(h - (e.here() + 4)));
+                }
+                else
+                {
+                    e.bytes({ 0x49, 0xBB });                        // mov r11, imm64; call r11
+                    e.imm64(h);
+                    e.bytes({ 0x41, 0xFF, 0xD3 });
+                }
+                move_args(false);
+            }
+
+            e.byte(0xC9);                                           // leave
+            e.jmp(original);
+        }
+    #else
+        // Generates a dispatcher at @base (zero to find out its size) calling @handlers and then jumping into @original
+        //      push ebp; mov ebp, esp; sub esp, frame; <save ecx and edx>
+        //      for each handler: <copy the stack arguments>; <restore ecx and edx>; call handler; lea esp, [ebp - frame]
+        //      <restore ecx and edx>; leave; jmp original
+        // Resetting esp after each call undoes whatever the handler popped, so any calling convention works.
+        inline void emit(std::vector<uint8_t>& code, uintptr_t base, const signature& sig,
+                         const std::vector<uintptr_t>& handlers, uintptr_t original)
+        {
+            emitter e = { code, base };
+            const size_t  dwords = sig.stack / 4;
+            const int32_t frame  = int32_t(((8 + 4 * dwords + 8 + 15) & ~size_t(15)) - 8);    // Keeps 16 bytes alignment at the calls
+
+            auto load_regs = [&]() { e.bytes({ 0x8B, 0x4D, 0xFC, 0x8B, 0x55, 0xF8 }); };      // mov ecx, [ebp-4]; mov edx, [ebp-8]
+
+            e.bytes({ 0x55, 0x89, 0xE5, 0x81, 0xEC });              // push ebp; mov ebp, esp; sub esp, frame
+            e.imm32(frame);
+            e.bytes({ 0x89, 0x4D, 0xFC, 0x89, 0x55, 0xF8 });        // mov [ebp-4], ecx; mov [ebp-8], edx
+
+            for(uintptr_t h : handlers)
+            {
+                for(size_t j = 0; j < dwords; ++j)
+                {
+                    e.bytes({ 0x8B, 0x85 });                        // mov eax, [ebp + 8 + 4j]
+                    e.imm32(int32_t(8 + 4 * j));
+                    e.bytes({ 0x89, 0x84, 0x24 });                  // mov [esp + 4j], eax
+                    e.imm32(int32_t(4 * j));
+                }
+                load_regs();
+                e.byte(0xE8);                                       // call rel32
+                e.imm32(int32_t(h - (e.here() + 4)));
+                e.bytes({ 0x8D, 0xA5 });                            // lea esp, [ebp - frame]
+                e.imm32(-frame);
+            }
+
+            load_regs();
+            e.byte(0xC9);                                           // leave
+            e.jmp(original);
+        }
+    #endif
+    }
+
+
+    /*
+     *  scoped_dispatcher
+     *      Calls a list of raw handlers of type Handler (a function pointer with the same arguments and calling convention
+     *      as the call being hooked) before the original function, thought machine code generated for the call site
+     *      Make sure no thread is running a dispatcher by the time this gets restored
+     */
+    template<class Handler>
+    class scoped_dispatcher : public scoped_basic<5>
+    {
+        private:
+            using base = scoped_basic<5>;
+
+            struct stub
+            {
+                void*  p;
+                size_t size;
+            };
+
+            std::vector<Handler> handlers;                  // In calling order
+            memory_pointer_raw   site = nullptr;            // The call being hooked
+            bool                 vp = true;
+            void*                original_ = nullptr;       // Where the call used to go into
+            stub                 current = { nullptr, 0 };  // The dispatcher in use
+            std::vector<stub>    retired;                   // Replaced dispatchers, some thread may still be running them
+
+            // Generates a dispatcher for the current handlers and atomically makes the call site go into it
+            bool rebuild()
+            {
+                auto& arena = executable_arena::singleton();
+                const auto sig = injector_dispatcher::handler_traits<Handler>::get();
+
+                std::vector<uintptr_t> targets;
+                for(auto h : handlers) targets.push_back(uintptr_t((void*)(h)));
+
+                // Find out how big the dispatcher is, then generate it again for the place it'll actually live at
+                std::vector<uint8_t> code;
+                injector_dispatcher::emit(code, 0, sig, targets, uintptr_t(original_));
+                const size_t size = code.size();
+
+                uint8_t* p = (uint8_t*) arena.allocate(size, site.get<void>());
+                if(p == nullptr)
+                    return false;
+
+                code.clear();
+                injector_dispatcher::emit(code, uintptr_t(p), sig, targets, uintptr_t(original_));
+                memcpy(p, code.data(), code.size());
+
+                if(!MakeCALLAtomic(site, p, this->vp))
+                {
+                    arena.deallocate(p, size);
+                    return false;
+                }
+
+                if(current.p) retired.push_back(current);
+                current = stub { p, size };
+                return true;
+            }
+
+        public:
+            // Takes over the call at @at, returns false on failure
+            // It must be a relative call (E8), the dispatcher relies on the return address it pushes and is swapped in atomically.
+            bool make_dispatcher(memory_pointer_tr at, bool vp = true)
+            {
+                this->restore();
+                if(ReadMemory<uint8_t>(at, vp) != 0xE8)
+                    return false;
+
+                this->original_ = GetBranchDestination(at, vp).get<void>();
+                if(this->original_ == nullptr)
+                    return false;
+
+                this->site = at.get<void>();
+                this->vp = vp;
+                this->save(at, 5, vp);
+
+                if(!this->rebuild())
+                {
+                    this->restore();
+                    return false;
+                }
+                return true;
+            }
+
+            // Adds @handler to the end of the chain, returns false if the dispatcher could not be generated
+            bool add(Handler handler)
+            {
+                handlers.push_back(handler);
+                if(this->current.p && !this->rebuild())
+                {
+                    handlers.pop_back();
+                    return false;
+                }
+                return true;
+            }
+
+            // Removes @handler from the chain, returns false if it isn't there or if the dispatcher could not be generated
+            bool remove(Handler handler)
+            {
+                for(size_t i = 0; i < handlers.size(); ++i)
+                {
+                    if(handlers[i] == handler)
+                    {
+                        handlers.erase(handlers.begin() + i);
+                        if(this->current.p && !this->rebuild())
+                        {
+                            handlers.insert(handlers.begin() + i, handler);
+                            return false;
+                        }
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            // Number of handlers in the chain
+            size_t size() const
+            {
+                return handlers.size();
+            }
+
+            // Gets the function the call used to go into
+            memory_pointer_raw original() const
+            {
+                return original_;
+            }
+
+            // Restores the call and frees the dispatchers (the handlers are kept for the next make_dispatcher)
+            virtual void restore()
+            {
+                auto& arena = executable_arena::singleton();
+
+                // Put the original call back atomically first, then write the saved bytes (the same ones)
+                if(current.p)
+                    MakeCALLAtomic(site, original_, this->vp);
+                base::restore();
+                for(auto& s : retired)
+                    arena.deallocate(s.p, s.size);
+                if(current.p) arena.deallocate(current.p, current.size);
+                retired.clear();
+                current = stub { nullptr, 0 };
+            }
+
+            // Constructors, move constructors, assigment operators........
+            scoped_dispatcher() = default;
+            scoped_dispatcher(const scoped_dispatcher&) = delete;
+            scoped_dispatcher(scoped_dispatcher&& rhs)
+                : base(std::move(rhs)), handlers(std::move(rhs.handlers)), site(rhs.site), vp(rhs.vp), original_(rhs.original_),
+                  current(rhs.current), retired(std::move(rhs.retired))
+            {
+                rhs.current = stub { nullptr, 0 };
+                rhs.retired.clear();
+            }
+            scoped_dispatcher& operator=(const scoped_dispatcher& rhs) = delete;
+            scoped_dispatcher& operator=(scoped_dispatcher&& rhs)
+            {
+                this->restore();
+                base::operator=(std::move(rhs));
+                std::swap(this->handlers, rhs.handlers);
+                std::swap(this->retired, rhs.retired);
+                std::swap(this->current, rhs.current);
+                this->site = rhs.site, this->vp = rhs.vp, this->original_ = rhs.original_;
+                return *this;
+            }
+
+            scoped_dispatcher(memory_pointer_tr at, bool vp = true)
+            { make_dispatcher(at, vp); }
+
+            ~scoped_dispatcher()
+            {
+                this->restore();
+            }
+    };
+}
@@ -0,0 +1,243 @@
+/*
+ *  Injectors - Epoch Based Reclamation
+ *
+ *  Copyright (C) 2014 LINK/2012 <dma_2012@hotmail.com>
+ *
+ *  This software is provided 'as-is', without any express or implied
+ *  warranty. In no event will the authors be held liable for any damages
+ *  arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *     1. The origin of this software must not be misrepresented; you must not
+ *     claim that you wrote the original software. If you use this software
+ *     in a product, an acknowledgment in the product documentation would be
+ *     appreciated but is not required.
+ *
+ *     2. Altered source versions must be plainly marked as such, and must not be
+ *     misrepresented as being the original software.
+ *
+ *     3. This notice may not be removed or altered from any source
+ *     distribution.
+ *
+ */
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ *  Lets readers walk shared data without taking any lock while writers replace it.
+ *  Writers publish a new copy of the data thought an atomic pointer and retire the old one, which gets freed only after
+ *  every reader which could have seen it has left its read section.
+ *
+ *      {
+ *          epoch_manager::read_guard guard;
+ *          auto p = shared.load();     // p is safe to use until the guard goes away
+ *      }
+ *
+ *      auto old = shared.exchange(new_copy);
+ *      epoch_manager::singleton().retire(old);
+ *
+ *  Each Tag of basic_epoch_manager is a domain of its own, with its own epoch and readers. A read section which runs
+ *  user code (as the hook chains do) should use its own domain, so that code can synchronize() the others.
+ */
+
+namespace injector
+{
+    /*
+     *  basic_epoch_manager
+     *      Epoch based reclamation for the library data read without locks, one domain per Tag
+     */
+    template<class Tag>
+    class basic_epoch_manager
+    {
+        public:
+            struct statistics
+            {
+                size_t threads;     // Threads which ever read (records are reused once a thread exits)
+                size_t pending;     // Retired objects still waiting for their readers
+                size_t reclaimed;   // Retired objects already freed
+            };
+
+        private:
+            // Per thread state, never freed, only reused after its thread exits
+            struct record
+            {
+                std::atomic<uint64_t>   active;     // Epoch seen when entering the read section, zero when outside
+                std::atomic<bool>       in_use;
+                unsigned                depth;      // Nesting of read sections, only touched by the owner thread
+                record*                 next;
+            };
+
+            struct retired
+            {
+                void*    p;
+                void   (*deleter)(void*);
+                uint64_t epoch;     // Readers from this epoch onwards can't see it
+            };
+
+            struct thread_slot
+            {
+                record* r = nullptr;
+                ~thread_slot() { if(r) r->in_use.store(false, std::memory_order_release); }
+            };
+
+            std::atomic<uint64_t>   epoch;
+            std::atomic<record*>    records;
+            std::mutex              mutex;      // Guards the retired list
+            std::vector<retired>    garbage;
+            size_t                  reclaimed;
+
+            basic_epoch_manager() : epoch(1), records(nullptr), reclaimed(0)
+            {}
+
+            // The record of the calling thread in this domain, nullptr if it never read
+            static thread_slot& this_slot()
+            {
+                static thread_local thread_slot slot;
+                return slot;
+            }
+
+            // Gets the record of the calling thread
+            record* this_record()
+            {
+                thread_slot& slot = this_slot();
+                if(slot.r == nullptr)
+                {
+                    for(record* r = records.load(std::memory_order_acquire); r; r = r->next)
+                    {
+                        bool expected = false;
+                        if(!r->in_use.load(std::memory_order_relaxed) && r->in_use.compare_exchange_strong(expected, true))
+                            return (slot.r = r);
+                    }
+
+                    record* r = new record;
+                    r->active.store(0, std::memory_order_relaxed);
+                    r->in_use.store(true, std::memory_order_relaxed);
+                    r->depth = 0;
+                    r->next = records.load(std::memory_order_relaxed);
+                    while(!records.compare_exchange_weak(r->next, r, std::memory_order_release, std::memory_order_relaxed)) {}
+                    slot.r = r;
+                }
+                return slot.r;
+            }
+
+            // Checks whether every reader but @self is outside of its read section or entered it at @e or later
+            bool readers_past(uint64_t e, const record* self = nullptr) const
+            {
+                for(record* r = records.load(std::memory_order_acquire); r; r = r->next)
+                {
+                    if(r == self) continue;
+                    const uint64_t a = r->active.load(std::memory_order_seq_cst);
+                    if(a != 0 && a < e) return false;
+                }
+                return true;
+            }
+
+            // Frees the retired objects nobody can be reading anymore, with the mutex locked
+            void collect()
+            {
+                size_t kept = 0;
+                for(auto& g : garbage)
+                {
+                    if(readers_past(g.epoch))
+                        g.deleter(g.p), ++reclaimed;
+                    else
+                        garbage[kept++] = g;
+                }
+                garbage.resize(kept);
+            }
+
+        public:
+            basic_epoch_manager(const basic_epoch_manager&) = delete;
+            basic_epoch_manager& operator=(const basic_epoch_manager&) = delete;
+
+            // Enters a read section, read sections may nest
+            void enter()
+            {
+                record* r = this_record();
+                if(r->depth++ == 0)
+                    r->active.store(epoch.load(std::memory_order_relaxed), std::memory_order_seq_cst);
+            }
+
+            // Leaves a read section
+            void leave()
+            {
+                record* r = this_record();
+                if(--r->depth == 0)
+                    r->active.store(0, std::memory_order_release);
+            }
+
+            // Hands @p over to be deleted by @deleter once no reader can see it anymore
+            // It must already be unreachable for new readers
+            void retire(void* p, void (*deleter)(void*))
+            {
+                const uint64_t e = epoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+                std::lock_guard<std::mutex> lock(mutex);
+                garbage.push_back(retired { p, deleter, e });
+                collect();
+            }
+
+            // Same as above but deletes @p as a T
+            template<class T>
+            void retire(T* p)
+            {
+                if(p) retire(p, [](void* x) { delete (T*)(x); });
+            }
+
+            // Waits until every other reader which was in a read section by now has left it
+            // The read section the calling thread may be in isn't waited for, it couldn't end meanwhile. Objects retired from
+            // there are still kept until it ends.
+            void synchronize()
+            {
+                const uint64_t e = epoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+                while(!readers_past(e, this_slot().r))
+                    std::this_thread::yield();
+
+                std::lock_guard<std::mutex> lock(mutex);
+                collect();
+            }
+
+            // Gets the state of the reclamation
+            statistics get_statistics()
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                statistics s = { 0, garbage.size(), reclaimed };
+                for(record* r = records.load(std::memory_order_acquire); r; r = r->next)
+                    ++s.threads;
+                return s;
+            }
+
+            // The epoch manager of this domain
+            // It's never destroyed, because threads may still be reading while the static objects get destroyed.
+            static basic_epoch_manager& singleton()
+            {
+                static basic_epoch_manager* mgr = new basic_epoch_manager();
+                return *mgr;
+            }
+
+            /*
+             *  RAII wrapper for a read section
+             */
+            class read_guard
+            {
+                public:
+                    read_guard()  { basic_epoch_manager::singleton().enter(); }
+                    ~read_guard() { basic_epoch_manager::singleton().leave(); }
+                    read_guard(const read_guard&) = delete;
+                    read_guard& operator=(const read_guard&) = delete;
+            };
+    };
+
+    /*
+     *  epoch_manager
+     *      The domain used by the library data
+     */
+    typedef basic_epoch_manager<void> epoch_manager;
+}
@@ -24,9 +24,26 @@
  *
  */
 #pragma once
+#ifdef _WIN32
 #include <windows.h>
+#include <tlhelp32.h>   // for CreateToolhelp32Snapshot
+#else
+#include <link.h>       // for dl_iterate_phdr
+#endif
 #include <cstdint>
 #include <cstdio>
+#include <cstring>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#ifndef INJECTOR_GVM_TRANSLATION_CACHE
+#define INJECTOR_GVM_TRANSLATION_CACHE 0
+#endif
 
 namespace injector
 {
@@ -119,10 +136,7 @@ class game_version_manager
         // Raises a error saying that you could not detect the game version
         void RaiseCouldNotDetect()
         {
-            MessageBoxA(0,
-                "Could not detect the game version\nContact the mod creator!",
-                PluginName, MB_ICONERROR
-            );
+            RaiseError("Could not detect the game version\nContact the mod creator!");
         }
 
         // Raises a error saying that the exe version is incompatible (and output the exe name)
@@ -133,7 +147,18 @@ class game_version_manager
                 "An incompatible exe version has been detected! (%s)\nContact the mod creator!",
                 GetVersionText(v)
                 );
-            MessageBoxA(0, buf, PluginName, MB_ICONERROR);
+            RaiseError(buf);
+        }
+
+    private:
+        // Shows the error message @msg to the user
+        void RaiseError(const char* msg)
+        {
+        #ifdef _WIN32
+            MessageBoxA(0, msg, PluginName, MB_ICONERROR);
+        #else
+            fprintf(stderr, "%s: %s\n", PluginName, msg);
+        #endif
         }
 };
 #else   // INJECTOR_GVM_DUMMY
@@ -146,6 +171,291 @@ class game_version_manager
 #endif  // INJECTOR_OWN_GVM
 
 
+/*
+ *  module_base_table
+ *      Where each loaded module wanted to be loaded at and where it has been loaded at, to undo ASLR
+ *      Addresses are given as the preferred (link time) ones, as seen on a disassembler, and translated to the running ones.
+ */
+class module_base_table
+{
+    public:
+        struct module
+        {
+            uintptr_t preferred;    // Base the module has been linked at
+            uintptr_t actual;       // Base the module has been loaded at
+            uintptr_t size;         // Size of the module image
+
+            // Value to add to a preferred address of this module to get its running address
+            uintptr_t delta() const { return actual - preferred; }
+        };
+
+    private:
+        module                          main;           // Known from construction, as main_delta() needs it
+        mutable std::vector<module>     by_preferred;   // Sorted by the preferred base, listed on first use
+        mutable std::vector<module>     by_actual;      // Sorted by the actual base, those never overlap
+        mutable std::atomic<bool>       listed;         // Whether the two above have been filled
+        mutable std::mutex              mutex;          // Taken to fill them
+
+        // Finds the module in @v which [begin, begin + size) contains @p, @begin being either the preferred or actual base
+        static const module* search(const std::vector<module>& v, uintptr_t module::*begin, uintptr_t p)
+        {
+            auto it = std::upper_bound(v.begin(), v.end(), p, [begin](uintptr_t p, const module& m) { return p < m.*begin; });
+            if(it == v.begin()) return nullptr;
+            const module& m = *(it - 1);
+            return p - m.*begin < m.size? &m : nullptr;
+        }
+
+    #ifdef _WIN32
+        // Reads the ImageBase from the module file, the loader overwrites the one in memory when relocating the module
+        static uintptr_t image_base_on_disk(const wchar_t* path, uintptr_t fallback)
+        {
+            HANDLE f = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                   NULL, OPEN_EXISTING, 0, NULL);
+            if(f == INVALID_HANDLE_VALUE) return fallback;
+
+            unsigned char buf[4096];
+            DWORD size = 0;
+            BOOL ok = ReadFile(f, buf, sizeof(buf), &size, NULL);
+            CloseHandle(f);
+
+            auto dos = (const IMAGE_DOS_HEADER*)(buf);
+            if(!ok || size < sizeof(IMAGE_DOS_HEADER) || dos->e_magic != IMAGE_DOS_SIGNATURE
+            || dos->e_lfanew < 0 || DWORD(dos->e_lfanew) + sizeof(IMAGE_NT_HEADERS) > size)
+                return fallback;
+
+            auto nt = (const IMAGE_NT_HEADERS*)(buf + dos->e_lfanew);
+            return nt->Signature == IMAGE_NT_SIGNATURE? uintptr_t(nt->OptionalHeader.ImageBase) : fallback;
+        }
+    #else
+        // Gets the module of an object reported by the dynamic linker, or one with no size if it has nothing loaded
+        // A position independent object is linked at zero, its preferred addresses are offsets into it
+        static module loaded_object(const dl_phdr_info* info)
+        {
+            uintptr_t begin = UINTPTR_MAX, end = 0;
+            for(int i = 0; i < info->dlpi_phnum; ++i)
+            {
+                const auto& ph = info->dlpi_phdr[i];
+                if(ph.p_type == PT_LOAD)
+                {
+                    begin = (std::min)(begin, uintptr_t(ph.p_vaddr & ~(ph.p_align? ph.p_align - 1 : 0)));
+                    end   = (std::max)(end, uintptr_t(ph.p_vaddr + ph.p_memsz));
+                }
+            }
+            return begin < end? module { begin, info->dlpi_addr + begin, end - begin } : module { 0, 0, 0 };
+        }
+    #endif
+
+        // Gets the main executable from its headers in memory, without listing the other modules
+        // On Windows the preferred base still comes from the file, as relocating the executable overwrites the one in memory
+        static module find_main()
+        {
+            module m = { 0, 0, 0 };
+        #ifdef _WIN32
+            const uintptr_t base = (uintptr_t) GetModuleHandle(NULL);
+            auto dos = (const IMAGE_DOS_HEADER*)(base);
+            auto nt  = (const IMAGE_NT_HEADERS*)(base + dos->e_lfanew);
+            m = module { base, base, nt->OptionalHeader.SizeOfImage };
+
+            wchar_t path[MAX_PATH];
+            DWORD length = GetModuleFileNameW(NULL, path, MAX_PATH);
+            if(length && length < MAX_PATH)
+                m.preferred = image_base_on_disk(path, base);
+        #else
+            // The first object reported by the dynamic linker is the main executable
+            dl_iterate_phdr([](dl_phdr_info* info, size_t, void* data) -> int
+            {
+                *(module*)(data) = loaded_object(info);
+                return 1;
+            }, &m);
+        #endif
+        #ifdef INJECTOR_GVM_PREFERRED_BASE
+            if(m.size) m.preferred = INJECTOR_GVM_PREFERRED_BASE;
+        #endif
+            return m;
+        }
+
+        // Lists the loaded modules into the lookup tables if not done yet
+        void list() const
+        {
+            if(listed.load(std::memory_order_acquire))
+                return;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if(listed.load(std::memory_order_relaxed))
+                return;
+
+            by_preferred.clear();
+            if(main.size) by_preferred.push_back(main);
+
+        #ifdef _WIN32
+            HANDLE snap = CreateToolhelp32Snapshot(TH32CS_SNAPMODULE, 0);
+            if(snap != INVALID_HANDLE_VALUE)
+            {
+                MODULEENTRY32W entry;
+                entry.dwSize = sizeof(entry);
+                for(BOOL ok = Module32FirstW(snap, &entry); ok; ok = Module32NextW(snap, &entry))
+                {
+                    const uintptr_t base = (uintptr_t) entry.modBaseAddr;
+                    if(base != main.actual)
+                        by_preferred.push_back(module { image_base_on_disk(entry.szExePath, base), base, entry.modBaseSize });
+                }
+                CloseHandle(snap);
+            }
+        #else
+            dl_iterate_phdr([](dl_phdr_info* info, size_t, void* data) -> int
+            {
+                std::vector<module>& v = *(std::vector<module>*)(data);
+                module m = loaded_object(info);
+                if(m.size && (v.empty() || m.actual != v.front().actual))
+                    v.push_back(m);
+                return 0;
+            }, &by_preferred);
+        #endif
+
+            by_actual = by_preferred;
+            std::sort(by_preferred.begin(), by_preferred.end(), [](const module& a, const module& b)
+            {
+                return a.preferred < b.preferred || (a.preferred == b.preferred && a.size < b.size);
+            });
+            std::sort(by_actual.begin(), by_actual.end(), [](const module& a, const module& b)
+            {
+                return a.actual < b.actual;
+            });
+            listed.store(true, std::memory_order_release);
+        }
+
+    public:
+        // Only the main executable is read here, the other modules are listed when first needed
+        module_base_table() : main(find_main()), listed(false)
+        {}
+
+        // Forgets the modules listed, so they're listed again when next needed; call it after loading or unloading modules
+        // The main executable is kept. Don't call it while other threads are using the table
+        void refresh()
+        {
+            listed.store(false, std::memory_order_relaxed);
+        }
+
+        // Number of modules in the table
+        size_t size() const
+        {
+            list();
+            return by_preferred.size();
+        }
+
+        // Gets the main executable
+        const module& main_module() const
+        {
+            return main;
+        }
+
+        // Finds the module which would contain the preferred address @p, the main executable first
+        // Modules linked at the same base (e.g. position independent objects at zero) are ambiguous, use translate(p, module) for those
+        const module* find(uintptr_t p) const
+        {
+            if(p - main.preferred < main.size)
+                return &main;
+            list();
+            return search(by_preferred, &module::preferred, p);
+        }
+
+        // Finds the module loaded around the running address @p
+        const module* find_loaded(uintptr_t p) const
+        {
+            if(p - main.actual < main.size)
+                return &main;
+            list();
+            return search(by_actual, &module::actual, p);
+        }
+
+        // Translates the preferred address @p into the running one, or returns nullptr if no module would contain it
+        void* translate(void* p) const
+        {
+            const module* m = find(uintptr_t(p));
+            return m? (void*)(uintptr_t(p) + m->delta()) : nullptr;
+        }
+
+        // Translates the preferred address @p of the module loaded around the running address @module (nullptr for the main executable)
+        // Returns nullptr if there's no module there
+        void* translate(void* p, const void* module) const
+        {
+            const module_base_table::module* m = module? find_loaded(uintptr_t(module)) : &main;
+            return m? (void*)(uintptr_t(p) + m->delta()) : nullptr;
+        }
+
+        // Table of the modules loaded when first used
+        static module_base_table& singleton()
+        {
+            static module_base_table table;
+            return table;
+        }
+
+        // Delta of the main executable, the fast path when only it is involved
+        // The delta is kept constant initialized so reading it needs no guard, the main executable never moves after the first read.
+        // For a constant @p, p + main_delta() is a single load and add. Computing it reads the main executable headers only,
+        // no module listing, so it's fine to use from a library initializer.
+        static uintptr_t main_delta()
+        {
+            static std::atomic<uintptr_t> delta(1);     // Deltas are multiple of the page size, one means not computed yet
+            uintptr_t d = delta.load(std::memory_order_relaxed);
+            if(d == 1)
+                delta.store(d = find_main().delta(), std::memory_order_relaxed);
+            return d;
+        }
+};
+
+
+// Lowest level stuff of the translation tables goes on the following namespace (the rest is in translator.hpp)
+// PRIVATE! Skip this, not interesting for you.
+namespace injector_translator
+{
+    // Number of trailing one bits of @k, which is never all ones
+    inline unsigned trailing_ones(size_t k)
+    {
+#ifdef _MSC_VER
+        unsigned long i;
+        _BitScanForward(&i, ~uint32_t(k));
+        return unsigned(i);
+#else
+        return unsigned(__builtin_ctz(~uint32_t(k)));
+#endif
+    }
+
+    // Addresses in [begin, end] translate into target + (p - begin)
+    struct segment
+    {
+        uintptr_t begin, end, target;
+    };
+
+    // Disjoint segments sorted by begin and the tree to search them, the arrays may live in the heap or in a mapped file
+    struct segment_view
+    {
+        const segment*   segments = nullptr;
+        const uintptr_t* tree = nullptr;    // Begin of the segments in Eytzinger order (from index 1)
+        const uint32_t*  rank = nullptr;    // Index in segments of each node of the tree
+        size_t           count = 0;
+
+        // Translates p, or returns nullptr if it isn't in the table
+        void* find(void* p) const
+        {
+            // Look for the first segment beginning after p, going down the tree without branching on the comparisons
+            const uintptr_t x = uintptr_t(p);
+            const size_t n = count;
+            size_t k = 1;
+            while(k <= n)
+                k = 2 * k + (tree[k] <= x);
+            k >>= trailing_ones(k) + 1;     // Go back up to where we last turned left
+
+            // The segment before that is the one that may have p
+            const size_t i = (k == 0? n : rank[k]);
+            if(i == 0 || x > segments[i - 1].end)
+                return nullptr;
+            return (void*)(segments[i - 1].target + (x - segments[i - 1].begin));
+        }
+    };
+}
+
+
 /*
  *  address_manager
  *      Address translator from 1.0 executables to other executables offsets
@@ -153,6 +463,24 @@ class game_version_manager
  */
 class address_manager : public game_version_manager
 {
+    public:
+        struct cache_statistics
+        {
+            size_t hits;        // Translations taken from the cache
+            size_t misses;      // Translations which had to go to the translator
+
+            // Ratio of translations taken from the cache
+            double hit_ratio() const { return hits + misses? double(hits) / double(hits + misses) : 0.0; }
+        };
+
+        // Immutable translation published by freeze(), searched by translate_address without any guard nor call
+        struct frozen_translation
+        {
+            injector_translator::segment_view table;            // Every translation, never changes once published
+            void*       (*fallback)(const void* data, void* p);   // Called for the addresses not in the table
+            const void* data;
+        };
+
     private:
         address_manager()
         {
@@ -167,11 +495,90 @@ class address_manager : public game_version_manager
                 void* translator(void* p) { return p; }
         #endif
 
+        // Two way set associative cache of the most recent translations, each thread has its own so lookups don't need locking
+        // Entries from an older generation are misses, that's how the whole cache gets thrown away at once
+        struct translation_cache
+        {
+            static const size_t sets = INJECTOR_GVM_TRANSLATION_CACHE? INJECTOR_GVM_TRANSLATION_CACHE : 1;
+            static_assert((sets & (sets - 1)) == 0, "INJECTOR_GVM_TRANSLATION_CACHE must be a power of two");
+
+            struct way
+            {
+                void*    key;
+                void*    value;
+                uint32_t generation;
+            };
+
+            way              ways[sets][2];     // The first way of a set is the most recently used one
+            cache_statistics stats;
+
+            static size_t index(void* p)
+            {
+                return size_t((uint32_t(uintptr_t(p)) * 2654435761u) >> 16) & (sets - 1);
+            }
+        };
+
+        static translation_cache& cache()
+        {
+            static thread_local translation_cache c;
+            return c;
+        }
+
+        // The frozen translation, constant initialized so reading it needs no guard
+        static std::atomic<const frozen_translation*>& frozen()
+        {
+            static std::atomic<const frozen_translation*> f(nullptr);
+            return f;
+        }
+
+        // Generation of the translations, starts at 1 so the zeroed cache is empty
+        static std::atomic<uint32_t>& generation()
+        {
+            static std::atomic<uint32_t> g(1);
+            return g;
+        }
+
     public:
         // Translates address p to the running executable pointer
         void* translate(void* p)
         {
+        #if defined(INJECTOR_GVM_HAS_TRANSLATOR) && INJECTOR_GVM_TRANSLATION_CACHE > 0
+            auto& c = cache();
+            auto& set = c.ways[translation_cache::index(p)];
+            const uint32_t gen = generation().load(std::memory_order_acquire);
+
+            if(set[0].key == p && set[0].generation == gen)
+            {
+                ++c.stats.hits;
+                return set[0].value;
+            }
+            if(set[1].key == p && set[1].generation == gen)
+            {
+                ++c.stats.hits;
+                std::swap(set[0], set[1]);
+                return set[0].value;
+            }
+
+            ++c.stats.misses;
+            void* result = translator(p);
+            set[1] = set[0];
+            set[0].key = p, set[0].value = result, set[0].generation = gen;
+            return result;
+        #else
             return translator(p);
+        #endif
+        }
+
+        // Throws away every cached translation, call this whenever the translator would give different results
+        static void invalidate()
+        {
+            generation().fetch_add(1, std::memory_order_acq_rel);
+        }
+
+        // Gets the statistics of the translation cache of the calling thread
+        static cache_statistics get_cache_statistics()
+        {
+            return cache().stats;
         }
         
         
@@ -186,8 +593,28 @@ class address_manager : public game_version_manager
         // Static version of translate()
         static void* translate_address(void* p)
         {
+            if(const frozen_translation* f = frozen().load(std::memory_order_acquire))
+            {
+                if(void* result = f->table.find(p))
+                    return result;
+                return f->fallback(f->data, p);
+            }
             return singleton().translate(p);
         }
+
+        // Makes translate_address search @f from now on, skipping the singleton, the translator and the translation cache
+        // There's no going back, @f must never change nor go away. Returns false (and does nothing) if already frozen by another.
+        static bool freeze(const frozen_translation* f)
+        {
+            const frozen_translation* expected = nullptr;
+            return f != nullptr && (frozen().compare_exchange_strong(expected, f, std::memory_order_acq_rel) || expected == f);
+        }
+
+        // Checks whether translate_address is using a frozen translation
+        static bool is_frozen()
+        {
+            return frozen().load(std::memory_order_acquire) != nullptr;
+        }
         
         //
         static void set_name(const char* modname)
@@ -195,17 +622,38 @@ class address_manager : public game_version_manager
             singleton().PluginName = modname;
         }
         
+        // Gets the address the main executable has been loaded at
+        static uintptr_t main_module_base()
+        {
+        #ifdef _WIN32
+            return (uintptr_t) GetModuleHandle(NULL);
+        #else
+            // The first object reported by the dynamic linker is the main executable
+            uintptr_t base = 0;
+            dl_iterate_phdr([](dl_phdr_info* info, size_t, void* data) -> int
+            {
+                for(int i = 0; i < info->dlpi_phnum; ++i)
+                {
+                    if(info->dlpi_phdr[i].p_type == PT_LOAD)
+                    {
+                        *(uintptr_t*)(data) = info->dlpi_addr + info->dlpi_phdr[i].p_vaddr;
+                        break;
+                    }
+                }
+                return 1;
+            }, &base);
+            return base;
+        #endif
+        }
+
     public:
         // Functors for memory translation:
 
-        // Translates aslr translator
+        // Translates aslr translator, from the preferred address of the main executable to the running one
         struct fn_mem_translator_aslr
         {
             void* operator()(void* p) const
-            {
-                static uintptr_t  module = (uintptr_t)GetModuleHandle(NULL);
-                return (void*)((uintptr_t)(p)-(0x400000 - module));
-            }
+            { return (void*)((uintptr_t)(p) + module_base_table::main_delta()); }
         };
 
         // Translates nothing translator
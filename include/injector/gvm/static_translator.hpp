@@ -0,0 +1,172 @@
+/*
+ *  Injectors - Compile Time Address Translation
+ *
+ *  Copyright (C) 2014 LINK/2012 <dma_2012@hotmail.com>
+ *
+ *  This software is provided 'as-is', without any express or implied
+ *  warranty. In no event will the authors be held liable for any damages
+ *  arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *     1. The origin of this software must not be misrepresented; you must not
+ *     claim that you wrote the original software. If you use this software
+ *     in a product, an acknowledgment in the product documentation would be
+ *     appreciated but is not required.
+ *
+ *     2. Altered source versions must be plainly marked as such, and must not be
+ *     misrepresented as being the original software.
+ *
+ *     3. This notice may not be removed or altered from any source
+ *     distribution.
+ *
+ */
+#pragma once
+
+/*
+ *  When the addresses of every game version are known beforehand, the translation can be done by the compiler instead.
+ *  Write the table as constexpr data, one row per address, the first column being the address on the base version
+ *  (the one used on your code) and the following columns the same address on the other versions; sorted by the first column:
+ *
+ *      constexpr uintptr_t sa_rows[][3] = {
+ *          //  1.0 US      1.0 EU      1.01 US
+ *          { 0x53E550,   0x53E550,   0x53EA40 },
+ *          { 0x58FBD6,   0x58FC26,   0x5903C6 },
+ *      };
+ *      constexpr injector::static_translation_table<3> sa_table(sa_rows);
+ *
+ *  Then INJECTOR_STATIC_ADDRESS(sa_table, 0x58FBD6) gives the address on the running version. The row is looked up at compile
+ *  time (an address missing from the table is a compile error), so what's left at runtime is a single indexed load from the
+ *  column of the running version, see static_translation_version().
+ *  If INJECTOR_GVM_STATIC_VERSION is defined to a column, the build targets that version only and the address is a constant.
+ *
+ *  This doesn't change memory_pointer: memory_pointer(0x58FBD6).get() (and so WriteMemory(0x58FBD6, ...)) still translates at runtime
+ *  thought address_manager, the compiler can't see thought that. Pass the result of INJECTOR_STATIC_ADDRESS wrapped by raw_ptr to keep
+ *  it free, raw pointers are never translated:
+ *
+ *      injector::WriteMemory(raw_ptr(INJECTOR_STATIC_ADDRESS(sa_table, 0x58FBD6)), 0x90, true);
+ *
+ *  The same table can translate the addresses only known at runtime, by being the address_manager translator (this needs
+ *  INJECTOR_GVM_HAS_TRANSLATOR defined), which is a binary search over the first column:
+ *
+ *      void* injector::address_manager::translator(void* p) { return sa_table.translate(p); }
+ */
+
+#include "../injector.hpp"
+#include <type_traits>
+
+namespace injector
+{
+    /*
+     *  static_translation_version
+     *      The column of the static translation tables used at runtime, set it after detecting the game version
+     *      Unused when the version is fixed by INJECTOR_GVM_STATIC_VERSION
+     */
+    inline size_t& static_translation_version()
+    {
+        static size_t version = 0;
+        return version;
+    }
+
+    /*
+     *  static_translation_table
+     *      Address translation table for Versions game versions, made of constexpr rows
+     */
+    template<size_t Versions>
+    class static_translation_table
+    {
+        public:
+            typedef uintptr_t row[Versions];
+
+        private:
+            const row*  rows;
+            size_t      count;
+
+            // Binary search of the row beginning with @addr in [lo, hi)
+            constexpr size_t search(uintptr_t addr, size_t lo, size_t hi) const
+            {
+                return lo >= hi?                    throw "address isn't in the translation table" :
+                       rows[lo + (hi - lo) / 2][0] == addr?  lo + (hi - lo) / 2 :
+                       rows[lo + (hi - lo) / 2][0] < addr?   search(addr, lo + (hi - lo) / 2 + 1, hi) :
+                                                             search(addr, lo, lo + (hi - lo) / 2);
+            }
+
+            // Checks the rows in [lo, hi) are sorted, splitting in halves so the recursion stays shallow
+            constexpr bool sorted(size_t lo, size_t hi) const
+            {
+                return hi - lo < 2 || (sorted(lo, lo + (hi - lo) / 2) && sorted(lo + (hi - lo) / 2, hi)
+                                      && rows[lo + (hi - lo) / 2 - 1][0] < rows[lo + (hi - lo) / 2][0]);
+            }
+
+        public:
+            template<size_t N>
+            constexpr static_translation_table(const row (&rows)[N]) : rows(rows), count(N)
+            {}
+
+            // Number of addresses in the table
+            constexpr size_t size() const
+            {
+                return count;
+            }
+
+            // Checks the table is sorted by the first column, as the lookups need it to be
+            // Use it on a static_assert next to the table
+            constexpr bool is_sorted() const
+            {
+                return sorted(0, count);
+            }
+
+            // Gets the row of @addr, fails to compile if it's not in the table when evaluated at compile time
+            constexpr size_t index(uintptr_t addr) const
+            {
+                return search(addr, 0, count);
+            }
+
+            // Gets the address of the row @i at the column @version
+            constexpr uintptr_t get(size_t i, size_t version) const
+            {
+                return rows[i][version];
+            }
+
+            // Gets the address of the row @i on the running version
+            uintptr_t get(size_t i) const
+            {
+            #ifdef INJECTOR_GVM_STATIC_VERSION
+                return rows[i][INJECTOR_GVM_STATIC_VERSION];
+            #else
+                return rows[i][static_translation_version()];
+            #endif
+            }
+
+            // Translates @p into the running version at runtime, for addresses not known at compile time
+            // Returns nullptr if it isn't in the table
+            void* translate(void* p) const
+            {
+                const uintptr_t addr = uintptr_t(p);
+                size_t lo = 0, hi = count;
+                while(lo < hi)
+                {
+                    const size_t mid = lo + (hi - lo) / 2;
+                    if(rows[mid][0] == addr) return (void*)(get(mid));
+                    if(rows[mid][0] < addr)  lo = mid + 1;
+                    else                     hi = mid;
+                }
+                return nullptr;
+            }
+    };
+}
+
+/*
+ *  INJECTOR_STATIC_ADDRESS
+ *      Translates the base version address @addr using the constexpr @table, as an uintptr_t
+ *      This is a constant expression when INJECTOR_GVM_STATIC_VERSION is defined, otherwise a load from the table
+ */
+#ifdef INJECTOR_GVM_STATIC_VERSION
+#define INJECTOR_STATIC_ADDRESS(table, addr) \
+    ((table).get(std::integral_constant<size_t, (table).index(addr)>::value, INJECTOR_GVM_STATIC_VERSION))
+#else
+#define INJECTOR_STATIC_ADDRESS(table, addr) \
+    ((table).get(std::integral_constant<size_t, (table).index(addr)>::value))
+#endif
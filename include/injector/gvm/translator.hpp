@@ -36,15 +36,238 @@
  *  At the constructor of your derived 'address_translator' make the map object to have [addr_to_translate] = translated_addr;
  *  There's also the virtual method 'fallback' that will get called when the translation wasn't possible, you can do some fallback stuff here
  *      (such as return the pointer as is or output a error message)
+ *  Whole functions or shifted sections can be translated at once with map_range(begin, end, new_begin) instead of one map entry per address.
+ *      Map entries of a translator win over its ranges.
+ *  The maps of the enabled translators get flattened into a single sorted table whenever a translator is constructed, destroyed,
+ *  enabled or disabled (and once more on the first translation after constructing one, as its constructor fills the map only after
+ *  that). If you change a map after that, call update() on the translator.
+ *  Translations never wait for a lock, they read a snapshot of the table which gets replaced as a whole when the translators change.
+ *      When other threads may be translating meanwhile, construct the translator disabled (address_translator(false)), fill the map
+ *      and only then enable() it. The same goes for changing the map later on: disable(), change it, enable().
+ *  Once every translator is in place, freeze() flattens them into a table for good, which translate_address searches without any
+ *      guard or cache. No translator can be added or changed afterwards.
+ *  Big tables can be kept in a file instead, made by save() on a translator with the map filled (e.g. by a small converter program)
+ *      and then used in place by a mapped_address_translator, without building any map at startup.
+ *
+ *  The file is a header followed by the flattened table, all of it in the native byte order and pointer size:
+ *      char      magic[4];         // "INJT"
+ *      uint32_t  version;          // injector_translator::file_version
+ *      uint32_t  pointer_size;     // sizeof(uintptr_t)
+ *      uint32_t  reserved;
+ *      uint64_t  count;            // Number of segments
+ *      uint64_t  checksum;         // FNV-1a of everything after the header
+ *      { uintptr_t begin, end, target; } segments[count];     // Disjoint and sorted, [begin, end] translates into target + (p - begin)
+ *      uintptr_t tree[count + 1];  // Begin of the segments in Eytzinger order (from index 1)
+ *      uint32_t  rank[count + 1];  // Index in segments of each node of the tree
  */
 
 #include "../injector.hpp"
+#include "../epoch.hpp"
+#include "../mapped_file.hpp"
 #include <list>
 #include <map>
+#include <vector>
+#include <queue>
+#include <memory>
+#include <atomic>
+#include <mutex>
 #include <algorithm>
+#include <cassert>
+#include <cstdio>
 
 namespace injector
 {
+    class address_translator;
+
+    // Lowest level stuff (the flattened tables and their files) goes on the following namespace
+    // PRIVATE! Skip this, not interesting for you.
+    namespace injector_translator
+    {
+        static const uint32_t file_version = 1;
+        static const size_t   max_ptr_dist = 7;     // How far after a map entry an address still translates thought it
+
+        // Translates every address in [begin, end) into new_begin + (p - begin)
+        struct range
+        {
+            memory_pointer_raw begin, end, new_begin;
+        };
+
+        // Same as segment_view (see gvm.hpp), owning the arrays
+        struct segment_table
+        {
+            std::vector<segment>    segments;
+            std::vector<uintptr_t>  tree;
+            std::vector<uint32_t>   rank;
+
+            segment_view view() const
+            {
+                segment_view v;
+                v.segments = segments.data(), v.tree = tree.data(), v.rank = rank.data(), v.count = segments.size();
+                return v;
+            }
+
+            // Lays the tree down over the segments
+            void build_tree()
+            {
+                const size_t n = segments.size();
+                tree.assign(n + 1, 0);
+                rank.assign(n + 1, 0);
+                size_t index = 0;
+                fill_tree(1, index);
+            }
+
+            void fill_tree(size_t node, size_t& index)
+            {
+                if(node <= segments.size())
+                {
+                    fill_tree(2 * node, index);
+                    tree[node] = segments[index].begin;
+                    rank[node] = uint32_t(index++);
+                    fill_tree(2 * node + 1, index);
+                }
+            }
+        };
+
+        // Part of the address space some translator translates
+        struct piece
+        {
+            uintptr_t begin, end, target;
+            size_t    priority;     // Translators first in the list win, and in a translator the map wins over the ranges
+        };
+
+        // Turns the map and the ranges of a translator into pieces
+        // An address translates thought the entry with the greatest address not above it, if that's no more than max_ptr_dist
+        // bytes away. Entries never cover the next one, and the last entry of a map covers only itself.
+        inline void add_pieces(std::vector<piece>& pieces, const std::map<memory_pointer_raw, memory_pointer_raw>& map,
+                               const std::vector<range>& ranges, size_t priority)
+        {
+            auto add_piece = [&](uintptr_t begin, uintptr_t end, uintptr_t target, size_t priority)
+            {
+                if(target == 0)     // Translating into null means not translating at all
+                {
+                    if(begin == end) return;
+                    ++begin, ++target;
+                }
+                pieces.push_back(piece { begin, end, target, priority });
+            };
+
+            for(auto it = map.begin(); it != map.end(); ++it)
+            {
+                auto next = std::next(it);
+                uintptr_t begin = it->first.as_int();
+                uintptr_t end = (next == map.end()? begin : begin + std::min<uintptr_t>(max_ptr_dist, next->first.as_int() - begin - 1));
+                add_piece(begin, end, it->second.as_int(), priority);
+            }
+            for(auto& r : ranges)
+                add_piece(r.begin.as_int(), r.end.as_int() - 1, r.new_begin.as_int(), priority + 1);
+        }
+
+        // Flattens the pieces into a table
+        inline void flatten(std::vector<piece>& pieces, segment_table& table)
+        {
+            std::sort(pieces.begin(), pieces.end(), [](const piece& a, const piece& b) { return a.begin < b.begin; });
+
+            // Sweep thought every place where a piece begins or ends, the winner in between is the active piece of highest priority
+            std::vector<uintptr_t> points;
+            points.reserve(pieces.size() * 2);
+            for(auto& x : pieces)
+            {
+                points.push_back(x.begin);
+                if(x.end != uintptr_t(-1)) points.push_back(x.end + 1);
+            }
+            std::sort(points.begin(), points.end());
+            points.erase(std::unique(points.begin(), points.end()), points.end());
+
+            auto lower = [&](size_t a, size_t b) { return pieces[a].priority > pieces[b].priority; };
+            std::priority_queue<size_t, std::vector<size_t>, decltype(lower)> active(lower);
+            auto& segments = table.segments;
+            segments.clear();
+            size_t next = 0, last = size_t(-1);
+            for(size_t i = 0; i < points.size(); ++i)
+            {
+                const uintptr_t x = points[i];
+                while(next < pieces.size() && pieces[next].begin <= x)
+                    active.push(next++);
+                while(!active.empty() && pieces[active.top()].end < x)
+                    active.pop();
+                if(active.empty())
+                    continue;
+
+                const size_t w = active.top();
+                const uintptr_t end = std::min(pieces[w].end, i + 1 < points.size()? points[i + 1] - 1 : uintptr_t(-1));
+                if(w == last && segments.back().end + 1 == x)
+                    segments.back().end = end;
+                else
+                    segments.push_back(segment { x, end, pieces[w].target + (x - pieces[w].begin) });
+                last = w;
+            }
+
+            table.build_tree();
+        }
+
+        struct file_header
+        {
+            char     magic[4];
+            uint32_t version;
+            uint32_t pointer_size;
+            uint32_t reserved;
+            uint64_t count;
+            uint64_t checksum;
+        };
+
+        // Size of the file with @count segments
+        inline uint64_t file_size(uint64_t count)
+        {
+            return sizeof(file_header) + count * sizeof(segment) + (count + 1) * (sizeof(uintptr_t) + sizeof(uint32_t));
+        }
+
+        // Checks the file at @data with @size bytes and points @view into it
+        inline bool load(const void* data, size_t size, segment_view& view)
+        {
+            const file_header* h = (const file_header*)(data);
+            if(data == nullptr || size < sizeof(file_header)
+            || memcmp(h->magic, "INJT", 4) != 0 || h->version != file_version || h->pointer_size != sizeof(uintptr_t)
+            || h->count > size / sizeof(segment) || file_size(h->count) != size)
+                return false;
+
+            const uint8_t* payload = (const uint8_t*)(data) + sizeof(file_header);
+            if(injector_file::hash(payload, size - sizeof(file_header)) != h->checksum)
+                return false;
+
+            view.count    = size_t(h->count);
+            view.segments = (const segment*)(payload);
+            view.tree     = (const uintptr_t*)(view.segments + view.count);
+            view.rank     = (const uint32_t*)(view.tree + view.count + 1);
+            return true;
+        }
+
+        // Writes @table into the file at @path
+        inline bool save(const char* path, const segment_table& table)
+        {
+            const size_t n = table.segments.size();
+            file_header h;
+            memcpy(h.magic, "INJT", 4);
+            h.version = file_version;
+            h.pointer_size = sizeof(uintptr_t);
+            h.reserved = 0;
+            h.count = n;
+            h.checksum = injector_file::hash(table.segments.data(), n * sizeof(segment));
+            h.checksum = injector_file::hash(table.tree.data(), (n + 1) * sizeof(uintptr_t), h.checksum);
+            h.checksum = injector_file::hash(table.rank.data(), (n + 1) * sizeof(uint32_t), h.checksum);
+
+            FILE* f = fopen(path, "wb");
+            if(f == nullptr)
+                return false;
+            bool ok = fwrite(&h, sizeof(h), 1, f) == 1
+                   && fwrite(table.segments.data(), sizeof(segment), n, f) == n
+                   && fwrite(table.tree.data(), sizeof(uintptr_t), n + 1, f) == n + 1
+                   && fwrite(table.rank.data(), sizeof(uint32_t), n + 1, f) == n + 1;
+            ok = (fclose(f) == 0) && ok;
+            if(!ok) remove(path);
+            return ok;
+        }
+    }
+
     /*
      *  address_translator
      *      Base for an address translator
@@ -52,16 +275,36 @@ namespace injector
     class address_translator
     {
         private:
-            bool enabled;
+            std::atomic<bool> enabled;
+            bool registered = false;
             void add();
-            void remove();
+            void changed();
 
         protected:
             friend class address_translator_manager;
             std::map<memory_pointer_raw, memory_pointer_raw> map;
 
+            // Table used in place (from a mapped file), wins over the map and the ranges of this translator
+            injector_translator::segment_view view;
+
+            // Takes this translator away from the manager, waiting for every thread still using it
+            // Translators overriding fallback should call this first thing in their destructor, otherwise other threads may call
+            // the fallback while the derived object is being destroyed. Done by the destructor if not done before.
+            void remove();
+
+            // Translates every address in [begin, end) into new_begin + (p - begin)
+            typedef injector_translator::range range;
+            std::vector<range> ranges;
+
+            // Adds a range into this translator, ranges of a translator should not overlap each other
+            void map_range(memory_pointer_raw begin, memory_pointer_raw end, memory_pointer_raw new_begin)
+            {
+                if(begin < end) ranges.push_back(range { begin, end, new_begin });
+            }
+
         public:
-            address_translator() : enabled(true)
+            // Constructs the translator, enabled unless @enable_it is false
+            explicit address_translator(bool enable_it = true) : enabled(enable_it)
             {
                 // Must have bounds filled with min ptr and max ptr to have search working properly
 				map.insert(std::make_pair(raw_ptr(0x00000000u), raw_ptr(0x00000000u)));
@@ -91,12 +334,20 @@ namespace injector
             void enable()
             {
                 this->enabled = true;
+                this->changed();
             }
 
             // Disables this translator
             void disable()
             {
                 this->enabled = false;
+                this->changed();
+            }
+
+            // Tells the map of this translator has been changed
+            void update()
+            {
+                this->changed();
             }
 
             // Checks if this translator is enabled
@@ -104,6 +355,53 @@ namespace injector
             {
                 return enabled;
             }
+
+            // Writes the map and the ranges of this translator into a file which mapped_address_translator can use
+            bool save(const char* path) const
+            {
+                std::vector<injector_translator::piece> pieces;
+                injector_translator::segment_table table;
+                injector_translator::add_pieces(pieces, this->map, this->ranges, 0);
+                injector_translator::flatten(pieces, table);
+                return injector_translator::save(path, table);
+            }
+    };
+
+    /*
+     *  mapped_address_translator
+     *      Translator using the table in a file made by address_translator::save, in place
+     *      The translator stays disabled if the file is missing or isn't valid (wrong version, pointer size or checksum)
+     */
+    class mapped_address_translator : public address_translator
+    {
+        private:
+            injector_file::mapped_file file;
+
+        public:
+            explicit mapped_address_translator(const char* path) : address_translator(false)
+            {
+                if(file.open(path) && injector_translator::load(file.get(), file.length(), this->view))
+                    this->enable();
+                else
+                    file.close();
+            }
+
+            ~mapped_address_translator()
+            {
+                this->remove();     // Before the file goes away
+            }
+
+            // Checks whether the file has been loaded
+            bool loaded() const
+            {
+                return this->view.tree != nullptr;
+            }
+
+            // Number of segments in the file
+            size_t size() const
+            {
+                return this->view.count;
+            }
     };
 
     /*
@@ -116,22 +414,124 @@ namespace injector
             friend class address_manager;
             friend class address_translator;
 
-            std::list<const address_translator*> translators;
+            std::list<const address_translator*> translators;     // Only touched with the mutex locked
+            std::mutex mutex;
+
+            // Immutable snapshot of the translators, readers use it without locking and writers replace it as a whole
+            // The enabled translators are flattened into layers, searched in order: the maps of consecutive translators get merged
+            // together into a single table, while the tables of mapped translators are used in place.
+            struct table
+            {
+                std::vector<injector_translator::segment_table> owned;
+                std::vector<injector_translator::segment_view>  layers;
+                std::vector<const address_translator*> enabled;     // For the fallbacks, in order
+
+                void* find(void* p) const
+                {
+                    for(auto& layer : layers)
+                    {
+                        if(void* result = layer.find(p))
+                            return result;
+                    }
+                    return nullptr;
+                }
+
+                void* fallback(void* p) const;
+            };
+
+            // Every translation flattened into a single table by freeze(), published into address_manager
+            struct frozen_state
+            {
+                injector_translator::segment_table  table;
+                address_manager::frozen_translation translation;
+            };
+
+            std::atomic<table*> current;
+            std::atomic<bool>   pending;    // A translator constructed enabled was published before its map got filled
+            frozen_state*       frozen;     // Set by freeze() and never freed, translate_address may use it until the very end
+
+            address_translator_manager() : current(new table()), pending(false), frozen(nullptr)
+            {}
 
             void add(const address_translator& t)
             {
+                std::lock_guard<std::mutex> lock(mutex);
+                assert(frozen == nullptr && "Translators can't be added after freeze()");
+                if(frozen != nullptr)
+                    return;
+
                 translators.push_front(&t);
+                this->rebuild();
+
+                // The constructor of the derived translator fills the map after this, pick it up on the next translation
+                if(t.is_enabled()) this->pending.store(true, std::memory_order_release);
             }
 
             void remove(const address_translator& t)
             {
-                translators.remove(&t);
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    translators.remove(&t);
+                    this->rebuild();
+                }
+
+                // Nobody may be left using the translator once it's gone
+                epoch_manager::singleton().synchronize();
+            }
+
+            // A translator has been enabled, disabled or had its map changed
+            void changed()
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                assert(frozen == nullptr && "Translators can't be changed after freeze()");
+                if(frozen == nullptr)
+                    this->rebuild();
             }
 
+            // Picks up the maps filled after the translators got constructed, see add()
+            // Readers never wait for this, if someone else holds the mutex they keep going with the current table
+            void refresh()
+            {
+                if(this->pending.load(std::memory_order_acquire) && this->mutex.try_lock())
+                {
+                    std::lock_guard<std::mutex> lock(mutex, std::adopt_lock);
+                    if(this->pending.load(std::memory_order_relaxed))
+                        this->rebuild();
+                }
+            }
+
+            // Builds the table from the translators and publishes it, with the mutex locked
+            void rebuild();
+
          public:
+            // Below this many addresses translate_many just translates one by one, sorting costs more than it saves
+            static const size_t batch_threshold = 128;
+
             // Translates the address p
+            // This only reads the published table, it can be called from any thread even while translators come and go
             void* translator(void* p);
 
+            // Translates the @count addresses at @in into @out, the same as calling translator() on each of them
+            // The addresses get sorted and walked together with the table, so each lookup starts where the previous one ended
+            // Less than @threshold addresses are translated one by one instead
+            void translate_many(void* const* in, void** out, size_t count, size_t threshold = batch_threshold);
+
+            // Flattens the enabled translators into one immutable table and makes address_manager::translate_address search it
+            // directly, with no guard, no call and no cache in the way. There's no going back: translators can't be constructed,
+            // enabled, disabled nor updated afterwards (that's asserted, and ignored). Translators may still be destroyed, their
+            // translations stay in the frozen table but their fallback isn't called anymore.
+            // Returns false if address_manager has been frozen by something else.
+            bool freeze();
+
+            // Looks for the address p in the translators, without going to the fallbacks
+            // Returns nullptr if it isn't there
+            void* find(void* p)
+            {
+                this->refresh();
+                epoch_manager::read_guard guard;
+                return this->current.load()->find(p);
+            }
+
             // Singleton object
             static address_translator_manager& singleton()
             {
@@ -144,60 +544,192 @@ namespace injector
 
     inline void* address_translator_manager::translator(void* p_)
     {
-        static const size_t max_ptr_dist = 7;
+        this->refresh();
+        epoch_manager::read_guard guard;
+        const table* t = this->current.load();
+        void* result = t->find(p_);
+
+        // If we couldn't translate the address, notify and try to fallback
+        if(result == nullptr)
+            result = t->fallback(p_);
+    
+        return result;
+    }
 
-        // Tries to find an address in a translator map
-        auto try_map = [](const std::map<memory_pointer_raw, memory_pointer_raw>& map, memory_pointer_raw p) -> memory_pointer_raw
+    inline bool address_translator_manager::freeze()
+    {
+        using namespace injector_translator;
+        std::lock_guard<std::mutex> lock(mutex);
+        if(this->frozen == nullptr)
         {
-            memory_pointer_raw result = nullptr;
+            if(this->pending.load(std::memory_order_relaxed))
+                this->rebuild();
+
+            // Same order as the layers of the table: the translators first in the list win, and in a translator its file wins
+            // over its map, which wins over its ranges
+            std::vector<piece> pieces;
+            size_t priority = 0;
+            for(auto tr : this->translators)
+            {
+                if(!tr->is_enabled()) continue;
+                for(size_t i = 0; i < tr->view.count; ++i)
+                {
+                    const segment& s = tr->view.segments[i];
+                    pieces.push_back(piece { s.begin, s.end, s.target, priority });
+                }
+                add_pieces(pieces, tr->map, tr->ranges, priority + 1);
+                priority += 3;
+            }
 
-            // Find first element in the map that is greater than or equal to p
-            auto it = map.lower_bound(p);
-            if(it != map.end())
+            frozen_state* f = new frozen_state();
+            flatten(pieces, f->table);
+            f->translation.table = f->table.view();
+            f->translation.data = this;
+            f->translation.fallback = [](const void* data, void* p) -> void*
             {
-                // If it's not exactly the address, get back one position on the table
-                if(it->first != p) --it;
+                epoch_manager::read_guard guard;
+                return ((const address_translator_manager*)(data))->current.load()->fallback(p);
+            };
+            this->frozen = f;
+        }
+        return address_manager::freeze(&this->frozen->translation);
+    }
 
-                auto diff = (p - it->first).as_int();       // What's the difference between p and that address?
-                if(diff <= max_ptr_dist)                    // Could we live with this difference in hands?
-                    result = it->second + raw_ptr(diff);    // Yes, we can!
-            }
+    inline void* address_translator_manager::table::fallback(void* p_) const
+    {
+        memory_pointer_raw result = nullptr;
+        for(auto it = enabled.begin(); result == nullptr && it != enabled.end(); ++it)
+            result = (*it)->fallback(p_);
+        return result.get();
+    }
 
-            return result;
-        };
+    inline void address_translator_manager::translate_many(void* const* in, void** out, size_t count, size_t threshold)
+    {
+        if(count < threshold)
+        {
+            for(size_t i = 0; i < count; ++i)
+                out[i] = this->translator(in[i]);
+            return;
+        }
 
+        // Sort the addresses remembering where they came from, a byte at a time skipping the bytes which are the same everywhere
+        std::vector<std::pair<uintptr_t, size_t>> sorted(count), temp(count);
+        uintptr_t all_or = 0, all_and = uintptr_t(-1);
+        for(size_t i = 0; i < count; ++i)
+        {
+            sorted[i] = std::make_pair(uintptr_t(in[i]), i);
+            all_or |= uintptr_t(in[i]), all_and &= uintptr_t(in[i]);
+        }
+        for(size_t shift = 0; shift < sizeof(uintptr_t) * 8; shift += 8)
+        {
+            if((((all_or ^ all_and) >> shift) & 0xFF) == 0)
+                continue;
+
+            size_t offsets[256] = { 0 };
+            for(auto& a : sorted) ++offsets[(a.first >> shift) & 0xFF];
+            for(size_t i = 0, sum = 0; i < 256; ++i) { size_t c = offsets[i]; offsets[i] = sum; sum += c; }
+            for(auto& a : sorted) temp[offsets[(a.first >> shift) & 0xFF]++] = a;
+            sorted.swap(temp);
+        }
 
-        //
-        memory_pointer_raw result = nullptr;
+        this->refresh();
+        epoch_manager::read_guard guard;
+        const table* t = this->current.load();
 
-        // Try to find translation for this pointer
-        auto& mgr = address_translator_manager::singleton().translators;
-        for(auto it = mgr.begin(); result == nullptr && it != mgr.end(); ++it)
+        using injector_translator::segment;
+        auto begin_after = [](uintptr_t x, const segment& s) { return x < s.begin; };
+        for(size_t i = 0; i < count; ++i)
+            out[i] = nullptr;
+
+        for(auto& layer : t->layers)
         {
-            auto& t = **it;
-            if(t.is_enabled()) result = try_map(t.map, p_);
+            const size_t n = layer.count;
+            size_t pos = 0;     // Every segment before this one begins at or before the current address
+            for(auto& a : sorted)
+            {
+                const uintptr_t x = a.first;
+                if(out[a.second] != nullptr)    // Found on a previous layer
+                    continue;
+
+                // Gallop forward from the previous address, then narrow down to the first segment beginning after x
+                size_t lo = pos, hi = pos, step = 1;
+                while(hi < n && layer.segments[hi].begin <= x)
+                {
+                    lo = hi + 1;
+                    hi += step;
+                    step *= 2;
+                }
+                pos = size_t(std::upper_bound(layer.segments + lo, layer.segments + std::min(hi, n), x, begin_after) - layer.segments);
+
+                if(pos != 0 && x <= layer.segments[pos - 1].end)
+                    out[a.second] = (void*)(layer.segments[pos - 1].target + (x - layer.segments[pos - 1].begin));
+            }
         }
 
-        // If we couldn't translate the address, notify and try to fallback
-        if(result.is_null())
+        for(auto& a : sorted)
         {
-            for(auto it = mgr.begin(); result == nullptr && it != mgr.end(); ++it)
+            if(out[a.second] == nullptr)
+                out[a.second] = t->fallback((void*)(a.first));
+        }
+    }
+
+    inline void address_translator_manager::rebuild()
+    {
+        using namespace injector_translator;
+        this->pending.store(false, std::memory_order_relaxed);
+
+        std::unique_ptr<table> t(new table());
+        t->owned.reserve(this->translators.size() + 1);     // The layers point into those
+
+        std::vector<piece> pieces;
+        auto flush = [&]()
+        {
+            if(!pieces.empty())
+            {
+                t->owned.emplace_back();
+                flatten(pieces, t->owned.back());
+                t->layers.push_back(t->owned.back().view());
+                pieces.clear();
+            }
+        };
+
+        size_t priority = 0;
+        for(auto tr : this->translators)
+        {
+            if(!tr->is_enabled()) continue;
+            t->enabled.push_back(tr);
+            if(tr->view.tree != nullptr)
             {
-                auto& t = **it;
-                if(t.is_enabled())  result = t.fallback(p_);
+                flush();
+                t->layers.push_back(tr->view);
             }
+            add_pieces(pieces, tr->map, tr->ranges, priority);
+            priority += 2;
         }
-    
-        return result.get();
+        flush();
+
+        // Publish it, the old table goes away once its readers are done with it
+        epoch_manager::singleton().retire(this->current.exchange(t.release()));
+        address_manager::invalidate();
     }
 
     inline void address_translator::add()
     {
         address_translator_manager::singleton().add(*this);
+        this->registered = true;
     }
 
     inline void address_translator::remove()
     {
-        address_translator_manager::singleton().remove(*this);
+        if(this->registered)
+        {
+            address_translator_manager::singleton().remove(*this);
+            this->registered = false;
+        }
+    }
+
+    inline void address_translator::changed()
+    {
+        address_translator_manager::singleton().changed();
     }
 }
@@ -25,13 +25,31 @@
  */
 #pragma once
 #include "injector.hpp"
+#include "delegate.hpp"
 #include <cassert>
-#include <functional>
+#include <functional>   // (not used here anymore, but hooks often take a std::function)
 #include <memory>       // for std::shared_ptr
 #include <list>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include "epoch.hpp"
 
 namespace injector
 {
+    namespace injector_hooking
+    {
+        // Tag of the epoch domain of the hook chains
+        struct epoch_tag;
+    }
+
+    /*
+     *  hook_epoch_manager
+     *      Epoch domain of the hook chains, apart from the library one because hooks run inside its read sections
+     *      A hook can then remove a translator (which waits for the translations in flight) without waiting for itself.
+     */
+    typedef basic_epoch_manager<injector_hooking::epoch_tag> hook_epoch_manager;
+
     /*
      *  scoped_base
      *      Base for any scoped hooking type
@@ -109,7 +127,7 @@ namespace injector
             scoped_basic& operator=(const scoped_basic& rhs) = delete;
             scoped_basic& operator=(scoped_basic&& rhs)
             {
-                if(this->saved = rhs.saved)
+                if((this->saved = rhs.saved))
                 {
                     assert(bufsize >= rhs.size);
 
@@ -274,17 +292,74 @@ namespace injector
             using func_type_raw = typename ToManage::func_type_raw;
             using func_type     = typename ToManage::func_type;
             using functor_type  = typename ToManage::functor_type;
-            using assoc_type    = std::list<std::pair<const ToManage*, functor_type>>;
+            using functor_ptr   = std::shared_ptr<const functor_type>;
+            using assoc_type    = std::list<std::pair<const ToManage*, functor_ptr>>;
 
             // Only construction is allowed... by myself ofcourse...
-            function_hooker_manager() = default;
+            function_hooker_manager() : original(nullptr), chain(nullptr) {}
             function_hooker_manager(const function_hooker_manager&) = delete;
             function_hooker_manager(function_hooker_manager&&) = delete;
 
+            // The hooks in calling order (the last added first), never modified once published
+            // The functors themselves are shared with assoc, they are never copied and live on while a chain has them
+            struct chain_type
+            {
+                func_type_raw               original;
+                std::vector<functor_ptr>    hooks;
+            };
+
             //
-            func_type_raw   original;               // Pointer to the original function we've replaced
+            std::atomic<func_type_raw> original;    // Pointer to the original function we've replaced
             assoc_type      assoc;                  // Association between owners of a hook and the hook (map)
+            std::atomic<const chain_type*> chain;   // Published copy of assoc for call_hooks, replaced whenever assoc changes
+            std::recursive_mutex mutex;             // Serializes the changes to assoc, call_hooks never takes it
+            memory_pointer_raw site;                // The call replaced, translated once when hooking
             bool            has_hooked = false;     // Is the hook already in place?
+            bool            was_call = false;       // Was the replaced instruction a relative call? (then it can be put back atomically)
+
+            // The next call of the chain given to a hook, small and trivially copyable so func_type stores it as is
+            struct next_call
+            {
+                const chain_type* chain;
+                size_t            index;
+
+                Ret operator()(Args... args) const
+                {
+                    return call_from(chain, index, args...);
+                }
+            };
+
+            // Calls the hook at @index of @chain, or the original function after the last hook
+            static Ret call_from(const chain_type* chain, size_t index, Args&... args)
+            {
+                if(index < chain->hooks.size())
+                    return (*chain->hooks[index])(func_type(next_call { chain, index + 1 }), args...);
+                return chain->original(args...);
+            }
+
+            // Publishes a new chain made from assoc, the hooks added later wrap the ones added before
+            // The old chain is freed once no call_hooks can be walking it anymore
+            void compose()
+            {
+                chain_type* c = nullptr;
+                if(!assoc.empty())
+                {
+                    c = new chain_type { this->original.load(std::memory_order_relaxed), {} };
+                    c->hooks.reserve(assoc.size());
+                    for(auto it = assoc.rbegin(); it != assoc.rend(); ++it)
+                        c->hooks.push_back(it->second);
+                }
+                hook_epoch_manager::singleton().retire(const_cast<chain_type*>(chain.exchange(c, std::memory_order_acq_rel)));
+            }
+
+            // The manager as seen by call_hooks, a plain pointer so calls don't touch the reference count of instance()
+            // The game code only reaches call_hooks while the hook is in place, and the hook gets restored before the manager
+            // is destroyed, so the manager is alive whenever this is used. Constant initialized, reading it needs no guard.
+            static std::atomic<function_hooker_manager*>& hooked_instance()
+            {
+                static std::atomic<function_hooker_manager*> manager(nullptr);
+                return manager;
+            }
 
             // Find assoc iterator for the content owned by 'owned'
             typename assoc_type::iterator find_assoc(const ToManage& owner)
@@ -295,50 +370,33 @@ namespace injector
             }
 
             // Adds a new item to the association map (or override if already in the map)
-            void add(const ToManage& hooker, functor_type functor)
+            void add(const ToManage& hooker, functor_ptr functor)
             {
+                std::lock_guard<std::recursive_mutex> lock(mutex);
                 auto it = find_assoc(hooker);
                 if(it != assoc.end())
                     it->second = std::move(functor);
                 else
                     assoc.emplace_back(&hooker, std::move(functor));
+                this->compose();
             }
 
         public:
+            ~function_hooker_manager()
+            {
+                hook_epoch_manager::singleton().retire(const_cast<chain_type*>(chain.exchange(nullptr)));
+            }
+
             // Forwards the call to all the installed hooks
+            // The chain is precomposed, so this walks it by index without allocating anything. It never blocks, hooks can be
+            // installed and removed from other threads at the same time. A hook may still run for a moment after its removal.
             static Ret call_hooks(Args&... args)
             {
-                auto& manager = *instance();
-
-                if(manager.assoc.size() == 0) // This may be uncommon but may happen (?), no hook installed
-                    return manager.original(args...);
-
-                // Functor for the original call
-                func_type original = [&manager](Args... args) -> Ret {
-                    return manager.original(args...);
-                };
-
-                if(manager.assoc.size() == 1)
-                {
-                    // We have only one hook, just use it directly no need to go further in complexity
-                    auto& functor = manager.assoc.begin()->second;
-                    return functor(std::move(original), args...);
-                }
-                else
-                {
-                    // Build a serie of functors which captures the previous functor sending it to the next functor,
-                    // that's what would happen if the hooks took place independent of the template staticness (AAAAAAA)
-                    func_type next = std::move(original);
-                    for(auto it = manager.assoc.begin(); it != manager.assoc.end(); ++it)
-                    {
-                        auto& functor = it->second;
-                        next = [functor, next](Args... args) -> Ret
-                        {
-                            return functor(next, args...);
-                        };
-                    }
-                    return next(args...);
-                }
+                auto& manager = *hooked_instance().load(std::memory_order_relaxed);
+                hook_epoch_manager::read_guard guard;
+                if(const chain_type* c = manager.chain.load(std::memory_order_acquire))
+                    return call_from(c, 0, args...);
+                return manager.original.load(std::memory_order_relaxed)(args...);   // Came in right as the last hook was being removed
             }
 
         public:
@@ -347,26 +405,45 @@ namespace injector
             // We need an auxiliar function pointer 'ptr' (to abstract calling conventions) which should forward itself to ^call_hooks
             void make_call(const ToManage& hooker, functor_type functor, memory_pointer_raw ptr)
             {
-                this->add(hooker, std::move(functor));
+                std::lock_guard<std::recursive_mutex> lock(mutex);
+                auto hook = std::make_shared<const functor_type>(std::move(functor));
 
                 // Make sure we only hook this address for the manager once
                 if(!this->has_hooked)
                 {
+                    this->site = memory_pointer_tr(hooker.addr).get<void>();
+                    hooked_instance().store(this, std::memory_order_relaxed);
                     // (the following cast is needed for __thiscall functions)
-                    this->original = (func_type_raw) (void*) scoped_call::make_call(hooker.addr, ptr).get();
+                    this->original.store((func_type_raw) (void*) GetBranchDestination(site).get(), std::memory_order_relaxed);
+                    this->add(hooker, std::move(hook));
+
+                    // Threads may be running thought the call, so replace it atomically when possible
+                    this->was_call = ReadMemory<uint8_t>(site, true) == 0xE8;
+                    this->save(site, 5, true);
+                    if(!MakeCALLAtomic(site, ptr))
+                        MakeCALL(site, ptr);
                     this->has_hooked = true;
                 }
+                else
+                {
+                    this->add(hooker, std::move(hook));
+                }
             }
 
             // Restores the state of the call we've replaced in the game code
             // All installed hooks gets uninstalled after this
             void restore()
             {
+                std::lock_guard<std::recursive_mutex> lock(mutex);
                 if(this->has_hooked)
                 {
+                    // Put the original call back atomically first, then write the saved bytes (the same ones if it was a relative call)
                     this->has_hooked = false;
+                    if(this->was_call)
+                        MakeCALLAtomic(site, (void*)(this->original.load(std::memory_order_relaxed)));
+                    scoped_call::restore();
                     this->assoc.clear();
-                    return scoped_call::restore();
+                    this->compose();
                 }
             }
 
@@ -374,12 +451,13 @@ namespace injector
             // After this call the 'from' object has no association in this manager
             void replace(const ToManage& from, const ToManage& to)
             {
+                std::lock_guard<std::recursive_mutex> lock(mutex);
                 auto it = find_assoc(from);
                 if(it != assoc.end())
                 {
                     auto functor = std::move(it->second);
                     assoc.erase(it);
-                    this->add(to, std::move(functor));
+                    this->add(to, std::move(functor));      // (also recomposes the chain)
                 }
             }
 
@@ -387,11 +465,13 @@ namespace injector
             // If the number of hooks reaches zero after the remotion, a restore will take place
             void remove(const ToManage& hooker)
             {
+                std::lock_guard<std::recursive_mutex> lock(mutex);
                 auto it = find_assoc(hooker);
                 if(it != assoc.end())
                 {
                     assoc.erase(it);
                     if(assoc.size() == 0) this->restore();
+                    else                  this->compose();
                 }
             }
 
@@ -418,8 +498,8 @@ namespace injector
             static const uintptr_t addr = addr1;
 
             using func_type_raw = FuncType;
-            using func_type     = std::function<Ret(Args...)>;
-            using functor_type  = std::function<Ret(func_type, Args&...)>;
+            using func_type     = inplace_delegate<Ret(Args...)>;
+            using functor_type  = inplace_delegate<Ret(func_type, Args&...), INJECTOR_DELEGATE_SIZE, false>;  // Hooks may be move only
             using manager_type  = function_hooker_manager<function_hooker_base, Ret, Args...>;
 
         public:
@@ -529,6 +609,8 @@ namespace injector
     };
 
 
+#ifdef _WIN32  // The following calling conventions are a Windows thing
+
     /*
      *  function_hooker_stdcall
      *      For stdcall conventions (__stdcall)
@@ -639,6 +721,7 @@ namespace injector
             }
     };
 
+#endif
 
 
     /******************* HELPERS ******************/
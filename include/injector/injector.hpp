@@ -25,10 +25,21 @@
  */
 #pragma once
 #define INJECTOR_HAS_INJECTOR_HPP
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 #include <cstdint>
 #include <cstdio>
+#include <cstring>
+#ifdef INJECTOR_CACHE_PROTECTION
+#include <map>
+#include <mutex>
+#endif
 #include "gvm/gvm.hpp"
+#include "disasm.hpp"
 /*
     The following macros (#define) are relevant on this header:
 
@@ -53,6 +64,31 @@
     INJECTOR_OWN_GVM
         If defined, the game_version_manager should be implemented by the user before including this library.
         By default it provides a nice gvm for Grand Theft Auto series
+
+    INJECTOR_CACHE_PROTECTION
+        If defined, the memory protections changed by this library are remembered in a process-wide map (protection_map),
+        so unprotecting memory doesn't need to query the old protection from the system and redundant changes are skipped.
+        Protection changes (and unmaps) made by other means aren't seen by the map, call protection_map::singleton().flush() after those.
+        Memory given back by FreeExecutableMemory (e.g. executable_arena pages) is forgotten by itself.
+
+    INJECTOR_GVM_TRANSLATION_CACHE
+        Number of sets (of two addresses each) of the per-thread cache in front of address_manager::translator, a power of two.
+        Only used together with INJECTOR_GVM_HAS_TRANSLATOR, the default is zero (no cache), 64 is a good size to turn it on.
+        Every thread which translates gets its own cache, a set takes 48 bytes in x86-64 (24 bytes in x86), so 64 takes 3KB per thread.
+        With the cache on, the translator (fallbacks included) must give the same result for the same address until
+        address_manager::invalidate() gets called. address_translator_manager does that by itself when its translators change.
+
+    INJECTOR_GVM_STATIC_VERSION
+        If defined, the build targets a single game version: the column of the static_translation_table objects to use.
+        INJECTOR_STATIC_ADDRESS then folds into a constant, see gvm/static_translator.hpp.
+
+    INJECTOR_GVM_PREFERRED_BASE
+        If defined, the base the main executable is assumed to be linked at by aslr_ptr (e.g. 0x400000), instead of the one
+        read from its headers. Use it when the addresses on your code don't come from the executable itself.
+
+    INJECTOR_DELEGATE_SIZE
+        Default size of the buffer inside inplace_delegate, the type of the hook functors of function_hooker.
+        A functor (lambda captures included) bigger than this goes to the heap when stored, the default is four pointers.
 */
 #include "gvm/gvm.hpp"
 
@@ -81,6 +117,8 @@ union auto_pointer
         explicit auto_pointer(void* x)    : p(x)       {}
         explicit auto_pointer(uint32_t x) : a(x)       {}
 
+        auto_pointer& operator=(const auto_pointer& x) { return p = x.p, *this; }
+
         bool is_null() const { return this->p != nullptr; }
 
     #if __cplusplus >= 201103L || _MSC_VER >= 1800
@@ -135,7 +173,8 @@ union basic_memory_pointer
         // Gets the raw pointer, without translation (casted to T*)
         template<class T> T* get_raw() const    { return auto_pointer(p); }
         
-        // This type can get assigned from void* and uintptr_t
+        // This type can get assigned from void* and uintptr_t (and its own type)
+        basic_memory_pointer& operator=(const basic_memory_pointer& rhs) { return p = rhs.p, *this; }
         basic_memory_pointer& operator=(void* x)		{ return p = x, *this; }
         basic_memory_pointer& operator=(uintptr_t x)	{ return a = x, *this; }
         
@@ -220,6 +259,9 @@ union memory_pointer_tr
         memory_pointer_tr(const memory_pointer_tr& rhs)
             : p(rhs.p)
         {}  // Constructs from my own type, copy constructor
+
+        memory_pointer_tr& operator=(const memory_pointer_tr& rhs)
+        { return p = rhs.p, *this; }    // Assigns from my own type, copy assignment
         
         memory_pointer_tr(uintptr_t x)
             : p(memory_pointer(x).get())
@@ -263,23 +305,342 @@ union memory_pointer_tr
 
 
 
+/*
+ *  memory_protection
+ *      The type used to describe a memory protection on the running platform
+ *      On Windows those are the PAGE_* constants, on POSIX systems the PROT_* flags
+ */
+#ifdef _WIN32
+typedef DWORD memory_protection;
+static const memory_protection protection_rwx = PAGE_EXECUTE_READWRITE;
+#else
+typedef int   memory_protection;
+static const memory_protection protection_rwx = PROT_READ | PROT_WRITE | PROT_EXEC;
+#endif
+
+/*
+ *  GetPageSize
+ *      Gets the size of a memory page on the running system
+ */
+inline size_t GetPageSize()
+{
+#ifdef _WIN32
+    static const size_t page_size = []{ SYSTEM_INFO si; GetSystemInfo(&si); return size_t(si.dwPageSize); }();
+#else
+    static const size_t page_size = size_t(sysconf(_SC_PAGESIZE));
+#endif
+    return page_size;
+}
+
+#ifndef _WIN32
+/*
+ *  QueryProtection
+ *      Finds the current protection of the page at @addr by looking at the process mappings
+ *      POSIX has no counterpart for the old protection output of VirtualProtect, so this is needed to restore it later
+ */
+inline bool QueryProtection(void* addr, memory_protection& out_protection)
+{
+    bool found = false;
+    if(FILE* f = fopen("/proc/self/maps", "r"))
+    {
+        char line[512];
+        unsigned long long begin, end;
+        char perms[5];
+        while(!found && fgets(line, sizeof(line), f))
+        {
+            if(sscanf(line, "%llx-%llx %4s", &begin, &end, perms) == 3
+            && uintptr_t(addr) >= begin && uintptr_t(addr) < end)
+            {
+                out_protection = (perms[0] == 'r'? PROT_READ : 0)
+                               | (perms[1] == 'w'? PROT_WRITE : 0)
+                               | (perms[2] == 'x'? PROT_EXEC : 0);
+                found = true;
+            }
+        }
+        fclose(f);
+    }
+    return found;
+}
+#endif
+
+/*
+ *  IsWritableProtection
+ *      Checks whether the protection @protection allows writing into the memory
+ */
+inline bool IsWritableProtection(memory_protection protection)
+{
+#ifdef _WIN32
+    return (protection & (PAGE_READWRITE | PAGE_WRITECOPY | PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY)) != 0;
+#else
+    return (protection & PROT_WRITE) != 0;
+#endif
+}
+
+/*
+ *  SystemProtectMemory
+ *      Asks the operating system to make the pages at @addr with size @size have a protection of @protection
+ *      On Windows the previous protection of the first page is returned to @out_oldprotect, on POSIX it's left untouched
+ */
+inline bool SystemProtectMemory(void* addr, size_t size, memory_protection protection, memory_protection& out_oldprotect)
+{
+#ifdef _WIN32
+    return VirtualProtect(addr, size, protection, &out_oldprotect) != 0;
+#else
+    // mprotect wants page aligned ranges
+    (void) out_oldprotect;
+    uintptr_t page  = uintptr_t(addr) & ~uintptr_t(GetPageSize() - 1);
+    return mprotect((void*)(page), size + (uintptr_t(addr) - page), protection) == 0;
+#endif
+}
+
+#ifdef INJECTOR_CACHE_PROTECTION
+/*
+ *  protection_map
+ *      Process-wide cache of the protection of the memory pages we've been working with
+ *      Allows UnprotectMemory to know the old protection without asking the system and to skip the protection changes
+ *      which wouldn't change anything (e.g. the memory is already writable).
+ *      Only the changes done thought this library are seen by the cache, call flush() after changing protections by other means.
+ */
+class protection_map
+{
+    public:
+        // Number of system calls the cache has saved us from
+        struct statistics
+        {
+            size_t queries_avoided;     // Lookups of the old protection answered by the cache
+            size_t protects_avoided;    // Protection changes skipped because they were redundant
+        };
+
+    private:
+        struct region
+        {
+            uintptr_t           end;
+            memory_protection   protection;
+        };
+
+        std::map<uintptr_t, region> regions;    // Sorted, non-overlapping regions indexed by their begin
+        std::mutex                  mutex;
+        statistics                  stats;
+        
+        protection_map()
+        {
+            stats.queries_avoided = stats.protects_avoided = 0;
+        }
+
+        // Page aligned bounds of the memory at @addr with size @size
+        static void page_bounds(void* addr, size_t size, uintptr_t& begin, uintptr_t& end)
+        {
+            const uintptr_t page_mask = ~uintptr_t(GetPageSize() - 1);
+            begin = uintptr_t(addr) & page_mask;
+            end   = (uintptr_t(addr) + size + GetPageSize() - 1) & page_mask;
+        }
+
+        // Gets the cached protection of the byte at @addr
+        bool find(uintptr_t addr, memory_protection& out_protection) const
+        {
+            auto it = regions.upper_bound(addr);
+            if(it == regions.begin() || (--it)->second.end <= addr)
+                return false;
+            out_protection = it->second.protection;
+            return true;
+        }
+
+        // Checks whether the entire range [@begin, @end) is cached and all of it satisfies @pred
+        template<class Pred>
+        bool all_of(uintptr_t begin, uintptr_t end, Pred pred) const
+        {
+            auto it = regions.upper_bound(begin);
+            if(it == regions.begin()) return false;
+            for(--it; begin < end; ++it)
+            {
+                if(it == regions.end() || it->first > begin || it->second.end <= begin || !pred(it->second.protection))
+                    return false;
+                begin = it->second.end;
+            }
+            return true;
+        }
+
+        // Removes the range [@begin, @end) from the cache
+        void erase(uintptr_t begin, uintptr_t end)
+        {
+            // Cut the region overlapping our begin
+            auto it = regions.lower_bound(begin);
+            if(it != regions.begin())
+            {
+                auto prev = std::prev(it);
+                if(prev->second.end > begin)
+                {
+                    if(prev->second.end > end) regions[end] = prev->second;
+                    prev->second.end = begin;
+                }
+            }
+
+            // Remove (or cut) the regions starting inside our range
+            while(it != regions.end() && it->first < end)
+            {
+                if(it->second.end > end) regions[end] = it->second;
+                it = regions.erase(it);
+            }
+        }
+
+        // Records that the range [@begin, @end) now has protection @protection
+        void assign(uintptr_t begin, uintptr_t end, memory_protection protection)
+        {
+            erase(begin, end);
+            region r = { end, protection };
+            regions[begin] = r;
+        }
+
+        // Tries to bring the protection of @addr into the cache
+        bool fetch(uintptr_t addr)
+        {
+        #ifdef _WIN32
+            // On Windows the old protection comes for free from VirtualProtect, so the cache is fed only by our own changes
+            return false;
+        #else
+            // Reading the mappings file is expensive, so take all the regions at once
+            bool found = false;
+            if(FILE* f = fopen("/proc/self/maps", "r"))
+            {
+                char line[512];
+                unsigned long long begin, end;
+                char perms[5];
+                regions.clear();
+                while(fgets(line, sizeof(line), f))
+                {
+                    if(sscanf(line, "%llx-%llx %4s", &begin, &end, perms) == 3)
+                    {
+                        assign(uintptr_t(begin), uintptr_t(end), (perms[0] == 'r'? PROT_READ : 0)
+                                                               | (perms[1] == 'w'? PROT_WRITE : 0)
+                                                               | (perms[2] == 'x'? PROT_EXEC : 0));
+                        found = found || (addr >= begin && addr < end);
+                    }
+                }
+                fclose(f);
+            }
+            return found;
+        #endif
+        }
+
+    public:
+        // The process-wide protection map
+        static protection_map& singleton()
+        {
+            static protection_map map;
+            return map;
+        }
+
+        // Makes the memory at @addr with size @size have a protection of @protection
+        bool protect(void* addr, size_t size, memory_protection protection)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            uintptr_t begin, end;
+            page_bounds(addr, size, begin, end);
+
+            if(all_of(begin, end, [protection](memory_protection p) { return p == protection; }))
+            {
+                ++stats.protects_avoided;
+                return true;
+            }
+
+            memory_protection dummy;
+            if(!SystemProtectMemory(addr, size, protection, dummy))
+                return false;
+
+            assign(begin, end, protection);
+            return true;
+        }
+
+        // Makes the memory at @addr with size @size writable, giving the previous protection to @out_oldprotect
+        bool unprotect(void* addr, size_t size, memory_protection& out_oldprotect)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            uintptr_t begin, end;
+            page_bounds(addr, size, begin, end);
+
+            bool cached = find(begin, out_oldprotect);
+            if(cached)
+            {
+            #ifndef _WIN32
+                ++stats.queries_avoided;
+            #endif
+            }
+            else if(fetch(begin))
+            {
+                cached = find(begin, out_oldprotect);
+            }
+
+            if(cached && all_of(begin, end, IsWritableProtection))
+            {
+                ++stats.protects_avoided;
+                return true;
+            }
+
+        #ifndef _WIN32
+            if(!cached && !QueryProtection(addr, out_oldprotect))
+                return false;
+        #endif
+
+            if(!SystemProtectMemory(addr, size, protection_rwx, out_oldprotect))
+                return false;
+
+            assign(begin, end, protection_rwx);
+            return true;
+        }
+
+        // Forgets what is known about the memory at @addr with size @size, e.g. after unmapping it
+        void forget(void* addr, size_t size)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            uintptr_t begin, end;
+            page_bounds(addr, size, begin, end);
+            erase(begin, end);
+        }
+
+        // Forgets everything known about the memory protections
+        void flush()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            regions.clear();
+        }
+
+        // Gets the number of system calls avoided so far
+        statistics get_statistics()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return stats;
+        }
+};
+#endif
+
 /*
  *  ProtectMemory
  *      Makes the address @addr have a protection of @protection
  */
-inline bool ProtectMemory(memory_pointer_tr addr, size_t size, DWORD protection)
+inline bool ProtectMemory(memory_pointer_tr addr, size_t size, memory_protection protection)
 {
-    return VirtualProtect(addr.get(), size, protection, &protection) != 0;
+#ifdef INJECTOR_CACHE_PROTECTION
+    return protection_map::singleton().protect(addr.get(), size, protection);
+#else
+    return SystemProtectMemory(addr.get(), size, protection, protection);
+#endif
 }
 
 /*
  *  UnprotectMemory
  *      Unprotect the memory at @addr with size @size so it have all accesses (execute, read and write)
  *      Returns the old protection to out_oldprotect
+ *      When INJECTOR_CACHE_PROTECTION is defined memory which is already writable is left as is.
  */
-inline bool UnprotectMemory(memory_pointer_tr addr, size_t size, DWORD& out_oldprotect)
+inline bool UnprotectMemory(memory_pointer_tr addr, size_t size, memory_protection& out_oldprotect)
 {
-    return VirtualProtect(addr.get(), size, PAGE_EXECUTE_READWRITE, &out_oldprotect) != 0;
+#if defined(INJECTOR_CACHE_PROTECTION)
+    return protection_map::singleton().unprotect(addr.get(), size, out_oldprotect);
+#elif defined(_WIN32)
+    return SystemProtectMemory(addr.get(), size, protection_rwx, out_oldprotect);
+#else
+    return QueryProtection(addr.get(), out_oldprotect) && SystemProtectMemory(addr.get(), size, protection_rwx, out_oldprotect);
+#endif
 }
 
 /*
@@ -291,7 +652,7 @@ struct scoped_unprotect
 {
     memory_pointer_raw  addr;
     size_t              size;
-    DWORD               dwOldProtect;
+    memory_protection   dwOldProtect;
     bool                bUnprotected;
 
     scoped_unprotect(memory_pointer_tr addr, size_t size)
@@ -456,81 +817,266 @@ inline memory_pointer_raw ReadRelativeOffset(memory_pointer_tr at, size_t sizeof
     return nullptr;
 }
 
+/*
+ *  IsRelativeOffsetReachable
+ *      Checks whether absolute address @abs_value fits in a relative offset of @sizeof_addr bytes for instruction that ends at @end_of_instruction
+ *      Always true for 4 bytes offsets in 32 bits, but not in x86-64.
+ */
+inline bool IsRelativeOffsetReachable(memory_pointer_tr abs_value, memory_pointer_tr end_of_instruction, size_t sizeof_addr = 4)
+{
+    intptr_t rel = intptr_t(abs_value.as_int() - end_of_instruction.as_int());
+    switch(sizeof_addr)
+    {
+        case 1: return rel == intptr_t(int8_t(rel));
+        case 2: return rel == intptr_t(int16_t(rel));
+        case 4: return rel == intptr_t(int32_t(rel));
+    }
+    return false;
+}
+
 /*
  *  MakeRelativeOffset
  *      Writes relative offset into @at based on absolute destination @dest
+ *      Returns false (and writes nothing) if @dest is too far away to fit in the offset
  */
-inline void MakeRelativeOffset(memory_pointer_tr at, memory_pointer_tr dest, size_t sizeof_addr = 4, bool vp = true)
+inline bool MakeRelativeOffset(memory_pointer_tr at, memory_pointer_tr dest, size_t sizeof_addr = 4, bool vp = true)
 {
+    if(!IsRelativeOffsetReachable(dest, at+sizeof_addr, sizeof_addr))
+        return false;
+
     switch(sizeof_addr)
     {
-        case 1: WriteMemory<int8_t> (at, static_cast<int8_t> (GetRelativeOffset(dest, at+sizeof_addr)), vp);
-        case 2: WriteMemory<int16_t>(at, static_cast<int16_t>(GetRelativeOffset(dest, at+sizeof_addr)), vp);
-        case 4: WriteMemory<int32_t>(at, static_cast<int32_t>(GetRelativeOffset(dest, at+sizeof_addr)), vp);
+        case 1: WriteMemory<int8_t> (at, static_cast<int8_t> (GetRelativeOffset(dest, at+sizeof_addr)), vp); break;
+        case 2: WriteMemory<int16_t>(at, static_cast<int16_t>(GetRelativeOffset(dest, at+sizeof_addr)), vp); break;
+        case 4: WriteMemory<int32_t>(at, static_cast<int32_t>(GetRelativeOffset(dest, at+sizeof_addr)), vp); break;
     }
+    return true;
+}
+
+/*
+ *  GetRelayThunk
+ *      Gets a thunk in the rel32 reach of @end_of_instruction which jumps into @dest (using a 14 bytes absolute jump)
+ *      Defined in arena.hpp
+ */
+inline memory_pointer_raw GetRelayThunk(memory_pointer_tr end_of_instruction, memory_pointer_raw dest);
+
+/*
+ *  GetReachableDestination
+ *      Gets the address a rel32 branch that ends at @end_of_instruction should use to go into @dest
+ *      That's @dest itself if it is in reach, otherwise a relay thunk (x86-64 only). Returns nullptr on failure.
+ */
+inline memory_pointer_raw GetReachableDestination(memory_pointer_tr end_of_instruction, memory_pointer_raw dest)
+{
+    if(IsRelativeOffsetReachable(dest, end_of_instruction))
+        return dest;
+    return GetRelayThunk(end_of_instruction, dest);
 }
 
 /*
  *  GetBranchDestination
  *      Gets the destination of a branch instruction at address @at
- *      *** Works only with JMP and CALL for now ***
+ *      Works with relative JMP, CALL and Jcc and with indirect JMP and CALL thought a memory address, see GetBranchTarget
  */
 inline memory_pointer_raw GetBranchDestination(memory_pointer_tr at, bool vp = true)
 {
-    switch(ReadMemory<uint8_t>(at, vp))
+    // Only the bytes of the instruction are touched, the 15 bytes an instruction may take could go into an unmapped page.
+    // So a copy of the bytes known to be in the instruction gets decoded, and more are copied until the decoder needs no other.
+    uint8_t code[32] = { 0 };
+    x86_instruction ins;
+    size_t known = 0, length = 1;
+    while(length > known)
     {
-        // We need to handle other instructions (and prefixes) later...
-        case 0xE8:	// call rel
-        case 0xE9:	// jmp rel
-            return ReadRelativeOffset(at + 1, 4, vp);
-
-        case 0xFF: 
-            switch(ReadMemory<uint8_t>(at + 1, vp))
-            {
-                case 0x15:  // call dword ptr [addr]
-                case 0x25:  // jmp dword ptr [addr]
-                    return *(ReadMemory<uintptr_t*>(at + 2, vp));
-            }
-            break;
+        {
+            scoped_unprotect xprotect(at + known, vp? length - known : 0);
+            memcpy(&code[known], at.get<uint8_t>() + known, length - known);
+        }
+        known = length;
+        if((length = DecodeInstruction(code, ins)) == 0)
+            return nullptr;
     }
-    return nullptr;
+
+    scoped_unprotect xprotect(at, vp? length : 0);
+    return GetBranchTarget(at.get<uint8_t>(), ins);
+}
+
+/*
+ *  MakeJMP
+ *      Creates a JMP instruction at address @at that jumps into address @dest
+ *      If there was already a branch instruction there, its destination is given to @previous (otherwise nullptr)
+ *      In x86-64 a @dest out of the rel32 reach goes thought a relay thunk, nothing is written and false is returned if that
+ *      can't be done.
+ */
+inline bool MakeJMP(memory_pointer_tr at, memory_pointer_raw dest, memory_pointer_raw& previous, bool vp = true)
+{
+    previous = GetBranchDestination(at, vp);
+    auto target = GetReachableDestination(at+5, dest);
+    if(target.is_null()) return false;
+    WriteMemory<uint8_t>(at, 0xE9, vp);
+    MakeRelativeOffset(at+1, target, 4, vp);
+    return true;
 }
 
 /*
  *  MakeJMP
  *      Creates a JMP instruction at address @at that jumps into address @dest
  *      If there was already a branch instruction there, returns the previosly destination of the branch
+ *      Returns nullptr as well when the JMP could not be written, use the overload above to tell those apart.
  */
 inline memory_pointer_raw MakeJMP(memory_pointer_tr at, memory_pointer_raw dest, bool vp = true)
 {
-    auto p = GetBranchDestination(at, vp);
-    WriteMemory<uint8_t>(at, 0xE9, vp);
-    MakeRelativeOffset(at+1, dest, 4, vp);
-    return p;
+    memory_pointer_raw p;
+    return MakeJMP(at, dest, p, vp)? p : nullptr;
+}
+
+/*
+ *  MakeCALL
+ *      Creates a CALL instruction at address @at that jumps into address @dest
+ *      If there was already a branch instruction there, its destination is given to @previous (otherwise nullptr)
+ *      In x86-64 a @dest out of the rel32 reach goes thought a relay thunk, nothing is written and false is returned if that
+ *      can't be done.
+ */
+inline bool MakeCALL(memory_pointer_tr at, memory_pointer_raw dest, memory_pointer_raw& previous, bool vp = true)
+{
+    previous = GetBranchDestination(at, vp);
+    auto target = GetReachableDestination(at+5, dest);
+    if(target.is_null()) return false;
+    WriteMemory<uint8_t>(at, 0xE8, vp);
+    MakeRelativeOffset(at+1, target, 4, vp);
+    return true;
 }
 
 /*
  *  MakeCALL
  *      Creates a CALL instruction at address @at that jumps into address @dest
  *      If there was already a branch instruction there, returns the previosly destination of the branch
+ *      Returns nullptr as well when the CALL could not be written, use the overload above to tell those apart.
  */
 inline memory_pointer_raw MakeCALL(memory_pointer_tr at, memory_pointer_raw dest, bool vp = true)
 {
-    auto p = GetBranchDestination(at, vp);
-    WriteMemory<uint8_t>(at, 0xE8, vp);
-    MakeRelativeOffset(at+1, dest, 4, vp);
-    return p;
+    memory_pointer_raw p;
+    return MakeCALL(at, dest, p, vp)? p : nullptr;
+}
+
+/*
+ *  CompareExchange64
+ *      Atomically replaces the 8 bytes at @addr (which must be 8 bytes aligned) with @desired if they're equal to @expected
+ */
+inline bool CompareExchange64(void* addr, uint64_t expected, uint64_t desired)
+{
+#ifdef _MSC_VER
+    return InterlockedCompareExchange64((volatile LONG64*)(addr), LONG64(desired), LONG64(expected)) == LONG64(expected);
+#else
+    return __atomic_compare_exchange_n((uint64_t*)(addr), &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#endif
+}
+
+/*
+ *  WriteMemoryAtomic64
+ *      Atomically writes the @size bytes from @value into @addr, this range must not cross a 8 bytes aligned boundary
+ *      The neighbouring bytes in the same 8 bytes block are preserved.
+ */
+inline void WriteMemoryAtomic64(uintptr_t addr, const void* value, size_t size)
+{
+    uintptr_t block = addr & ~uintptr_t(7);
+    uint64_t  old, val;
+    do
+    {
+        memcpy(&old, (void*)(block), sizeof(old));
+        val = old;
+        memcpy((uint8_t*)(&val) + (addr - block), value, size);
+    } while(!CompareExchange64((void*)(block), old, val));
+}
+
+/*
+ *  WriteInstructionAtomic
+ *      Writes the instruction @code with size @size (up to 8 bytes) at address @at in a way other threads executing the same
+ *      spot never see it half written. Returns false if that's not possible at this address (nothing gets written then).
+ *      Threads must not be stopped in the middle of the range being replaced, so it should overwrite a single instruction.
+ *      Does memory unprotection if @vp is true
+ */
+inline bool WriteInstructionAtomic(memory_pointer_tr at, const uint8_t* code, size_t size, bool vp = true)
+{
+    const uintptr_t addr = at.as_int();
+    auto same_block = [](uintptr_t a, size_t n) { return (a & ~uintptr_t(7)) == ((a + n - 1) & ~uintptr_t(7)); };
+
+    if(size == 0 || size > 8)
+        return false;
+
+    scoped_unprotect xprotect(at, vp? size : 0);
+
+    if(same_block(addr, size))
+    {
+        // The whole instruction fits in an aligned block, publish it in one go
+        WriteMemoryAtomic64(addr, code, size);
+    }
+    else if(same_block(addr, 2))
+    {
+        // Park the threads reaching the instruction at a short jump to itself, write the tail and then
+        // release them by writing the head over the short jump
+        const uint8_t self_jmp[2] = { 0xEB, 0xFE };
+        WriteMemoryAtomic64(addr, self_jmp, 2);
+        for(uintptr_t p = addr + 2, end = addr + size; p < end; )
+        {
+            size_t n = size_t(((p + 8) & ~uintptr_t(7)) - p);
+            if(n > end - p) n = size_t(end - p);
+            WriteMemoryAtomic64(p, code + (p - addr), n);
+            p += n;
+        }
+        WriteMemoryAtomic64(addr, code, 2);
+    }
+    else if(ReadMemory<uint8_t>(at) == code[0] && same_block(addr + 1, size - 1))
+    {
+        // No room for the short jump but the opcode is the same, only the operands have to change
+        WriteMemoryAtomic64(addr + 1, code + 1, size - 1);
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+/*
+ *  MakeJMPAtomic
+ *      Same as MakeJMP but the instruction is written atomically, see WriteInstructionAtomic
+ *      Returns false if it could not be done at this address
+ */
+inline bool MakeJMPAtomic(memory_pointer_tr at, memory_pointer_raw dest, bool vp = true)
+{
+    uint8_t code[5] = { 0xE9 };
+    auto target = GetReachableDestination(at+5, dest);
+    if(target.is_null()) return false;
+    int32_t rel = GetRelativeOffset(target, at+5);
+    memcpy(&code[1], &rel, sizeof(rel));
+    return WriteInstructionAtomic(at, code, sizeof(code), vp);
+}
+
+/*
+ *  MakeCALLAtomic
+ *      Same as MakeCALL but the instruction is written atomically, see WriteInstructionAtomic
+ *      Returns false if it could not be done at this address
+ */
+inline bool MakeCALLAtomic(memory_pointer_tr at, memory_pointer_raw dest, bool vp = true)
+{
+    uint8_t code[5] = { 0xE8 };
+    auto target = GetReachableDestination(at+5, dest);
+    if(target.is_null()) return false;
+    int32_t rel = GetRelativeOffset(target, at+5);
+    memcpy(&code[1], &rel, sizeof(rel));
+    return WriteInstructionAtomic(at, code, sizeof(code), vp);
 }
 
 /*
  *  MakeJA
  *      Creates a JA instruction at address @at that jumps if above into address @dest
- *      If there was already a branch instruction there, returns the previosly destination of the branch
+ *      In x86-64 a @dest out of the rel32 reach goes thought a relay thunk, nothing is written if that can't be done.
  */
 inline void MakeJA(memory_pointer_tr at, memory_pointer_raw dest, bool vp = true)
 {
-    WriteMemory<uint16_t>(at, 0x87F0, vp);
-    MakeRelativeOffset(at+2, dest, 4, vp);
+    auto target = GetReachableDestination(at+6, dest);
+    if(target.is_null()) return;
+    WriteMemory<uint16_t>(at, 0x870F, vp);
+    MakeRelativeOffset(at+2, target, 4, vp);
 }
 
 /*
@@ -662,6 +1208,11 @@ inline memory_pointer_aslr  aslr_ptr(T p)
 // Detects game, region and version; returns false if could not detect it
 inline bool game_version_manager::Detect()
 {
+#ifndef _WIN32
+    // The detection works thought the PE header of the games, not available here
+    this->Clear();
+    return false;
+#else
     // Cleanup data
     this->Clear();
 
@@ -748,10 +1299,13 @@ inline bool game_version_manager::Detect()
         default:
             return false;
     }
+#endif
 }
 
 #endif
 
 
-} // namespace 
+} // namespace
+
+#include "arena.hpp"    // for GetRelayThunk
 
@@ -0,0 +1,112 @@
+/*
+ *  Injectors - Mapped Files
+ *
+ *  Copyright (C) 2014 LINK/2012 <dma_2012@hotmail.com>
+ *
+ *  This software is provided 'as-is', without any express or implied
+ *  warranty. In no event will the authors be held liable for any damages
+ *  arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *     1. The origin of this software must not be misrepresented; you must not
+ *     claim that you wrote the original software. If you use this software
+ *     in a product, an acknowledgment in the product documentation would be
+ *     appreciated but is not required.
+ *
+ *     2. Altered source versions must be plainly marked as such, and must not be
+ *     misrepresented as being the original software.
+ *
+ *     3. This notice may not be removed or altered from any source
+ *     distribution.
+ *
+ */
+#pragma once
+#include "injector.hpp"
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <fcntl.h>
+#endif
+
+namespace injector
+{
+    // Lowest level stuff (hashing and file mapping) goes on the following namespace
+    // PRIVATE! Skip this, not interesting for you.
+    namespace injector_file
+    {
+        // FNV-1a, good enough for telling files and modules apart
+        inline uint64_t hash(const void* data, size_t size, uint64_t h = 0xCBF29CE484222325ull)
+        {
+            for(size_t i = 0; i < size; ++i)
+                h = (h ^ ((const uint8_t*)(data))[i]) * 0x100000001B3ull;
+            return h;
+        }
+
+        // A file mapped read-only into memory
+        class mapped_file
+        {
+            private:
+                const void* data = nullptr;
+                size_t      size = 0;
+#ifdef _WIN32
+                HANDLE      mapping = NULL;
+#endif
+
+            public:
+                mapped_file() = default;
+                mapped_file(const mapped_file&) = delete;
+                mapped_file& operator=(const mapped_file&) = delete;
+                ~mapped_file() { close(); }
+
+                bool open(const char* path)
+                {
+                    close();
+#ifdef _WIN32
+                    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, 0, NULL);
+                    if(file == INVALID_HANDLE_VALUE)
+                        return false;
+                    LARGE_INTEGER li;
+                    if(GetFileSizeEx(file, &li) && li.QuadPart > 0)
+                    {
+                        this->mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+                        if(this->mapping && (this->data = MapViewOfFile(this->mapping, FILE_MAP_READ, 0, 0, 0)) != nullptr)
+                            this->size = size_t(li.QuadPart);
+                    }
+                    CloseHandle(file);
+#else
+                    int fd = ::open(path, O_RDONLY);
+                    if(fd == -1)
+                        return false;
+                    struct stat st;
+                    if(fstat(fd, &st) == 0 && st.st_size > 0)
+                    {
+                        void* p = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+                        if(p != MAP_FAILED)
+                            this->data = p, this->size = size_t(st.st_size);
+                    }
+                    ::close(fd);
+#endif
+                    if(this->data == nullptr) close();
+                    return this->data != nullptr;
+                }
+
+                void close()
+                {
+#ifdef _WIN32
+                    if(this->data) UnmapViewOfFile(this->data);
+                    if(this->mapping) CloseHandle(this->mapping);
+                    this->mapping = NULL;
+#else
+                    if(this->data) munmap((void*)(this->data), this->size);
+#endif
+                    this->data = nullptr;
+                    this->size = 0;
+                }
+
+                const void* get() const     { return data; }
+                size_t      length() const  { return size; }
+        };
+    }
+}
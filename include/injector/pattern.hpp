@@ -0,0 +1,1064 @@
+/*
+ *  Injectors - Byte Pattern Scanning
+ *
+ *  Copyright (C) 2014 LINK/2012 <dma_2012@hotmail.com>
+ *
+ *  This software is provided 'as-is', without any express or implied
+ *  warranty. In no event will the authors be held liable for any damages
+ *  arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *     1. The origin of this software must not be misrepresented; you must not
+ *     claim that you wrote the original software. If you use this software
+ *     in a product, an acknowledgment in the product documentation would be
+ *     appreciated but is not required.
+ *
+ *     2. Altered source versions must be plainly marked as such, and must not be
+ *     misrepresented as being the original software.
+ *
+ *     3. This notice may not be removed or altered from any source
+ *     distribution.
+ *
+ */
+#pragma once
+#include "injector.hpp"
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define INJECTOR_PATTERN_SIMD
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+#ifndef _WIN32
+#include <link.h>
+#endif
+
+/*
+ *  Instead of hardcoding an address for every version of the executable, look for the bytes around it.
+ *  A pattern is a string of hexadecimal bytes separated by spaces, where '?' or '??' matches any byte
+ *  and a single '?' in a nibble (e.g. '4?') matches any value of that nibble, like "E8 ? ? ? ? 8B 45".
+ */
+
+namespace injector
+{
+    /*
+     *  byte_pattern
+     *      A compiled pattern, ready to be used for scanning
+     */
+    class byte_pattern
+    {
+        public:
+            std::vector<uint8_t> bytes;     // The bytes to match (already masked)
+            std::vector<uint8_t> mask;      // Bits that must match on each byte
+            size_t  anchor[2] = { 0, 0 };   // Two fully known bytes looked for first (the rarest ones)
+            size_t  skip = 1;               // Average shift given by the Horspool skip table
+            size_t  shift[256];             // Horspool skip table, indexed by the byte under the last solid byte
+            size_t  last_solid = 0;         // Index of the last fully known byte, plus one
+
+        public:
+            byte_pattern() = default;
+
+            // Compiles a pattern in the "E8 ? ? ? ? 8B 45" form
+            explicit byte_pattern(const char* pattern)
+            {
+                this->compile(pattern);
+            }
+
+            // Compiles a pattern from the @data bytes where @mask has a 'x' for the bytes that must match and a '?' for the others
+            byte_pattern(const void* data, const char* mask)
+            {
+                for(size_t i = 0; mask[i]; ++i)
+                {
+                    uint8_t m = (mask[i] == '?'? 0x00 : 0xFF);
+                    this->bytes.push_back(((const uint8_t*)(data))[i] & m);
+                    this->mask.push_back(m);
+                }
+                this->prepare();
+            }
+
+            // Compiles a pattern in the "E8 ? ? ? ? 8B 45" form, returns false if the pattern is malformed
+            bool compile(const char* pattern)
+            {
+                auto nibble = [](char c, uint8_t& value, uint8_t& mask) -> bool
+                {
+                    value <<= 4; mask <<= 4;
+                    if(c >= '0' && c <= '9')      value |= uint8_t(c - '0');
+                    else if(c >= 'A' && c <= 'F') value |= uint8_t(c - 'A' + 10);
+                    else if(c >= 'a' && c <= 'f') value |= uint8_t(c - 'a' + 10);
+                    else if(c == '?') return true;
+                    else return false;
+                    mask |= 0x0F;
+                    return true;
+                };
+
+                this->bytes.clear();
+                this->mask.clear();
+                for(const char* p = pattern; *p; )
+                {
+                    if(*p == ' ' || *p == '\t') { ++p; continue; }
+
+                    uint8_t value = 0, mask = 0;
+                    bool ok;
+                    if(p[1] == 0 || p[1] == ' ' || p[1] == '\t')   // Single character token, "?" or "A" (0A)
+                    {
+                        ok = nibble(*p, value, mask);
+                        if(*p == '?') mask = 0x00; else mask |= 0xF0;
+                        p += 1;
+                    }
+                    else
+                    {
+                        ok = nibble(p[0], value, mask) && nibble(p[1], value, mask);
+                        p += 2;
+                        ok = ok && (*p == 0 || *p == ' ' || *p == '\t');
+                    }
+
+                    if(!ok)
+                    {
+                        this->bytes.clear();
+                        this->mask.clear();
+                        return false;
+                    }
+                    this->bytes.push_back(value & mask);
+                    this->mask.push_back(mask);
+                }
+                this->prepare();
+                return true;
+            }
+
+            // Size of the pattern in bytes
+            size_t size() const     { return bytes.size(); }
+            bool   empty() const    { return bytes.empty(); }
+
+            // Checks whether the pattern matches the bytes at @p
+            bool match(const uint8_t* p) const
+            {
+                const uint8_t* b = bytes.data();
+                const uint8_t* m = mask.data();
+                const size_t n = bytes.size();
+                size_t i = 0;
+                for(; i + 8 <= n; i += 8)   // A word at a time, then the leftovers
+                {
+                    uint64_t pw, bw, mw;
+                    memcpy(&pw, p + i, 8); memcpy(&bw, b + i, 8); memcpy(&mw, m + i, 8);
+                    if((pw & mw) != bw)
+                        return false;
+                }
+                for(; i < n; ++i)
+                {
+                    if((p[i] & m[i]) != b[i])
+                        return false;
+                }
+                return true;
+            }
+
+            // Checks whether the pattern matches anything
+            bool wildcard() const
+            {
+                for(uint8_t m : mask) if(m) return false;
+                return true;
+            }
+
+            // How common is a byte in x86 code (from 0 to 4), the higher the worse it is as an anchor
+            static int commonness(uint8_t b)
+            {
+                switch(b)
+                {
+                    case 0x00: case 0xFF: case 0xCC: case 0x90: return 4;
+                    case 0x48: case 0x8B: case 0x89: case 0x0F: case 0x24: case 0x44: case 0x4C: case 0x8D: return 3;
+                    case 0xE8: case 0x83: case 0x45: case 0x85: case 0xC0: case 0x01: case 0x08: case 0x10: return 2;
+                    case 0x74: case 0x75: case 0xEB: case 0xE9: case 0xC3: case 0x33: case 0x5D: case 0x55: return 1;
+                }
+                return 0;
+            }
+
+        private:
+            // Finds the anchors and builds the skip table
+            void prepare()
+            {
+                const size_t n = bytes.size();
+
+                // Anchors are the two least common fully known bytes, the farthest apart on a tie
+                size_t best[2] = { size_t(-1), size_t(-1) };
+                for(size_t i = 0; i < n; ++i)
+                {
+                    if(mask[i] != 0xFF) continue;
+                    this->last_solid = i + 1;
+                    if(best[0] == size_t(-1) || commonness(bytes[i]) < commonness(bytes[best[0]]))
+                        best[1] = best[0], best[0] = i;
+                    else if(best[1] == size_t(-1) || commonness(bytes[i]) <= commonness(bytes[best[1]]))
+                        best[1] = i;
+                }
+                if(best[0] == size_t(-1))   // No fully known byte, anchor on any partially known one
+                {
+                    best[0] = 0;
+                    while(best[0] + 1 < n && mask[best[0]] == 0) ++best[0];
+                }
+                if(best[1] == size_t(-1)) best[1] = best[0];
+                this->anchor[0] = best[0];
+                this->anchor[1] = best[1];
+
+                // Horspool skip over the pattern up to its last fully known byte
+                const size_t len = this->last_solid;
+                for(size_t c = 0; c < 256; ++c)
+                    shift[c] = (len? len : 1);
+                for(size_t i = 0; i + 1 < len; ++i)
+                {
+                    for(size_t c = 0; c < 256; ++c)
+                    {
+                        if((uint8_t(c) & mask[i]) == bytes[i])
+                            shift[c] = len - 1 - i;
+                    }
+                }
+                size_t sum = 0;
+                for(size_t c = 0; c < 256; ++c) sum += shift[c];
+                this->skip = sum / 256;
+            }
+    };
+
+
+    // Lowest level stuff (the scanning kernels) goes on the following namespace
+    // PRIVATE! Skip this, not interesting for you.
+    namespace injector_pattern
+    {
+        // Chunks of memory scanned by a thread are at least this big, splitting further only adds overhead
+        static const size_t min_chunk = 256 * 1024;
+
+        // Gets how many threads to use when asked for @threads (zero means one for each processor)
+        inline size_t thread_count(size_t threads)
+        {
+            if(threads == 0)
+            {
+                static const size_t hardware = std::max<size_t>(1, std::thread::hardware_concurrency());
+                threads = hardware;
+            }
+            return threads;
+        }
+
+        // Gets how many chunks of @size bytes should be split in for @threads threads (a few chunks per thread, so they can balance)
+        inline size_t chunk_count(size_t size, size_t threads)
+        {
+            if(threads <= 1) return 1;
+            return std::max<size_t>(1, std::min<size_t>(threads * 8, size / min_chunk));
+        }
+
+        // Runs @fn(i) for every i in [0, @count) in @threads threads (the calling one included) and waits for them
+        // Each thread takes from the front of its own contiguous share of the indices, once it's over it steals from
+        // the back of the shares of the others, away from where their owners are working.
+        template<class F>
+        inline void parallel_for(size_t count, size_t threads, F fn)
+        {
+            threads = std::min(threads, count);
+            if(threads <= 1)
+            {
+                for(size_t i = 0; i < count; ++i) fn(i);
+                return;
+            }
+
+            struct share
+            {
+                std::mutex mutex;
+                size_t     begin, end;
+            };
+
+            std::unique_ptr<share[]> shares(new share[threads]);
+            for(size_t t = 0; t < threads; ++t)
+            {
+                shares[t].begin = count * t / threads;
+                shares[t].end   = count * (t + 1) / threads;
+            }
+
+            auto worker = [&](size_t t)
+            {
+                for(;;)
+                {
+                    size_t i = count;
+                    {
+                        std::lock_guard<std::mutex> lock(shares[t].mutex);
+                        if(shares[t].begin < shares[t].end) i = shares[t].begin++;
+                    }
+                    for(size_t v = 1; v < threads && i == count; ++v)
+                    {
+                        auto& victim = shares[(t + v) % threads];
+                        std::lock_guard<std::mutex> lock(victim.mutex);
+                        if(victim.begin < victim.end) i = --victim.end;
+                    }
+                    if(i == count)
+                        return;
+                    fn(i);
+                }
+            };
+
+            std::vector<std::thread> pool;
+            for(size_t t = 1; t < threads; ++t)
+                pool.emplace_back(worker, t);
+            worker(0);
+            for(auto& thread : pool)
+                thread.join();
+        }
+
+        // Lowers @a to @value if that's lower than what it has
+        inline void atomic_min(std::atomic<size_t>& a, size_t value)
+        {
+            size_t current = a.load();
+            while(value < current && !a.compare_exchange_weak(current, value)) {}
+        }
+
+        // Patterns whose skip table shifts at least this much on average use Horspool instead of the scalar loop
+        // The SIMD kernels are faster than Horspool even for patterns hundreds of bytes long, so it's not used with them
+        static const size_t horspool_min_skip = 4;
+
+#if defined(INJECTOR_PATTERN_SIMD) && (defined(__GNUC__) || defined(__clang__))
+#define INJECTOR_PATTERN_TARGET(x) __attribute__((target(x)))
+#else
+#define INJECTOR_PATTERN_TARGET(x)
+#endif
+
+        // Index of the lowest set bit of @x (which is not zero)
+        inline unsigned lowest_bit(uint32_t x)
+        {
+#ifdef _MSC_VER
+            unsigned long i;
+            _BitScanForward(&i, x);
+            return unsigned(i);
+#else
+            return unsigned(__builtin_ctz(x));
+#endif
+        }
+
+        // Each kernel looks for the first match starting in [@first, @last), where @last leaves room for the entire pattern
+
+        inline const uint8_t* scan_scalar(const uint8_t* first, const uint8_t* last, const byte_pattern& p)
+        {
+            const uint8_t b0 = p.bytes[p.anchor[0]], m0 = p.mask[p.anchor[0]];
+            const uint8_t* a0 = first + p.anchor[0];
+            for(; first < last; ++first, ++a0)
+            {
+                if((*a0 & m0) == b0 && p.match(first))
+                    return first;
+            }
+            return nullptr;
+        }
+
+        inline const uint8_t* scan_horspool(const uint8_t* first, const uint8_t* last, const byte_pattern& p)
+        {
+            const size_t tail = p.last_solid - 1;
+            const uint8_t b = p.bytes[tail];
+            while(first < last)
+            {
+                uint8_t c = first[tail];
+                if(c == b && p.match(first))
+                    return first;
+                first += p.shift[c];
+            }
+            return nullptr;
+        }
+
+#ifdef INJECTOR_PATTERN_SIMD
+        INJECTOR_PATTERN_TARGET("sse2")
+        inline const uint8_t* scan_sse2(const uint8_t* first, const uint8_t* last, const byte_pattern& p)
+        {
+            const __m128i v0 = _mm_set1_epi8(char(p.bytes[p.anchor[0]]));
+            const __m128i v1 = _mm_set1_epi8(char(p.bytes[p.anchor[1]]));
+            for(; last - first >= 16; first += 16)
+            {
+                __m128i e0 = _mm_cmpeq_epi8(v0, _mm_loadu_si128((const __m128i*)(first + p.anchor[0])));
+                __m128i e1 = _mm_cmpeq_epi8(v1, _mm_loadu_si128((const __m128i*)(first + p.anchor[1])));
+                for(uint32_t bits = uint32_t(_mm_movemask_epi8(_mm_and_si128(e0, e1))); bits; bits &= bits - 1)
+                {
+                    const uint8_t* candidate = first + lowest_bit(bits);
+                    if(p.match(candidate))
+                        return candidate;
+                }
+            }
+            return scan_scalar(first, last, p);
+        }
+
+        INJECTOR_PATTERN_TARGET("avx2")
+        inline const uint8_t* scan_avx2(const uint8_t* first, const uint8_t* last, const byte_pattern& p)
+        {
+            const __m256i v0 = _mm256_set1_epi8(char(p.bytes[p.anchor[0]]));
+            const __m256i v1 = _mm256_set1_epi8(char(p.bytes[p.anchor[1]]));
+            for(; last - first >= 32; first += 32)
+            {
+                __m256i e0 = _mm256_cmpeq_epi8(v0, _mm256_loadu_si256((const __m256i*)(first + p.anchor[0])));
+                __m256i e1 = _mm256_cmpeq_epi8(v1, _mm256_loadu_si256((const __m256i*)(first + p.anchor[1])));
+                for(uint32_t bits = uint32_t(_mm256_movemask_epi8(_mm256_and_si256(e0, e1))); bits; bits &= bits - 1)
+                {
+                    const uint8_t* candidate = first + lowest_bit(bits);
+                    if(p.match(candidate))
+                        return candidate;
+                }
+            }
+            _mm256_zeroupper();
+            return scan_sse2(first, last, p);
+        }
+
+        // Checks whether the processor (and the operating system) can run AVX2 code
+        inline bool has_avx2()
+        {
+#ifdef _MSC_VER
+            int info[4];
+            __cpuid(info, 0);
+            if(info[0] < 7) return false;
+            __cpuid(info, 1);
+            if((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0)   // OSXSAVE and AVX
+                return false;
+            if((_xgetbv(0) & 6) != 6)                                       // XMM and YMM state enabled by the OS
+                return false;
+            __cpuidex(info, 7, 0);
+            return (info[1] & (1 << 5)) != 0;
+#else
+            return __builtin_cpu_supports("avx2") != 0;
+#endif
+        }
+#endif
+    }
+
+    /*
+     *  pattern_kernel
+     *      The scanning kernels, automatic picks the best one the processor can run
+     */
+    enum class pattern_kernel
+    {
+        automatic, scalar, horspool, sse2, avx2
+    };
+
+    /*
+     *  GetPatternKernel
+     *      Gets the best kernel for scanning @pattern in this processor
+     */
+    inline pattern_kernel GetPatternKernel(const byte_pattern& pattern)
+    {
+        if(pattern.last_solid == 0)     // No fully known byte for the fast kernels to look for
+            return pattern_kernel::scalar;
+#ifdef INJECTOR_PATTERN_SIMD
+        static const bool avx2 = injector_pattern::has_avx2();
+        return avx2? pattern_kernel::avx2 : pattern_kernel::sse2;
+#else
+        return pattern.skip >= injector_pattern::horspool_min_skip? pattern_kernel::horspool : pattern_kernel::scalar;
+#endif
+    }
+
+    /*
+     *  FindPattern
+     *      Finds the first place in [@begin, @end) where @pattern is found, the pattern must fit entirely in the range
+     *      Returns nullptr if there's no such place
+     */
+    inline memory_pointer_raw FindPattern(memory_pointer_raw begin, memory_pointer_raw end, const byte_pattern& pattern,
+                                          pattern_kernel kernel = pattern_kernel::automatic)
+    {
+        using namespace injector_pattern;
+        if(pattern.empty() || end.as_int() < begin.as_int() || end.as_int() - begin.as_int() < pattern.size())
+            return nullptr;
+
+        const uint8_t* first = begin.get<const uint8_t>();
+        const uint8_t* last  = end.get<const uint8_t>() - pattern.size() + 1;
+        if(pattern.wildcard())
+            return (void*)(first);
+
+        if(kernel == pattern_kernel::automatic || pattern.last_solid == 0)
+            kernel = GetPatternKernel(pattern);
+
+        switch(kernel)
+        {
+            case pattern_kernel::horspool:  return (void*)(scan_horspool(first, last, pattern));
+#ifdef INJECTOR_PATTERN_SIMD
+            case pattern_kernel::sse2:      return (void*)(scan_sse2(first, last, pattern));
+            case pattern_kernel::avx2:      return (void*)(scan_avx2(first, last, pattern));
+#endif
+            default:                        return (void*)(scan_scalar(first, last, pattern));
+        }
+    }
+
+    /*
+     *  FindPatternAll
+     *      Finds every place in [@begin, @end) where @pattern is found, including the overlapping ones
+     */
+    inline std::vector<memory_pointer_raw> FindPatternAll(memory_pointer_raw begin, memory_pointer_raw end, const byte_pattern& pattern,
+                                                          pattern_kernel kernel = pattern_kernel::automatic)
+    {
+        std::vector<memory_pointer_raw> result;
+        for(auto p = FindPattern(begin, end, pattern, kernel); !p.is_null(); p = FindPattern(p + 1, end, pattern, kernel))
+            result.push_back(p);
+        return result;
+    }
+
+    /*
+     *  FindPatternParallel
+     *      Same as FindPattern, but the range is split in chunks scanned by @threads threads (zero for one per processor)
+     *      The chunks overlap by the size of the pattern, the result is always the same FindPattern would give
+     */
+    inline memory_pointer_raw FindPatternParallel(memory_pointer_raw begin, memory_pointer_raw end, const byte_pattern& pattern,
+                                                  size_t threads = 0)
+    {
+        using namespace injector_pattern;
+        if(pattern.empty() || end.as_int() < begin.as_int() || end.as_int() - begin.as_int() < pattern.size())
+            return nullptr;
+
+        const uintptr_t first = begin.as_int(), last = end.as_int();
+        const size_t count = chunk_count(last - first, thread_count(threads));
+        if(count == 1)
+            return FindPattern(begin, end, pattern);
+
+        // Chunks after the first one with a match have nothing to say anymore
+        std::vector<uintptr_t> results(count, 0);
+        std::atomic<size_t> best(count);
+        parallel_for(count, thread_count(threads), [&](size_t k)
+        {
+            if(best.load() < k) return;
+            uintptr_t b = first + (last - first) / count * k;
+            uintptr_t e = (k + 1 == count? last : std::min(last, first + (last - first) / count * (k + 1) + pattern.size() - 1));
+            if((results[k] = FindPattern(b, e, pattern).as_int()) != 0)
+                atomic_min(best, k);
+        });
+
+        return best.load() < count? results[best.load()] : 0;
+    }
+
+
+    /*
+     *  memory_range
+     *      A [begin, end) range of memory
+     */
+    struct memory_range
+    {
+        uintptr_t begin;
+        uintptr_t end;
+
+        size_t size() const { return size_t(end - begin); }
+    };
+
+    /*
+     *  GetModuleSections
+     *      Gets the memory ranges the module at @module (nullptr for the main executable) is made of
+     *      In Windows those are the sections of the image, otherwise the loaded segments of the ELF object
+     *      If @executable_only is true, only the code goes into the result
+     */
+    inline std::vector<memory_range> GetModuleSections(memory_pointer_raw module = nullptr, bool executable_only = true)
+    {
+        std::vector<memory_range> result;
+#ifdef _WIN32
+        auto base = module.is_null()? uintptr_t(GetModuleHandle(NULL)) : module.as_int();
+        auto dos  = (const IMAGE_DOS_HEADER*)(base);
+        auto nt   = (const IMAGE_NT_HEADERS*)(base + dos->e_lfanew);
+        auto sec  = IMAGE_FIRST_SECTION(nt);
+        for(WORD i = 0; i < nt->FileHeader.NumberOfSections; ++i, ++sec)
+        {
+            if(executable_only && (sec->Characteristics & IMAGE_SCN_MEM_EXECUTE) == 0)
+                continue;
+            uintptr_t begin = base + sec->VirtualAddress;
+            result.push_back(memory_range { begin, begin + (sec->Misc.VirtualSize? sec->Misc.VirtualSize : sec->SizeOfRawData) });
+        }
+#else
+        struct context
+        {
+            uintptr_t module;
+            bool executable_only;
+            std::vector<memory_range>* result;
+        } ctx = { module.as_int(), executable_only, &result };
+
+        // The first object reported by the dynamic linker is the main executable
+        dl_iterate_phdr([](dl_phdr_info* info, size_t, void* data) -> int
+        {
+            auto& ctx = *(context*)(data);
+            bool found = (ctx.module == 0);
+            for(int i = 0; i < info->dlpi_phnum && !found; ++i)
+            {
+                auto& ph = info->dlpi_phdr[i];
+                uintptr_t begin = info->dlpi_addr + ph.p_vaddr;
+                found = (ph.p_type == PT_LOAD && ctx.module >= begin && ctx.module < begin + ph.p_memsz);
+            }
+            if(!found) return 0;
+
+            for(int i = 0; i < info->dlpi_phnum; ++i)
+            {
+                auto& ph = info->dlpi_phdr[i];
+                if(ph.p_type != PT_LOAD || (ctx.executable_only && (ph.p_flags & PF_X) == 0))
+                    continue;
+                uintptr_t begin = info->dlpi_addr + ph.p_vaddr;
+                ctx.result->push_back(memory_range { begin, begin + ph.p_memsz });
+            }
+            return 1;
+        }, &ctx);
+#endif
+        return result;
+    }
+
+    /*
+     *  FindPatternInModule
+     *      Finds the first place in the code of @module (nullptr for the main executable) where @pattern is found
+     *      Returns nullptr if there's no such place
+     */
+    inline memory_pointer_raw FindPatternInModule(const byte_pattern& pattern, memory_pointer_raw module = nullptr)
+    {
+        for(auto& range : GetModuleSections(module))
+        {
+            auto p = FindPattern(range.begin, range.end, pattern);
+            if(!p.is_null()) return p;
+        }
+        return nullptr;
+    }
+
+
+    /*
+     *  pattern_batch
+     *      Resolves many patterns in a single pass over the memory
+     *      The longest run of fully known bytes of each pattern (its literal anchor) goes into a Aho-Corasick automaton,
+     *      every time an anchor is seen the whole pattern is verified around it. The result for each pattern is the
+     *      first place it's found at, the same FindPattern would give.
+     */
+    class pattern_batch
+    {
+        public:
+            static const size_t max_anchor = 8;     // Longest anchor, longer ones only make the automaton bigger
+            static const size_t min_anchor = 3;     // Patterns with shorter anchors are better off scanned by FindPattern
+            static const uint32_t output_flag = 0x80000000;     // Transition into a state with outputs
+
+            struct statistics
+            {
+                size_t bytes;       // Bytes scanned
+                size_t states;      // States of the automaton
+                size_t candidates;  // Times a pattern had to be verified
+                size_t found;       // Patterns resolved
+                double seconds;     // Time spent scanning (without building the automaton)
+            };
+
+        private:
+            struct entry
+            {
+                byte_pattern pattern;
+                size_t       anchor_offset; // Where the anchor begins in the pattern
+                size_t       anchor_size;   // Size of the anchor, zero for patterns scanned by themselves
+                uintptr_t    result;
+            };
+
+            // What the scanning loop needs to reject a candidate, packed together to save cache misses
+            struct verifier
+            {
+                uint32_t back;      // Distance from the end of the anchor back into the beginning of the pattern
+                uint32_t size;      // Size of the pattern
+                uint32_t quick;     // Offset of a word of the pattern (outside the anchor if possible) checked first
+                uint64_t word;      // The masked bytes of that word
+                uint64_t mask;      // ...and its mask (all zero if the pattern is smaller than a word)
+            };
+
+            // What the scan of a chunk works on, it gets its own outputs to compact as patterns are resolved
+            struct cursor
+            {
+                std::vector<uint32_t>   out_begin;
+                std::vector<uint32_t>   outputs;
+                std::vector<uintptr_t>  results;    // Index by entry, empty if the chunk hasn't been scanned
+                size_t                  unresolved = 0;
+                size_t                  candidates = 0;
+            };
+
+            std::vector<entry>      entries;
+            std::vector<verifier>   verifiers;      // One for each entry
+            size_t                  unresolved = 0;
+            statistics              stats = { 0, 0, 0, 0, 0.0 };
+
+            // The automaton over the anchors of the unresolved patterns, rebuilt whenever a pattern is added
+            bool                    dirty = true;
+            uint16_t                classes[256];   // Bytes not in any anchor share the class zero
+            size_t                  nclasses = 1;
+            std::vector<uint32_t>   delta;          // Transitions, [state * nclasses + class], into state * nclasses (plus output_flag)
+            std::vector<uint32_t>   out_begin;      // Patterns whose anchor ends at a state (including the ones by its suffixes)
+            std::vector<uint32_t>   outputs;        // ...are outputs[out_begin[state] .. out_begin[state+1]]
+            std::vector<uint64_t>   prefixes;       // Bitset of the first two bytes of every anchor
+            bool                    compact = false;    // Outputs contain resolved patterns
+            size_t                  anchored = 0;       // Patterns in the automaton
+
+        public:
+            // Adds a pattern to the batch, returns its index
+            size_t add(const byte_pattern& pattern)
+            {
+                entry e = { pattern, 0, 0, 0 };
+                const size_t n = pattern.size();
+
+                // The anchor is the run of (up to max_anchor) fully known bytes least likely to show up by chance,
+                // which is usually the longest one, but not if it's something like 00 00 00 00 00
+                int best = 0;
+                for(size_t i = 0; i < n; ++i)
+                {
+                    int score = 0;
+                    size_t k = i;
+                    for(; k < n && k - i < max_anchor && pattern.mask[k] == 0xFF; ++k)
+                        score += 5 - byte_pattern::commonness(pattern.bytes[k]);
+                    if(score > best) best = score, e.anchor_offset = i, e.anchor_size = k - i;
+                }
+                if(e.anchor_size < min_anchor)
+                    e.anchor_offset = e.anchor_size = 0;
+
+                this->entries.push_back(std::move(e));
+                this->unresolved++;
+                this->dirty = true;
+                return this->entries.size() - 1;
+            }
+
+            // Adds a pattern in the "E8 ? ? ? ? 8B 45" form to the batch, returns its index
+            size_t add(const char* pattern)
+            {
+                return add(byte_pattern(pattern));
+            }
+
+            // Number of patterns in the batch
+            size_t size() const     { return entries.size(); }
+
+            // Checks whether every pattern has been found already
+            bool resolved() const   { return unresolved == 0; }
+
+            // Gets where the pattern at @index has been found, or nullptr if it hasn't been
+            memory_pointer_raw get(size_t index) const
+            {
+                return entries[index].result;
+            }
+
+            memory_pointer_raw operator[](size_t index) const
+            {
+                return get(index);
+            }
+
+            // Gets the pattern at @index
+            const byte_pattern& pattern(size_t index) const
+            {
+                return entries[index].pattern;
+            }
+
+            // Tells the pattern at @index has been found at @result somehow else, so scans don't look for it
+            void set(size_t index, memory_pointer_raw result)
+            {
+                resolve(entries[index], result.as_int());
+            }
+
+            // Forgets the results, so the patterns can be looked for again
+            void reset()
+            {
+                for(auto& e : entries) e.result = 0;
+                this->unresolved = entries.size();
+                this->stats = statistics { 0, 0, 0, 0, 0.0 };
+                this->dirty = true;     // The automaton has lost the resolved patterns
+            }
+
+            // Looks for the unresolved patterns in [@begin, @end), each pattern must fit entirely in the range
+            // The range is split in chunks scanned by @threads threads (zero for one per processor), the chunks overlap
+            // by the size of the longest pattern and the results are always the same of a scan in a single thread.
+            // Returns true if every pattern of the batch has been resolved
+            bool scan(memory_pointer_raw begin, memory_pointer_raw end, size_t threads = 1)
+            {
+                using namespace injector_pattern;
+                auto start = std::chrono::steady_clock::now();
+                if(this->dirty) this->build();
+
+                const uintptr_t first = begin.as_int(), last = end.as_int();
+                if(this->unresolved && last > first)
+                {
+                    // Patterns which don't go into the automaton
+                    for(auto& e : entries)
+                    {
+                        if(e.anchor_size == 0 && e.result == 0)
+                            resolve(e, FindPatternParallel(begin, end, e.pattern, threads).as_int());
+                    }
+                    if(this->compact) this->compact_outputs();
+
+                    size_t longest = 0;
+                    for(auto& e : entries)
+                        if(e.result == 0) longest = std::max(longest, e.pattern.size());
+
+                    // Every chunk gives the first match of each pattern starting inside of it, the first chunk to give
+                    // a match is the one that counts. Chunks skip patterns already found by a chunk before them.
+                    const size_t count = chunk_count(last - first, thread_count(threads));
+                    std::vector<cursor> cursors(count);
+                    std::unique_ptr<std::atomic<size_t>[]> found(new std::atomic<size_t>[entries.size()]);
+                    for(size_t i = 0; i < entries.size(); ++i)
+                        found[i].store(entries[i].result? 0 : count);
+
+                    if(!this->outputs.empty())
+                    {
+                        parallel_for(count, thread_count(threads), [&](size_t k)
+                        {
+                            const uintptr_t b = first + (last - first) / count * k;
+                            const uintptr_t l = (k + 1 == count? last : first + (last - first) / count * (k + 1));
+                            const uintptr_t e = std::min(last, l + longest - 1);
+                            scan_range((const uint8_t*)(b), (const uint8_t*)(e), (const uint8_t*)(l), k, found.get(), cursors[k]);
+                        });
+                    }
+
+                    for(size_t id = 0; id < entries.size(); ++id)
+                    {
+                        for(size_t k = 0; k < count && entries[id].result == 0; ++k)
+                        {
+                            if(cursors[k].results.size())
+                                resolve(entries[id], cursors[k].results[id]);
+                        }
+                    }
+                    for(auto& c : cursors)
+                        this->stats.candidates += c.candidates;
+                    this->stats.bytes += size_t(last - first);
+                }
+
+                this->stats.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                return this->resolved();
+            }
+
+            // Looks for the unresolved patterns in the code of @module (nullptr for the main executable)
+            // See scan() for @threads. Returns true if every pattern of the batch has been resolved
+            bool scan_module(memory_pointer_raw module = nullptr, size_t threads = 1)
+            {
+                for(auto& range : GetModuleSections(module))
+                {
+                    if(scan(range.begin, range.end, threads))
+                        break;
+                }
+                return this->resolved();
+            }
+
+            statistics get_statistics() const
+            {
+                statistics s = this->stats;
+                s.states = this->out_begin.empty()? 0 : this->out_begin.size() - 1;
+                s.found  = entries.size() - this->unresolved;
+                return s;
+            }
+
+        private:
+            bool has_prefix(uint8_t a, uint8_t b) const
+            {
+                const size_t i = a | (size_t(b) << 8);
+                return (prefixes[i / 64] >> (i % 64)) & 1;
+            }
+
+            void resolve(entry& e, uintptr_t result)
+            {
+                if(result && !e.result)
+                {
+                    e.result = result;
+                    this->unresolved--;
+                    this->compact = true;
+                }
+            }
+
+            // Takes the patterns for which @resolved(id) is true out of the @outputs of every state
+            template<class F>
+            static void compact_outputs(std::vector<uint32_t>& out_begin, std::vector<uint32_t>& outputs, F resolved)
+            {
+                size_t n = 0;
+                for(size_t s = 0, i = 0; s + 1 < out_begin.size(); ++s)
+                {
+                    for(; i < out_begin[s + 1]; ++i)
+                    {
+                        if(!resolved(outputs[i]))
+                            outputs[n++] = outputs[i];
+                    }
+                    out_begin[s + 1] = uint32_t(n);
+                }
+                outputs.resize(n);
+            }
+
+            void compact_outputs()
+            {
+                compact_outputs(out_begin, outputs, [this](uint32_t id) { return entries[id].result != 0; });
+                this->anchored = 0;
+                for(auto& e : entries)
+                    if(e.anchor_size && !e.result) ++this->anchored;
+                this->compact = false;
+            }
+
+            // Walks the automaton over [@first, @last) into @c, looking for matches starting before @limit
+            // This is the chunk @k of a scan, patterns found by a chunk before it (as told by @found) are skipped
+            void scan_range(const uint8_t* first, const uint8_t* last, const uint8_t* limit, size_t k,
+                            std::atomic<size_t>* found, cursor& c) const
+            {
+                c.out_begin  = this->out_begin;
+                c.outputs    = this->outputs;
+                c.results.assign(entries.size(), 0);
+                c.unresolved = this->anchored;
+
+                const uint32_t*  delta     = this->delta.data();
+                const uint16_t*  classes   = this->classes;
+                const verifier*  verifiers = this->verifiers.data();
+                const size_t     nclasses  = this->nclasses;
+                const uintptr_t  begin     = uintptr_t(first);
+                uint32_t state = 0;
+
+                for(const uint8_t* p = first; p < last && c.unresolved; ++p)
+                {
+                    if(state == 0)  // Back at the root, skip until a place where some anchor may begin
+                    {
+                        while(p + 1 < last && !has_prefix(p[0], p[1]))
+                            ++p;
+                    }
+
+                    state = delta[(state & ~output_flag) + classes[*p]];
+                    if((state & output_flag) == 0)
+                        continue;
+
+                    bool compact = false;
+                    const size_t s = (state & ~output_flag) / nclasses;
+                    for(uint32_t i = c.out_begin[s]; i < c.out_begin[s + 1]; ++i)
+                    {
+                        const uint32_t id = c.outputs[i];
+                        const verifier& v = verifiers[id];
+                        uintptr_t candidate = uintptr_t(p) + 1 - v.back;
+                        if(candidate < begin || candidate >= uintptr_t(limit) || uintptr_t(last) - candidate < v.size)
+                            continue;
+
+                        // Patterns shorter than the word have no quick check, reading it could go past @last
+                        if(v.size >= sizeof(uint64_t))
+                        {
+                            uint64_t word;
+                            memcpy(&word, (const void*)(candidate + v.quick), sizeof(word));
+                            if((word & v.mask) != v.word)
+                                continue;
+                        }
+
+                        if(found[id].load(std::memory_order_relaxed) < k)   // An earlier chunk has it already
+                        {
+                            compact = true;
+                            continue;
+                        }
+
+                        c.candidates++;
+                        if(entries[id].pattern.match((const uint8_t*)(candidate)))
+                        {
+                            c.results[id] = candidate;
+                            injector_pattern::atomic_min(found[id], k);
+                            compact = true;
+                        }
+                    }
+
+                    if(compact)     // Stop seeing outputs for patterns resolved in the loop above
+                    {
+                        compact_outputs(c.out_begin, c.outputs, [&](uint32_t id) { return c.results[id] || found[id].load() < k; });
+                        c.unresolved = 0;
+                        for(size_t id = 0; id < entries.size(); ++id)
+                            if(entries[id].anchor_size && !entries[id].result && !c.results[id] && found[id].load() >= k) ++c.unresolved;
+                    }
+                }
+            }
+
+            // Builds the automaton out of the anchors
+            void build()
+            {
+                // The quick rejection word is the one right after the anchor, or the last one of the pattern
+                verifiers.clear();
+                for(auto& e : entries)
+                {
+                    verifier v = { uint32_t(e.anchor_offset + e.anchor_size), uint32_t(e.pattern.size()), 0, 0, 0 };
+                    if(v.size >= sizeof(uint64_t))
+                    {
+                        v.quick = std::min<uint32_t>(v.back, v.size - sizeof(uint64_t));
+                        memcpy(&v.word, &e.pattern.bytes[v.quick], sizeof(uint64_t));
+                        memcpy(&v.mask, &e.pattern.mask[v.quick], sizeof(uint64_t));
+                    }
+                    verifiers.push_back(v);
+                }
+
+                // Only bytes appearing in some anchor need a class of their own
+                memset(classes, 0, sizeof(classes));
+                nclasses = 1;
+                for(auto& e : entries)
+                {
+                    for(size_t i = 0; i < e.anchor_size; ++i)
+                    {
+                        uint8_t b = e.pattern.bytes[e.anchor_offset + i];
+                        if(classes[b] == 0) classes[b] = uint16_t(nclasses++);
+                    }
+                }
+
+                // The pairs of bytes an anchor may begin with, anything else is skipped without walking the automaton
+                prefixes.assign(65536 / 64, 0);
+                for(auto& e : entries)
+                {
+                    if(e.anchor_size == 0 || e.result) continue;
+                    const uint8_t a = e.pattern.bytes[e.anchor_offset];
+                    for(size_t b = 0; b < 256; ++b)
+                    {
+                        if(e.anchor_size == 1 || b == e.pattern.bytes[e.anchor_offset + 1])
+                        {
+                            const size_t i = a | (b << 8);
+                            prefixes[i / 64] |= uint64_t(1) << (i % 64);
+                        }
+                    }
+                }
+
+                // The trie, where zero means no transition yet (the root can't be the target of one)
+                std::vector<std::vector<uint32_t>> own(1);      // Patterns whose anchor ends at each state
+                delta.assign(nclasses, 0);
+                for(size_t id = 0; id < entries.size(); ++id)
+                {
+                    auto& e = entries[id];
+                    if(e.anchor_size == 0 || e.result) continue;
+
+                    uint32_t state = 0;
+                    for(size_t i = 0; i < e.anchor_size; ++i)
+                    {
+                        uint8_t c = classes[e.pattern.bytes[e.anchor_offset + i]];
+                        if(delta[state * nclasses + c] == 0)
+                        {
+                            delta[state * nclasses + c] = uint32_t(own.size());
+                            own.emplace_back();
+                            delta.resize(delta.size() + nclasses, 0);
+                        }
+                        state = delta[state * nclasses + c];
+                    }
+                    own[state].push_back(uint32_t(id));
+                }
+
+                // Breadth first, fill the missing transitions with the ones of the longest proper suffix (the failure link)
+                const size_t nstates = own.size();
+                std::vector<uint32_t> fail(nstates, 0), queue;
+                queue.reserve(nstates);
+                for(size_t c = 0; c < nclasses; ++c)
+                {
+                    if(uint32_t s = delta[c])
+                        queue.push_back(s);
+                }
+                for(size_t q = 0; q < queue.size(); ++q)
+                {
+                    uint32_t s = queue[q];
+                    for(size_t c = 0; c < nclasses; ++c)
+                    {
+                        uint32_t& t = delta[s * nclasses + c];
+                        if(t == 0)
+                            t = delta[fail[s] * nclasses + c];
+                        else
+                        {
+                            fail[t] = delta[fail[s] * nclasses + c];
+                            queue.push_back(t);
+                        }
+                    }
+                }
+
+                // Flatten the outputs, a state also outputs everything its failure link does (parents come first in the queue)
+                for(uint32_t s : queue)
+                    own[s].insert(own[s].end(), own[fail[s]].begin(), own[fail[s]].end());
+                out_begin.assign(1, 0);
+                outputs.clear();
+                for(size_t s = 0; s < nstates; ++s)
+                {
+                    outputs.insert(outputs.end(), own[s].begin(), own[s].end());
+                    out_begin.push_back(uint32_t(outputs.size()));
+                }
+
+                // Transitions go straight into the row of the target state, saving a multiplication per byte
+                for(auto& t : delta)
+                    t = uint32_t(t * nclasses) | (own[t].empty()? 0 : output_flag);
+
+                this->anchored = 0;
+                for(auto& e : entries)
+                    if(e.anchor_size && !e.result) ++this->anchored;
+                this->dirty = false;
+            }
+    };
+}
@@ -0,0 +1,379 @@
+/*
+ *  Injectors - Persistent Pattern Cache
+ *
+ *  Copyright (C) 2014 LINK/2012 <dma_2012@hotmail.com>
+ *
+ *  This software is provided 'as-is', without any express or implied
+ *  warranty. In no event will the authors be held liable for any damages
+ *  arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *     1. The origin of this software must not be misrepresented; you must not
+ *     claim that you wrote the original software. If you use this software
+ *     in a product, an acknowledgment in the product documentation would be
+ *     appreciated but is not required.
+ *
+ *     2. Altered source versions must be plainly marked as such, and must not be
+ *     misrepresented as being the original software.
+ *
+ *     3. This notice may not be removed or altered from any source
+ *     distribution.
+ *
+ */
+#pragma once
+#include "pattern.hpp"
+#include "mapped_file.hpp"
+#include <string>
+#include <map>
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+/*
+ *  Scanning the same executable on every launch is a waste of time, the places patterns have been found at
+ *  can be kept in a file for the next time. The file belongs to a specific build of the module (as told by its
+ *  fingerprint) and is thrown away as soon as the module changes.
+ *
+ *  The file is a header followed by records sorted by the hash of the pattern, all of it in the native byte order:
+ *      char     magic[4];      // "INJC"
+ *      uint32_t version;       // pattern_cache::version
+ *      uint64_t fingerprint;   // GetModuleFingerprint of the module
+ *      uint64_t count;         // Number of records
+ *      { uint64_t hash; uint64_t offset; } records[count];     // offset is from the base of the module
+ */
+
+namespace injector
+{
+    // Lowest level stuff (hashing and file mapping) goes on the following namespace
+    // PRIVATE! Skip this, not interesting for you.
+    namespace injector_pattern_cache
+    {
+        using injector_file::hash;
+        using injector_file::mapped_file;
+
+        struct header
+        {
+            char     magic[4];
+            uint32_t version;
+            uint64_t fingerprint;
+            uint64_t count;
+        };
+
+        struct record
+        {
+            uint64_t hash;
+            uint64_t offset;
+        };
+    }
+
+    /*
+     *  GetModuleFingerprint
+     *      Gets a number which changes whenever the module at @module (nullptr for the main executable) is rebuilt or patched on disk
+     *      That's taken from the PE headers in Windows, otherwise from the GNU build-id (or the size and time of the file)
+     */
+    inline uint64_t GetModuleFingerprint(memory_pointer_raw module = nullptr)
+    {
+        using namespace injector_pattern_cache;
+#ifdef _WIN32
+        auto base = module.is_null()? uintptr_t(GetModuleHandle(NULL)) : module.as_int();
+        auto dos  = (const IMAGE_DOS_HEADER*)(base);
+        auto nt   = (const IMAGE_NT_HEADERS*)(base + dos->e_lfanew);
+        uint64_t h = hash(&nt->FileHeader, sizeof(nt->FileHeader));     // Has the link timestamp
+        h = hash(&nt->OptionalHeader.SizeOfImage, sizeof(nt->OptionalHeader.SizeOfImage), h);
+        h = hash(&nt->OptionalHeader.CheckSum, sizeof(nt->OptionalHeader.CheckSum), h);
+        h = hash(&nt->OptionalHeader.AddressOfEntryPoint, sizeof(nt->OptionalHeader.AddressOfEntryPoint), h);
+        return h;
+#else
+        struct context
+        {
+            uintptr_t module;
+            uint64_t  fingerprint;
+        } ctx = { module.as_int(), 0 };
+
+        // The first object reported by the dynamic linker is the main executable
+        dl_iterate_phdr([](dl_phdr_info* info, size_t, void* data) -> int
+        {
+            auto& ctx = *(context*)(data);
+            bool found = (ctx.module == 0);
+            for(int i = 0; i < info->dlpi_phnum && !found; ++i)
+            {
+                auto& ph = info->dlpi_phdr[i];
+                uintptr_t begin = info->dlpi_addr + ph.p_vaddr;
+                found = (ph.p_type == PT_LOAD && ctx.module >= begin && ctx.module < begin + ph.p_memsz);
+            }
+            if(!found) return 0;
+
+            // The build-id note, if the linker gave one
+            for(int i = 0; i < info->dlpi_phnum; ++i)
+            {
+                auto& ph = info->dlpi_phdr[i];
+                if(ph.p_type != PT_NOTE) continue;
+
+                const uint8_t* note = (const uint8_t*)(info->dlpi_addr + ph.p_vaddr);
+                const uint8_t* end  = note + ph.p_memsz;
+                while(note + sizeof(ElfW(Nhdr)) <= end)
+                {
+                    auto nhdr = (const ElfW(Nhdr)*)(note);
+                    const uint8_t* name = note + sizeof(ElfW(Nhdr));
+                    const uint8_t* desc = name + ((nhdr->n_namesz + 3) & ~3);
+                    if(nhdr->n_type == NT_GNU_BUILD_ID && nhdr->n_namesz == 4 && !memcmp(name, "GNU", 4))
+                    {
+                        ctx.fingerprint = hash(desc, nhdr->n_descsz);
+                        return 1;
+                    }
+                    note = desc + ((nhdr->n_descsz + 3) & ~3);
+                }
+            }
+
+            // Otherwise the file it came from
+            struct stat st;
+            const char* path = (info->dlpi_name && info->dlpi_name[0]? info->dlpi_name : "/proc/self/exe");
+            if(stat(path, &st) == 0)
+            {
+                uint64_t h = hash(&st.st_size, sizeof(st.st_size));
+                h = hash(&st.st_mtime, sizeof(st.st_mtime), h);
+                ctx.fingerprint = hash(&st.st_ino, sizeof(st.st_ino), h);
+            }
+            return 1;
+        }, &ctx);
+        return ctx.fingerprint;
+#endif
+    }
+
+    /*
+     *  pattern_cache
+     *      Remembers where patterns have been found in a module thought a cache file
+     *      The file is mapped read-only when the cache is opened, so looking for a pattern already in the cache costs
+     *      a binary search and a match against the memory, no scanning. New results are only written on save().
+     */
+    class pattern_cache
+    {
+        public:
+            static const uint32_t version = 1;
+
+            struct statistics
+            {
+                size_t hits;        // Patterns resolved from the cache
+                size_t misses;      // Patterns that needed a scan
+                size_t stale;       // Records that didn't match the memory anymore
+            };
+
+        private:
+            using header = injector_pattern_cache::header;
+            using record = injector_pattern_cache::record;
+
+            std::string                             path;
+            uintptr_t                               handle;         // The module as given to the constructor
+            uintptr_t                               module;         // Base of the module (lowest address of it)
+            uintptr_t                               module_end;
+            uint64_t                                fingerprint;
+            injector_pattern_cache::mapped_file     file;
+            const record*                           records = nullptr;
+            size_t                                  count = 0;
+            std::map<uint64_t, uint64_t>            added;          // Found after the file has been mapped
+            statistics                              stats = { 0, 0, 0 };
+
+        public:
+            // Opens the cache file at @path for @module (nullptr for the main executable)
+            // A missing file or a file made for another build of the module is the same as an empty cache
+            pattern_cache(const char* path, memory_pointer_raw module = nullptr)
+                : path(path), handle(module.as_int())
+            {
+                auto sections = GetModuleSections(module, false);
+                this->module = this->module_end = 0;
+                for(auto& r : sections)
+                {
+                    if(this->module == 0 || r.begin < this->module) this->module = r.begin;
+                    if(r.end > this->module_end) this->module_end = r.end;
+                }
+                this->fingerprint = GetModuleFingerprint(module);
+                this->load();
+            }
+
+            pattern_cache(const pattern_cache&) = delete;
+            pattern_cache& operator=(const pattern_cache&) = delete;
+
+            // Checks whether the file has been loaded (it exists and it's for this build of the module)
+            bool loaded() const         { return this->records != nullptr; }
+
+            // Number of patterns in the cache
+            size_t size() const         { return this->count + this->added.size(); }
+
+            // Gets where @pattern has been found before, or nullptr if that's not in the cache
+            memory_pointer_raw find(const byte_pattern& pattern)
+            {
+                const uint64_t key = hash(pattern);
+                uint64_t offset;
+
+                auto it = this->added.find(key);
+                if(it != this->added.end())
+                    offset = it->second;
+                else
+                {
+                    auto r = std::lower_bound(records, records + count, key, [](const record& r, uint64_t k) { return r.hash < k; });
+                    if(r == records + count || r->hash != key)
+                        return nullptr;
+                    offset = r->offset;
+                }
+
+                // Never trust the file blindly
+                uintptr_t address = this->module + uintptr_t(offset);
+                if(offset >= this->module_end - this->module || this->module_end - address < pattern.size()
+                || !pattern.match((const uint8_t*)(address)))
+                {
+                    this->stats.stale++;
+                    return nullptr;
+                }
+                return address;
+            }
+
+            // Tells the cache @pattern has been found at @address
+            void store(const byte_pattern& pattern, memory_pointer_raw address)
+            {
+                if(address.as_int() >= this->module && address.as_int() < this->module_end)
+                    this->added[hash(pattern)] = address.as_int() - this->module;
+            }
+
+            // Gets where @pattern is found in the code of the module, from the cache if possible, scanning it otherwise
+            memory_pointer_raw resolve(const byte_pattern& pattern, size_t threads = 1)
+            {
+                auto p = this->find(pattern);
+                if(!p.is_null())
+                {
+                    this->stats.hits++;
+                    return p;
+                }
+
+                this->stats.misses++;
+                for(auto& range : GetModuleSections(raw_ptr(this->handle)))
+                {
+                    p = FindPatternParallel(range.begin, range.end, pattern, threads);
+                    if(!p.is_null())
+                    {
+                        this->store(pattern, p);
+                        break;
+                    }
+                }
+                return p;
+            }
+
+            // Resolves the patterns of @batch from the cache, and scans the module only for the ones not in the cache
+            // Returns true if every pattern of the batch has been resolved
+            bool resolve(pattern_batch& batch, size_t threads = 1)
+            {
+                std::vector<size_t> missing;
+                for(size_t i = 0; i < batch.size(); ++i)
+                {
+                    if(!batch.get(i).is_null())
+                        continue;
+
+                    auto p = this->find(batch.pattern(i));
+                    if(p.is_null())
+                        missing.push_back(i);
+                    else
+                    {
+                        batch.set(i, p);
+                        this->stats.hits++;
+                    }
+                }
+
+                if(missing.size())
+                {
+                    this->stats.misses += missing.size();
+                    batch.scan_module(raw_ptr(this->handle), threads);
+                    for(size_t i : missing)
+                    {
+                        if(!batch.get(i).is_null())
+                            this->store(batch.pattern(i), batch.get(i));
+                    }
+                }
+                return batch.resolved();
+            }
+
+            // Writes the cache file, with everything from the loaded file plus what has been found since then
+            // The file is replaced atomically, so other processes either see the old or the new one. Returns false on failure.
+            bool save()
+            {
+                if(this->added.empty() && this->loaded())
+                    return true;
+
+                // Merge the loaded records with the new ones, which are also sorted
+                std::vector<record> merged;
+                merged.reserve(this->size());
+                auto it = this->added.begin();
+                for(size_t i = 0; i < this->count; ++i)
+                {
+                    for(; it != this->added.end() && it->first < records[i].hash; ++it)
+                        merged.push_back(record { it->first, it->second });
+                    if(it != this->added.end() && it->first == records[i].hash)
+                        merged.push_back(record { it->first, (it++)->second });
+                    else
+                        merged.push_back(records[i]);
+                }
+                for(; it != this->added.end(); ++it)
+                    merged.push_back(record { it->first, it->second });
+
+                header h = { { 'I', 'N', 'J', 'C' }, version, this->fingerprint, merged.size() };
+                std::string temp = this->path + ".tmp";
+                FILE* f = fopen(temp.c_str(), "wb");
+                if(f == nullptr)
+                    return false;
+                bool ok = fwrite(&h, sizeof(h), 1, f) == 1
+                       && fwrite(merged.data(), sizeof(record), merged.size(), f) == merged.size();
+                ok = (fclose(f) == 0) && ok;
+
+                this->file.close();     // Windows can't replace a mapped file
+                this->records = nullptr;
+                this->count = 0;
+#ifdef _WIN32
+                ok = ok && MoveFileExA(temp.c_str(), this->path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+                ok = ok && rename(temp.c_str(), this->path.c_str()) == 0;
+#endif
+                if(!ok) remove(temp.c_str());
+
+                // The new records are in the file now, or kept for the next try
+                if(this->load() && ok)
+                    this->added.clear();
+                return ok;
+            }
+
+            statistics get_statistics() const
+            {
+                return this->stats;
+            }
+
+            // Hash of @pattern as used for the keys of the cache
+            static uint64_t hash(const byte_pattern& pattern)
+            {
+                uint64_t size = pattern.size();
+                uint64_t h = injector_pattern_cache::hash(&size, sizeof(size));
+                h = injector_pattern_cache::hash(pattern.bytes.data(), pattern.size(), h);
+                return injector_pattern_cache::hash(pattern.mask.data(), pattern.size(), h);
+            }
+
+        private:
+            // Maps the file, which must be made for this build of the module
+            bool load()
+            {
+                if(!this->file.open(this->path.c_str()))
+                    return false;
+
+                auto h = (const header*)(this->file.get());
+                const size_t length = this->file.length();
+                if(length < sizeof(header) || memcmp(h->magic, "INJC", 4) || h->version != version
+                || h->fingerprint != this->fingerprint || (length - sizeof(header)) / sizeof(record) != h->count)
+                {
+                    this->file.close();
+                    return false;
+                }
+
+                this->records = (const record*)(h + 1);
+                this->count   = size_t(h->count);
+                return true;
+            }
+    };
+}
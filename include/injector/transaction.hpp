@@ -0,0 +1,187 @@
+/*
+ *  Injectors - Batched Memory Patching
+ *
+ *  Copyright (C) 2014 LINK/2012 <dma_2012@hotmail.com>
+ *
+ *  This software is provided 'as-is', without any express or implied
+ *  warranty. In no event will the authors be held liable for any damages
+ *  arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *     1. The origin of this software must not be misrepresented; you must not
+ *     claim that you wrote the original software. If you use this software
+ *     in a product, an acknowledgment in the product documentation would be
+ *     appreciated but is not required.
+ *
+ *     2. Altered source versions must be plainly marked as such, and must not be
+ *     misrepresented as being the original software.
+ *
+ *     3. This notice may not be removed or altered from any source
+ *     distribution.
+ *
+ */
+#pragma once
+#include "injector.hpp"
+#include <vector>
+#include <algorithm>
+
+namespace injector
+{
+    /*
+     *  patch_transaction
+     *      Collects many memory writes and applies all of them at once on commit()
+     *      Each of the pages touched by the writes gets unprotected exactly once, instead of once per write as
+     *      happens when using WriteMemory, MakeJMP and friends with virtual protect enabled.
+     *      Nothing is written to the memory before commit(), destroying an uncommitted transaction discards it.
+     */
+    class patch_transaction
+    {
+        private:
+            struct patch
+            {
+                uintptr_t addr;     // Where to write
+                size_t    offset;   // Offset of the content in the data buffer
+                size_t    size;     // Size of the content
+            };
+
+            std::vector<patch>   patches;   // Writes in the order they have been requested
+            std::vector<uint8_t> data;      // The content to be written by the patches
+
+        public:
+            patch_transaction() = default;
+            patch_transaction(const patch_transaction&) = delete;
+            patch_transaction& operator=(const patch_transaction&) = delete;
+
+            // Queues the write of @size bytes from @value into @addr
+            void write_raw(memory_pointer_tr addr, const void* value, size_t size)
+            {
+                patch p = { addr.as_int(), data.size(), size };
+                data.insert(data.end(), (const uint8_t*)(value), (const uint8_t*)(value) + size);
+                patches.push_back(p);
+            }
+
+            // Queues the write of the object @value into @addr
+            template<class T>
+            void write(memory_pointer_tr addr, T value)
+            {
+                return write_raw(addr, &value, sizeof(value));
+            }
+
+            // Queues the filling of @size bytes at @addr with the byte @value
+            void fill(memory_pointer_tr addr, uint8_t value, size_t size)
+            {
+                patch p = { addr.as_int(), data.size(), size };
+                data.insert(data.end(), size, value);
+                patches.push_back(p);
+            }
+
+            // Queues @count NOP instructions at @at
+            void make_nop(memory_pointer_tr at, size_t count = 1)
+            {
+                return fill(at, 0x90, count);
+            }
+
+            // Queues a JMP instruction at @at that jumps into @dest
+            // Returns the destination of the branch currently at @at, as MakeJMP does
+            memory_pointer_raw make_jmp(memory_pointer_tr at, memory_pointer_raw dest)
+            {
+                memory_pointer_raw p;
+                return make_branch(0xE9, at, dest, p)? p : nullptr;
+            }
+
+            // Same as above but returns false if the JMP can't be made, with the previous destination given to @previous
+            bool make_jmp(memory_pointer_tr at, memory_pointer_raw dest, memory_pointer_raw& previous)
+            {
+                return make_branch(0xE9, at, dest, previous);
+            }
+
+            // Queues a CALL instruction at @at that calls @dest
+            // Returns the destination of the branch currently at @at, as MakeCALL does
+            memory_pointer_raw make_call(memory_pointer_tr at, memory_pointer_raw dest)
+            {
+                memory_pointer_raw p;
+                return make_branch(0xE8, at, dest, p)? p : nullptr;
+            }
+
+            // Same as above but returns false if the CALL can't be made, with the previous destination given to @previous
+            bool make_call(memory_pointer_tr at, memory_pointer_raw dest, memory_pointer_raw& previous)
+            {
+                return make_branch(0xE8, at, dest, previous);
+            }
+
+            // Number of writes queued
+            size_t size() const     { return patches.size(); }
+            bool   empty() const    { return patches.empty(); }
+
+            // Discards all queued writes
+            void clear()
+            {
+                patches.clear();
+                data.clear();
+            }
+
+            // Applies all the queued writes in the order they've been requested
+            // If any of the pages cannot be unprotected nothing gets written and false is returned
+            // The transaction is left empty after this call (even on failure)
+            bool commit()
+            {
+                const uintptr_t page_mask = ~uintptr_t(GetPageSize() - 1);
+
+                // Find out the set of pages touched by the writes
+                std::vector<std::pair<uintptr_t, memory_protection>> pages;
+                for(auto& p : patches)
+                {
+                    if(p.size == 0) continue;
+                    for(uintptr_t page = p.addr & page_mask; page <= ((p.addr + p.size - 1) & page_mask); page += GetPageSize())
+                        pages.emplace_back(page, 0);
+                }
+                std::sort(pages.begin(), pages.end());
+                pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+
+                // Unprotect every page once
+                bool success = true;
+                size_t unprotected = 0;
+                for(; unprotected < pages.size(); ++unprotected)
+                {
+                    auto& page = pages[unprotected];
+                    if(!UnprotectMemory(raw_ptr(page.first), GetPageSize(), page.second))
+                    {
+                        success = false;
+                        break;
+                    }
+                }
+
+                // Write everything
+                if(success)
+                {
+                    for(auto& p : patches)
+                        memcpy((void*)(p.addr), data.data() + p.offset, p.size);
+                }
+
+                // Give the pages their protection back
+                for(size_t i = 0; i < unprotected; ++i)
+                    ProtectMemory(raw_ptr(pages[i].first), GetPageSize(), pages[i].second);
+
+                this->clear();
+                return success;
+            }
+
+        private:
+            bool make_branch(uint8_t opcode, memory_pointer_tr at, memory_pointer_raw dest, memory_pointer_raw& previous)
+            {
+                previous = GetBranchDestination(at, false);
+                auto target = GetReachableDestination(at + 5, dest);
+                if(target.is_null()) return false;
+
+                uint8_t buf[5];
+                int32_t rel = GetRelativeOffset(target, at + 5);
+                buf[0] = opcode;
+                memcpy(&buf[1], &rel, sizeof(rel));
+                write_raw(at, buf, sizeof(buf));
+                return true;
+            }
+    };
+}
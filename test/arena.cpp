@@ -0,0 +1,120 @@
+// executable_arena: stubs in reach of where they're asked to be, their alignment, the statistics, and reusing freed space
+#include <injector/injector.hpp>
+#include <injector/arena.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include "test.hpp"
+using namespace injector;
+
+// Checks whether all of [@p, @p + @size) can be reached by a rel32 from @nearby
+static bool in_reach(const void* p, size_t size, const void* nearby)
+{
+    return IsRelativeOffsetReachable(raw_ptr(p), raw_ptr(nearby))
+        && IsRelativeOffsetReachable(raw_ptr((const uint8_t*)(p) + size), raw_ptr(nearby));
+}
+
+int main()
+{
+    // Two places far apart from each other, this executable and the C library
+    const void* here  = (const void*)(&main);
+    const void* there = (const void*)(&std::printf);
+    const bool far_apart = !IsRelativeOffsetReachable(raw_ptr(here), raw_ptr(there));
+
+    {
+        executable_arena arena;
+        const size_t page = GetPageSize();
+
+        // Stubs are aligned and packed next to each other
+        uint8_t* a = (uint8_t*) arena.allocate(1, here);
+        uint8_t* b = (uint8_t*) arena.allocate(17, here);
+        uint8_t* c = (uint8_t*) arena.allocate(32, here);
+        CHECK(a && b && c);
+        CHECK(uintptr_t(a) % executable_arena::alignment == 0);
+        CHECK(b == a + 16);
+        CHECK(c == b + 32);
+        CHECK(in_reach(a, 80, here));
+
+        executable_arena::statistics s = arena.get_statistics();
+        CHECK(s.pages == 1);
+        CHECK(s.reserved == page);
+        CHECK(s.used == 80);
+        CHECK(s.stubs == 3);
+        CHECK(s.bytes_per_stub() == 26);
+
+        // The memory can be written and run
+        a[0] = 0xC3;
+        reinterpret_cast<void(*)()>(a)();
+
+        // Stubs asked to be somewhere else get their own pages there
+        uint8_t* d = (uint8_t*) arena.allocate(16, there);
+        CHECK(d != nullptr);
+        CHECK(in_reach(d, 16, there));
+        if(far_apart)
+        {
+            CHECK(!in_reach(d, 16, here));
+            CHECK(arena.get_statistics().pages == 2);
+        }
+
+        // Anywhere goes into whatever page has room
+        uint8_t* e = (uint8_t*) arena.allocate(16);
+        CHECK(e == d + 16 || e == c + 32);
+
+        // The last stub of a page gives its space back, the ones before it only once the page is empty
+        arena.deallocate(c, 32);
+        CHECK(arena.allocate(32, here) == c);
+        arena.deallocate(b, 17);
+        CHECK(arena.allocate(16, here) == c + 32);
+        CHECK(arena.get_statistics().stubs == 5);
+
+        arena.deallocate(a, 1);
+        arena.deallocate(c, 32);
+        arena.deallocate(c + 32, 16);
+        arena.deallocate(d, 16);
+        arena.deallocate(e, 16);
+        s = arena.get_statistics();
+        CHECK(s.pages == 0 && s.reserved == 0 && s.used == 0 && s.stubs == 0);
+        CHECK(s.bytes_per_stub() == 0);
+
+        // Bigger stubs than a page, and bigger pages
+        uint8_t* big = (uint8_t*) arena.allocate(page + 1, here);
+        CHECK(big != nullptr && in_reach(big, page + 1, here));
+        CHECK(arena.get_statistics().pages == 2);
+        executable_arena chunky(3 * page);
+        CHECK(chunky.allocate(16) != nullptr);
+        CHECK(chunky.get_statistics().pages == 3);
+    }
+
+    // Threads racing for the same holes around the same place
+    {
+        std::vector<std::vector<std::pair<uint8_t*, size_t>>> blocks(4);
+        std::vector<std::thread> threads;
+        for(size_t t = 0; t < blocks.size(); ++t)
+        {
+            threads.emplace_back([&blocks, t, here] {
+                for(size_t i = 0; i < 64; ++i)
+                {
+                    const size_t size = GetPageSize() * (1 + i % 3);
+                    blocks[t].emplace_back((uint8_t*) AllocateExecutableMemory(size, here), size);
+                }
+            });
+        }
+        for(auto& thread : threads) thread.join();
+
+        std::vector<std::pair<uint8_t*, size_t>> all;
+        for(auto& v : blocks) all.insert(all.end(), v.begin(), v.end());
+        std::sort(all.begin(), all.end());
+        for(size_t i = 0; i < all.size(); ++i)
+        {
+            CHECK(all[i].first != nullptr);
+            if(all[i].first == nullptr) continue;
+            CHECK(in_reach(all[i].first, all[i].second, here));
+            if(i > 0 && all[i - 1].first) CHECK(all[i - 1].first + all[i - 1].second <= all[i].first);
+        }
+        for(auto& b : all)
+            if(b.first) FreeExecutableMemory(b.first, b.second);
+    }
+
+    return test::result();
+}
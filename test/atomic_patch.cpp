@@ -0,0 +1,90 @@
+// MakeCALLAtomic and MakeJMPAtomic rewriting a live site while other threads run it
+#include <injector/injector.hpp>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include "test.hpp"
+using namespace injector;
+
+static const uint8_t ret1[] = { 0xB8, 0x01, 0x00, 0x00, 0x00, 0xC3 };              // mov eax, 1; ret
+static const uint8_t ret2[] = { 0xB8, 0x02, 0x00, 0x00, 0x00, 0xC3 };              // mov eax, 2; ret
+static const uint8_t call_prologue[] = { 0x48, 0x83, 0xEC, 0x08 };                  // sub rsp, 8
+static const uint8_t call_epilogue[] = { 0x48, 0x83, 0xC4, 0x08, 0xC3 };            // add rsp, 8; ret
+
+// Runs @fn from a few threads while @patch keeps flipping its branch between the two targets
+template<class Patch>
+static void stress(uint8_t* fn, Patch patch)
+{
+    std::atomic<bool> stop(false);
+    std::atomic<size_t> bad(0), calls(0);
+    std::vector<std::thread> callers;
+
+    for(int i = 0; i < 4; ++i)
+    {
+        callers.emplace_back([&] {
+            auto f = (int(*)())(fn);
+            size_t n = 0;
+            while(!stop.load(std::memory_order_relaxed))
+            {
+                int r = f();
+                if(r != 1 && r != 2) bad.fetch_add(1);
+                ++n;
+            }
+            calls.fetch_add(n);
+        });
+    }
+
+    size_t flips = 0;
+    auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+    while(std::chrono::steady_clock::now() < end)
+    {
+        CHECK(patch(flips & 1));
+        ++flips;
+        std::this_thread::yield();
+    }
+
+    stop = true;
+    for(auto& t : callers) t.join();
+    CHECK(bad.load() == 0);
+    CHECK(calls.load() > 0);
+}
+
+int main()
+{
+    uint8_t* page = test::map_code(4096);
+    CHECK(page != nullptr);
+    if(!page) return test::result();
+
+    uint8_t* targets[2] = { page, page + 3072 };
+    WriteMemoryRaw(targets[0], (void*)(ret1), sizeof(ret1), true);
+    WriteMemoryRaw(targets[1], (void*)(ret2), sizeof(ret2), true);
+
+    // A call site at every offset inside a 8 bytes block, each takes a different path of WriteInstructionAtomic
+    // The sites are at the end of a cache line, so a plain write would cross it
+    for(int offset = 0; offset < 8; ++offset)
+    {
+        uint8_t* site = page + 256 + 128 * offset + 56 + offset;
+        uint8_t* fn = site - sizeof(call_prologue);
+        WriteMemoryRaw(fn, (void*)(call_prologue), sizeof(call_prologue), true);
+        MakeCALL(site, targets[0]);
+        WriteMemoryRaw(site + 5, (void*)(call_epilogue), sizeof(call_epilogue), true);
+        CHECK(((uintptr_t)(site) & 7) == uintptr_t(offset));
+        CHECK(((int(*)())(fn))() == 1);
+
+        stress(fn, [&](size_t i) { return MakeCALLAtomic(site, targets[i]); });
+        CHECK(GetBranchDestination(site).get<uint8_t>() == targets[0] || GetBranchDestination(site).get<uint8_t>() == targets[1]);
+    }
+
+    // Same for a tail jump
+    for(int offset = 0; offset < 8; ++offset)
+    {
+        uint8_t* fn = page + 1280 + 128 * offset + 56 + offset;
+        MakeJMP(fn, targets[0]);
+        CHECK(((int(*)())(fn))() == 1);
+
+        stress(fn, [&](size_t i) { return MakeJMPAtomic(fn, targets[i]); });
+    }
+
+    return test::result();
+}
@@ -0,0 +1,88 @@
+// MakeJMP and MakeCALL in x86-64, near, thought relay thunks and failing
+#include <injector/injector.hpp>
+#include <injector/transaction.hpp>
+#include <cstring>
+#include "test.hpp"
+using namespace injector;
+
+extern "C" __attribute__((noinline)) int forty_two() { return 42; }
+extern "C" __attribute__((noinline)) int seven()     { return 7; }
+
+static const uint8_t ret1[] = { 0xB8, 0x01, 0x00, 0x00, 0x00, 0xC3 };          // mov eax, 1; ret
+static const uint8_t call_site[] =
+{
+    0x48, 0x83, 0xEC, 0x08,             // sub rsp, 8
+    0x90, 0x90, 0x90, 0x90, 0x90,       // the call goes here
+    0x48, 0x83, 0xC4, 0x08, 0xC3,       // add rsp, 8; ret
+};
+
+int main()
+{
+    // Somewhere away from this executable, so branching into it needs a relay thunk
+    uint8_t* page = test::map_code(4096, (uintptr_t(forty_two) + (uintptr_t(8) << 30)) & ~uintptr_t(0xFFFF));
+    CHECK(page != nullptr);
+    if(!page) return test::result();
+
+    uint8_t* near_target = page + 2048;
+    uint8_t* fn = page;
+    uint8_t* site = fn + 4;
+    WriteMemoryRaw(near_target, (void*)(ret1), sizeof(ret1), true);
+    WriteMemoryRaw(fn, (void*)(call_site), sizeof(call_site), true);
+    auto call_fn = (int(*)())(fn);
+
+    memory_pointer_raw previous = raw_ptr(1);
+
+    // Near call over something that isn't a branch
+    CHECK(MakeCALL(site, near_target, previous));
+    CHECK(previous.is_null());
+    CHECK(GetBranchDestination(site).get<void>() == near_target);
+    CHECK(call_fn() == 1);
+
+    // Far call, the previous destination is reported
+    CHECK(MakeCALL(site, raw_ptr(forty_two), previous));
+    CHECK(previous.get<void>() == near_target);
+    CHECK(GetBranchDestination(site).get<void>() != (void*)(forty_two));    // went thought a relay thunk
+    CHECK(call_fn() == 42);
+    CHECK(MakeCALL(site, raw_ptr(seven)).get<void>() != nullptr);
+    CHECK(call_fn() == 7);
+
+    // Far jump
+    uint8_t* tail = page + 1024;
+    CHECK(MakeJMP(tail, raw_ptr(forty_two), previous));
+    CHECK(previous.is_null());
+    CHECK(((int(*)())(tail))() == 42);
+    CHECK(MakeJMP(tail, near_target).get<void>() != nullptr);
+    CHECK(((int(*)())(tail))() == 1);
+
+    // Surround a site with 3GB of reserved memory at each side, no relay thunk can be placed in its reach
+    const size_t reach = size_t(3) << 30;
+    void* hole = mmap((void*)(0x300000000000), 2 * reach, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+    CHECK(hole == (void*)(0x300000000000));
+    if(hole == (void*)(0x300000000000))
+    {
+        uint8_t* far_page = test::map_code(4096, uintptr_t(hole) + reach);
+        CHECK(far_page != nullptr);
+
+        uint8_t* far_site = far_page + 16;
+        MakeCALL(far_site, far_page + 256);
+
+        uint8_t before[5];
+        memcpy(before, far_site, sizeof(before));
+
+        // Failing is told apart from having no branch before
+        CHECK(!MakeCALL(far_site, raw_ptr(forty_two), previous));
+        CHECK(previous.get<uint8_t>() == far_page + 256);
+        CHECK(!MakeJMP(far_site, raw_ptr(forty_two), previous));
+        CHECK(memcmp(before, far_site, sizeof(before)) == 0);
+        CHECK(MakeCALL(far_site, raw_ptr(forty_two)).is_null());
+        CHECK(memcmp(before, far_site, sizeof(before)) == 0);
+
+        patch_transaction tx;
+        CHECK(!tx.make_jmp(far_site, raw_ptr(forty_two), previous));
+        CHECK(tx.empty());
+
+        munmap(hole, 2 * reach);
+    }
+
+    return test::result();
+}
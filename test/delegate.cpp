@@ -0,0 +1,109 @@
+// inplace_delegate with functors inline and on the heap, copied, moved and move only
+#include <injector/hooking.hpp>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include "test.hpp"
+using namespace injector;
+
+typedef inplace_delegate<int(int)> delegate;
+typedef inplace_delegate<int(int), 32, false> move_only;
+
+static_assert(std::is_copy_constructible<delegate>::value && std::is_copy_assignable<delegate>::value, "copyable");
+static_assert(!std::is_copy_constructible<move_only>::value && !std::is_copy_assignable<move_only>::value, "move only");
+static_assert(std::is_nothrow_move_constructible<delegate>::value && std::is_nothrow_move_assignable<delegate>::value, "noexcept move");
+static_assert(std::is_nothrow_move_constructible<move_only>::value && std::is_nothrow_move_assignable<move_only>::value, "noexcept move");
+
+// Counts its live copies, @Pad bytes of captures
+template<size_t Pad>
+struct counted
+{
+    static int& alive() { static int n = 0; return n; }
+
+    char pad[Pad];
+    int  add;
+
+    counted(int add) : add(add)                 { ++alive(); }
+    counted(const counted& rhs) : add(rhs.add)  { ++alive(); }
+    counted(counted&& rhs) noexcept : add(rhs.add) { ++alive(); }
+    ~counted()                                  { --alive(); }
+    int operator()(int x) const                 { return x + add; }
+};
+
+// Can't be copied, @Pad bytes of captures
+template<size_t Pad>
+struct owning
+{
+    std::unique_ptr<int> p;
+    char pad[Pad];
+
+    owning(int value) : p(new int(value)), pad() {}
+    int operator()(int x) const { return x + *p + pad[0]; }
+};
+
+template<size_t Pad>
+static void check_delegate(bool inline_expected)
+{
+    typedef counted<Pad> functor;
+    CHECK(delegate::fits<functor>() == inline_expected);
+    {
+        delegate a = functor(1);
+        CHECK(functor::alive() == 1);
+        CHECK(a(1) == 2);
+
+        delegate b = a;
+        CHECK(functor::alive() == 2);
+        CHECK(b(2) == 3);
+
+        delegate c = std::move(a);
+        CHECK(!a && c && functor::alive() == 2);
+        CHECK(c(3) == 4);
+
+        a = c;
+        CHECK(functor::alive() == 3 && a(4) == 5);
+        a = std::move(b);
+        CHECK(!b && functor::alive() == 2 && a(5) == 6);
+        a = a;
+        CHECK(functor::alive() == 2 && a(6) == 7);
+        a = nullptr;
+        CHECK(!a && functor::alive() == 1);
+    }
+    CHECK(functor::alive() == 0);
+}
+
+int main()
+{
+    check_delegate<1>(true);
+    check_delegate<64>(false);
+
+    // Trivial functors, a capture too big for the default capacity
+    void *a = nullptr, *b = nullptr, *c = nullptr, *d = nullptr, *e = nullptr;
+    delegate big = [=](int x) { return x + (a == b) + (c == d) + (e == nullptr); };
+    delegate small = [](int x) { return x * 2; };
+    CHECK(big(0) == 3 && small(2) == 4);
+    std::swap(big, small);
+    CHECK(big(2) == 4 && small(0) == 3);
+
+    // A std::function inside
+    std::function<int(int)> f = [](int x) { return x - 1; };
+    delegate from_function = f;
+    CHECK(from_function(1) == 0);
+
+    // Move only functors, inline and on the heap
+    move_only m = owning<1>(10);
+    CHECK(m(1) == 11);
+    move_only n = std::move(m);
+    CHECK(!m && n(2) == 12);
+    move_only heap = owning<64>(20);
+    n = std::move(heap);
+    CHECK(!heap && n(3) == 23);
+
+    // A hook taking a big capture and a std::function
+    typedef function_hooker<0x1000, int(int)> hook;
+    hook::functor_type functor = [=](hook::func_type next, int& x) { return next(x) + (a == b) + (c == d) + (e == nullptr); };
+    hook::func_type next = f;
+    int x = 5;
+    CHECK(functor(next, x) == 7);
+
+    return test::result();
+}
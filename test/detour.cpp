@@ -0,0 +1,148 @@
+// Inline detours over hand written functions of this binary
+#include <injector/injector.hpp>
+#include <injector/detour.hpp>
+#include <cstring>
+#include "test.hpp"
+using namespace injector;
+
+extern "C"
+{
+    int f_frame(int);       // Regular prologue
+    int f_jcc(int);         // Short Jcc out of the stolen bytes
+    int f_riprel(int);      // RIP relative load
+    int f_call(int);        // CALL rel32
+    int f_short(int);       // Returns before 5 bytes, followed by padding
+    int f_short_bad(int);   // Returns before 5 bytes, followed by code
+    int f_lock(int*);       // Jumps over the LOCK prefix of the last stolen instruction
+    int f_double(int);
+    extern int f_value;
+}
+
+__asm__(
+    ".text\n"
+    ".p2align 4\n"
+    "f_frame:\n"
+    "   push %rbp\n"
+    "   mov %rsp, %rbp\n"
+    "   lea (%rdi,%rdi), %eax\n"
+    "   pop %rbp\n"
+    "   ret\n"
+
+    ".p2align 4\n"
+    "f_jcc:\n"
+    "   xor %eax, %eax\n"
+    "   test %edi, %edi\n"
+    "   .byte 0x74, 0x08\n"             // je +8, past the stolen bytes
+    "   mov %edi, %eax\n"
+    "   add $1, %eax\n"
+    "   ret\n"
+    "   int3\n"
+    "   int3\n"
+    "   mov $-1, %eax\n"
+    "   ret\n"
+
+    ".p2align 4\n"
+    "f_riprel:\n"
+    "   mov f_value(%rip), %eax\n"
+    "   add %edi, %eax\n"
+    "   ret\n"
+
+    ".p2align 4\n"
+    "f_call:\n"
+    "   .byte 0xE8\n"                   // call f_double
+    "   .long f_double - . - 4\n"
+    "   add $3, %eax\n"
+    "   ret\n"
+
+    ".p2align 4\n"
+    "f_short:\n"
+    "   mov %edi, %eax\n"
+    "   ret\n"
+    "   int3\n"
+    "   int3\n"
+    "   int3\n"
+    "   int3\n"
+
+    ".p2align 4\n"
+    "f_short_bad:\n"
+    "   mov %edi, %eax\n"
+    "   ret\n"
+    "   mov %esi, %eax\n"
+    "   ret\n"
+
+    ".p2align 4\n"
+    "f_lock:\n"
+    "   test %edi, %edi\n"
+    "   .byte 0x74, 0x01\n"             // je +1, over the lock prefix below (offset 5, past the 5 bytes jump)
+    "   lock cmpxchg %ecx, (%rsi)\n"
+    "   ret\n"
+
+    ".p2align 4\n"
+    "f_double:\n"
+    "   lea (%rdi,%rdi), %eax\n"
+    "   ret\n"
+
+    ".data\n"
+    ".p2align 2\n"
+    "f_value:\n"
+    "   .long 1000\n"
+    ".text\n"
+);
+
+static int (*original)(int);
+static int hook(int x) { return original(x) + 100; }
+
+// Detours @fn into hook and checks the original can still be reached thought the trampoline
+static void check_detour(int (*fn)(int), int arg)
+{
+    const int expected = fn(arg);
+    uint8_t before[16];
+    memcpy(before, (void*)(fn), sizeof(before));
+    {
+        scoped_detour detour;
+        original = detour.make_detour((void*)(fn), raw_ptr((void*)(hook))).get<int(int)>();
+        CHECK(original != nullptr);
+        if(original == nullptr) return;
+
+        CHECK(ReadMemory<uint8_t>((void*)(fn), true) == 0xE9);
+        CHECK(fn(arg) == expected + 100);
+        CHECK(original(arg) == expected);
+    }
+    CHECK(memcmp(before, (void*)(fn), sizeof(before)) == 0);
+    CHECK(fn(arg) == expected);
+}
+
+// Checks @fn is refused and left untouched
+static void check_refused(const void* fn)
+{
+    uint8_t before[16];
+    memcpy(before, fn, sizeof(before));
+    CHECK(MakeDetour(raw_ptr(fn), raw_ptr((void*)(hook))).is_null());
+    CHECK(memcmp(before, fn, sizeof(before)) == 0);
+}
+
+int main()
+{
+    check_detour(f_frame, 21);
+    check_detour(f_jcc, 0);
+    check_detour(f_jcc, 41);
+    check_detour(f_riprel, 5);
+    check_detour(f_call, 10);
+    check_detour(f_short, 7);
+
+    check_refused((const void*)(f_short_bad));
+    check_refused((const void*)(f_lock));
+
+    // The relocated rel32 operands must point at the same places
+    uint8_t code[injector_detour::max_trampoline];
+    size_t size;
+    int32_t rel;
+    const uintptr_t at = uintptr_t(f_call) + 0x10000;
+    size_t stolen = injector_detour::relocate((const uint8_t*)(f_call), 5, code, at, size);
+    memcpy(&rel, &code[1], sizeof(rel));
+    CHECK(stolen == 5);
+    CHECK(code[0] == 0xE8);
+    CHECK(at + 5 + rel == uintptr_t(f_double));
+
+    return test::result();
+}
@@ -0,0 +1,185 @@
+// Instruction lengths from the decoder against a table of known encodings, and GetBranchDestination next to an unmapped page
+#include <injector/injector.hpp>
+#include <cstring>
+#include <sys/mman.h>
+#include "test.hpp"
+using namespace injector;
+
+static const size_t na = size_t(-1);       // Not checked
+
+struct encoding
+{
+    const char* bytes;      // In the "8B 45 08" form
+    size_t      length32;   // Expected length in 32 bits, zero if invalid
+    size_t      length64;   // Expected length in 64 bits, zero if invalid
+};
+
+static const encoding encodings[] = {
+    // One byte
+    { "90",                             1, 1 },
+    { "C3",                             1, 1 },
+    { "06",                             1, 0 },     // PUSH ES
+
+    // Legacy prefixes and REX (which is INC/DEC in 32 bits, an instruction on its own)
+    { "F3 AB",                          2, 2 },
+    { "F3 48 AB",                       2, 3 },
+    { "F0 0F B1 0A",                    4, 4 },
+    { "2E 90",                          2, 2 },
+    { "64 A1 30 00 00 00",              6, 10 },    // moffs is 8 bytes in 64 bits
+    { "66 B8 34 12",                    4, 4 },
+    { "B8 78 56 34 12",                 5, 5 },
+    { "48 B8 01 02 03 04 05 06 07 08",  1, 10 },
+    { "49 BB 01 02 03 04 05 06 07 08",  1, 10 },
+    { "48 66 B8 34 12",                 1, 5 },     // REX before a prefix is ignored
+    { "40 48 90",                       1, 3 },
+    { "66 48 B8 01 02 03 04 05 06 07 08", 2, 11 },  // REX.W wins over 66
+    { "41 FF D3",                       1, 3 },
+
+    // Up to 15 bytes
+    { "66 66 66 66 66 66 66 66 66 66 66 66 66 66 90",       15, 15 },
+    { "66 66 66 66 66 66 66 66 66 66 66 66 66 66 66 90",    0, 0 },
+    { "66 66 66 66 66 66 66 66 66 66 66 66 05 34 12",       15, 15 },
+    { "66 66 66 66 66 66 66 66 66 66 66 66 66 05 34 12",    0, 0 },
+
+    // ModRM, SIB and displacements
+    { "8B C0",                          2, 2 },
+    { "8B 00",                          2, 2 },
+    { "8B 04 24",                       3, 3 },
+    { "8B 44 24 08",                    4, 4 },
+    { "8B 84 24 00 01 00 00",           7, 7 },
+    { "8B 04 25 00 10 00 00",           7, 7 },     // SIB without base
+    { "8B 44 8D 08",                    4, 4 },
+    { "8B 05 00 10 00 00",              6, 6 },     // Absolute in 32 bits, RIP relative in 64 bits
+    { "48 8B 05 00 10 00 00",           1, 7 },
+    { "8B 45 08",                       3, 3 },
+    { "8B 85 00 01 00 00",              6, 6 },
+    { "67 8B 00",                       3, 3 },     // 16 bits addressing in 32 bits, 32 bits addressing in 64 bits
+    { "67 8B 06 34 12",                 5, 3 },
+    { "67 8B 47 08",                    4, 4 },
+    { "67 8B 87 34 12",                 5, 7 },
+    { "64 48 8B 04 25 28 00 00 00",     2, 9 },
+    { "C6 05 00 10 00 00 01",           7, 7 },
+    { "C7 44 24 08 01 00 00 00",        8, 8 },
+    { "48 C7 C0 01 00 00 00",           1, 7 },
+    { "48 81 C4 00 01 00 00",           1, 7 },
+    { "48 83 C4 08",                    1, 4 },
+    { "69 C0 00 01 00 00",              6, 6 },
+    { "6B C0 08",                       3, 3 },
+
+    // Group 3, only TEST has an immediate
+    { "F6 C0 01",                       3, 3 },
+    { "F6 D0",                          2, 2 },
+    { "F7 C0 01 00 00 00",              6, 6 },
+    { "66 F7 C0 01 00",                 5, 5 },
+    { "F7 D0",                          2, 2 },
+    { "F7 44 24 08 01 00 00 00",        8, 8 },
+
+    // imm16
+    { "C2 08 00",                       3, 3 },
+    { "C8 10 00 01",                    4, 4 },
+    { "66 05 34 12",                    4, 4 },
+    { "9A 00 00 00 00 10 00",           7, 0 },     // CALL FAR
+
+    // Two bytes opcodes (0F)
+    { "0F 05",                          2, 2 },
+    { "0F 0B",                          2, 2 },
+    { "0F AF C0",                       3, 3 },
+    { "0F BA E0 05",                    4, 4 },
+    { "0F 1F 44 00 00",                 5, 5 },
+    { "66 0F 1F 44 00 00",              6, 6 },
+    { "0F 1F 84 00 00 00 00 00",        8, 8 },
+    { "0F 84 00 01 00 00",              6, 6 },
+    { "66 0F 70 C1 1B",                 5, 5 },
+
+    // Three bytes opcodes (0F 38, 0F 3A)
+    { "66 0F 38 00 C1",                 5, 5 },
+    { "0F 38 F0 06",                    4, 4 },
+    { "66 0F 38 00 44 24 08",           7, 7 },
+    { "66 0F 3A 0F C1 08",              6, 6 },
+    { "66 0F 3A 0F 44 24 08 04",        8, 8 },
+    { "66 0F 3A 16 05 00 10 00 00 01",  10, 10 },
+
+    // VEX and EVEX, which are LES, LDS and BOUND in 32 bits unless the next byte is a register ModRM
+    { "C5 F8 77",                       3, 3 },
+    { "C5 FD 6F 01",                    4, 4 },
+    { "C4 E3 7D 18 C1 01",              6, 6 },
+    { "62 F1 7C 48 28 C1",              6, 6 },
+    { "C5 01",                          2, na },
+    { "62 01",                          2, na },
+
+    // Branches
+    { "EB 10",                          2, 2 },
+    { "74 10",                          2, 2 },
+    { "E3 10",                          2, 2 },
+    { "E8 00 01 00 00",                 5, 5 },
+    { "E9 00 01 00 00",                 5, 5 },
+    { "66 E9 00 01",                    4, 6 },     // rel16 only in 32 bits
+    { "FF 15 00 10 00 00",              6, 6 },
+    { "FF 25 00 10 00 00",              6, 6 },
+};
+
+// Parses @text into @out, returns the number of bytes
+static size_t parse(const char* text, uint8_t* out)
+{
+    size_t n = 0;
+    for(unsigned value; std::sscanf(text, "%x", &value) == 1; text += 3)
+    {
+        out[n++] = uint8_t(value);
+        if(text[2] == 0) break;
+    }
+    return n;
+}
+
+int main()
+{
+    for(auto& e : encodings)
+    {
+        // Followed by bytes which would make it longer if the decoder went too far
+        uint8_t code[32];
+        memset(code, 0x8B, sizeof(code));
+        parse(e.bytes, code);
+
+        for(int x64 = 0; x64 < 2; ++x64)
+        {
+            const size_t expected = x64? e.length64 : e.length32;
+            if(expected == na) continue;
+            const size_t length = GetInstructionLength(code, x64 != 0);
+            CHECK(length == expected);
+            if(length != expected)
+                std::fprintf(stderr, "  %s in %d bits: %u instead of %u\n", e.bytes, x64? 64 : 32, unsigned(length), unsigned(expected));
+        }
+    }
+
+    // Branches ending right before an unmapped page, their protection must be left alone
+    uint8_t* page = test::map_code(8192);
+    CHECK(page != nullptr);
+    munmap(page + 4096, 4096);
+    uint8_t* const end = page + 4096;
+
+    static const char* const branches[] = { "E8 F0 FF FF FF", "EB F0", "0F 84 F0 FF FF FF", "FF 25 F0 FF FF FF" };
+    for(const char* text : branches)
+    {
+        uint8_t bytes[16];
+        const size_t n = parse(text, bytes);
+        uint8_t* at = end - n;
+        mprotect(page, 4096, PROT_READ | PROT_WRITE);
+        memcpy(at, bytes, n);
+        void* slot = (void*)(0x12345678);           // What the indirect one jumps thought
+        memcpy(end - 16, &slot, sizeof(slot));
+        mprotect(page, 4096, PROT_READ | PROT_EXEC);
+
+        memory_protection protection;
+        void* expected = (bytes[0] == 0xFF? slot : (void*)(end - 16));
+        CHECK(GetBranchDestination(at).get() == expected);
+        CHECK(GetBranchDestination(at, false).get() == expected);
+        CHECK(QueryProtection(page, protection) && protection == (PROT_READ | PROT_EXEC));
+
+        // Still decoded when it can't even be read
+        mprotect(page, 4096, PROT_NONE);
+        CHECK(GetBranchDestination(at).get() == expected);
+        CHECK(QueryProtection(page, protection) && protection == PROT_NONE);
+    }
+    munmap(page, 4096);
+
+    return test::result();
+}
@@ -0,0 +1,72 @@
+// scoped_dispatcher on a call site, anything else refused, and the call put back on restore
+#include <injector/dispatcher.hpp>
+#include <cstring>
+#include <vector>
+#include "test.hpp"
+using namespace injector;
+
+static std::vector<int> seen;
+static void first(int x)  { seen.push_back(x); }
+static void second(int x) { seen.push_back(-x); }
+
+int main()
+{
+    // sub rsp, 8; call original; add rsp, 8; ret
+    static const uint8_t caller[] = { 0x48, 0x83, 0xEC, 0x08, 0xE8, 0, 0, 0, 0, 0x48, 0x83, 0xC4, 0x08, 0xC3 };
+    static const uint8_t original[] = { 0x8D, 0x47, 0x01, 0xC3 };   // lea eax, [rdi+1]; ret
+    uint8_t* page = test::map_code(4096);
+    CHECK(page != nullptr);
+
+    uint8_t* site = page + 4;
+    uint8_t* target = page + 64;
+    WriteMemoryRaw(page, (void*)(caller), sizeof(caller), true);
+    WriteMemoryRaw(target, (void*)(original), sizeof(original), true);
+    MakeCALL(site, target);
+    auto fn = (int(*)(int))(page);
+
+    uint8_t call_bytes[5];
+    memcpy(call_bytes, site, sizeof(call_bytes));
+
+    // Only relative calls are taken over
+    uint8_t* jmp_site = page + 128;
+    MakeJMP(jmp_site, target);
+    uint8_t jmp_bytes[5];
+    memcpy(jmp_bytes, jmp_site, sizeof(jmp_bytes));
+    {
+        scoped_dispatcher<void(*)(int)> d;
+        CHECK(!d.make_dispatcher(jmp_site));
+        CHECK(memcmp(jmp_site, jmp_bytes, sizeof(jmp_bytes)) == 0);
+        CHECK(!d.make_dispatcher(page));     // sub rsp, 8
+        CHECK(memcmp(page, caller, 4) == 0);
+    }
+
+    {
+        scoped_dispatcher<void(*)(int)> d;
+        CHECK(d.add(first));
+        CHECK(d.make_dispatcher(site));
+        CHECK(d.original().get<void>() == target);
+        CHECK(d.add(second));
+
+        CHECK(fn(5) == 6);
+        CHECK(seen.size() == 2 && seen[0] == 5 && seen[1] == -5);
+
+        CHECK(d.remove(first));
+        CHECK(!d.remove(first));
+        seen.clear();
+        CHECK(fn(7) == 8);
+        CHECK(seen.size() == 1 && seen[0] == -7);
+
+        d.restore();
+        CHECK(memcmp(site, call_bytes, sizeof(call_bytes)) == 0);
+        seen.clear();
+        CHECK(fn(1) == 2 && seen.empty());
+
+        // Taken over again with the same handlers
+        CHECK(d.make_dispatcher(site));
+        CHECK(fn(2) == 3 && seen.size() == 1);
+    }
+    CHECK(memcmp(site, call_bytes, sizeof(call_bytes)) == 0);
+    CHECK(fn(3) == 4);
+
+    return test::result();
+}
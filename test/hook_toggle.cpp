@@ -0,0 +1,170 @@
+// function_hooker chains changed from one thread while eight threads call thought the hook, hooks using the library epoch, and move only hooks
+#define INJECTOR_GVM_HAS_TRANSLATOR
+#include <injector/injector.hpp>
+#include <injector/gvm/translator.hpp>
+#include <injector/hooking.hpp>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "test.hpp"
+using namespace injector;
+
+namespace injector
+{
+    void* address_manager::translator(void* p)
+    {
+        return address_translator_manager::singleton().translator(p);
+    }
+}
+
+// The code page, a function of int(int) calling another (sub rsp, 8; call original; add rsp, 8; ret)
+static const uintptr_t page_addr = 0x200000000;
+static const uintptr_t site_addr = page_addr + 4;
+static const uintptr_t original_addr = page_addr + 64;  // lea eax, [rdi+1]; ret
+
+using hook = function_hooker<site_addr, int(int)>;
+
+// Maps @from into @to
+struct test_translator final : address_translator
+{
+    test_translator(uintptr_t from, uintptr_t to)
+    {
+        map[raw_ptr(from)] = raw_ptr(to);
+    }
+
+    ~test_translator()
+    {
+        this->remove();
+    }
+};
+
+// A hook which can't be copied, counting how many of its kind are alive
+struct owning_hook
+{
+    struct counter
+    {
+        counter()  { ++alive(); }
+        ~counter() { --alive(); }
+    };
+
+    static int& alive() { static int n = 0; return n; }
+
+    std::unique_ptr<counter> owned;
+    int add;
+
+    owning_hook(int add) : owned(new counter()), add(add) {}
+    int operator()(hook::func_type next, int x) const { return next(x) + add; }
+};
+
+int main()
+{
+    static const uint8_t caller[] = { 0x48, 0x83, 0xEC, 0x08, 0xE8, 0, 0, 0, 0, 0x48, 0x83, 0xC4, 0x08, 0xC3 };
+    static const uint8_t original[] = { 0x8D, 0x47, 0x01, 0xC3 };
+    uint8_t* page = test::map_code(4096, page_addr);
+    CHECK(page == (uint8_t*)(page_addr));
+    if(page != (uint8_t*)(page_addr))
+        return test::result();
+
+    test_translator identity(site_addr, site_addr);
+    WriteMemoryRaw(raw_ptr(page_addr), (void*)(caller), sizeof(caller), true);
+    WriteMemoryRaw(raw_ptr(original_addr), (void*)(original), sizeof(original), true);
+    MakeCALL(raw_ptr(site_addr), raw_ptr(original_addr));
+    auto fn = (int(*)(int))(page_addr);
+
+    // Waiting for the readers from inside a read section doesn't wait for itself
+    {
+        epoch_manager::read_guard guard;
+        epoch_manager::singleton().synchronize();
+        hook_epoch_manager::read_guard hook_guard;
+        hook_epoch_manager::singleton().synchronize();
+    }
+
+    // A hook removing a translator, which waits for the translations in flight
+    {
+        test_translator* removed = new test_translator(0x1000, 0x2000);
+        CHECK(address_manager::translate_address((void*)(0x1000)) == (void*)(0x2000));
+
+        hook h;
+        h.make_call([&](hook::func_type next, int x) { delete removed; removed = nullptr; return next(x) + 1; });
+        CHECK(fn(1) == 3);
+        CHECK(removed == nullptr);
+        CHECK(address_manager::translate_address((void*)(0x1000)) == nullptr);
+    }
+    CHECK(fn(1) == 2);
+
+    // Move only hooks, stored once however many times the chain gets rebuilt
+    {
+        hook h, other;
+        h.make_call(owning_hook(100));
+        CHECK(owning_hook::alive() == 1);
+        for(int i = 0; i < 4; ++i)
+        {
+            other.make_call([](hook::func_type next, int x) { return next(x) * 2; });
+            CHECK(fn(1) == 204);
+            other.restore();
+            CHECK(fn(1) == 102);
+        }
+        hook moved(std::move(h));
+        CHECK(fn(1) == 102);
+        CHECK(owning_hook::alive() == 1);
+        moved.restore();
+        CHECK(fn(1) == 2);
+    }
+    hook_epoch_manager::singleton().synchronize();
+    CHECK(owning_hook::alive() == 0);
+
+    // One thread toggling two hooks, eight calling
+    hook a, b;
+    auto add_one = [](hook::func_type next, int x) { return next(x) + 1; };
+    auto add_ten = [](hook::func_type next, int x) { return next(x) + 10; };
+
+    std::atomic<bool> stop(false);
+    std::atomic<size_t> calls(0), wrong(0), toggles(0);
+    std::vector<std::thread> callers;
+    for(int t = 0; t < 8; ++t)
+    {
+        callers.emplace_back([&, t] {
+            size_t n = 0;
+            for(int x = t; !stop.load(std::memory_order_relaxed); x = (x + 1) & 0xFFFF, ++n)
+            {
+                const int r = fn(x) - (x + 1);
+                if(r != 0 && r != 1 && r != 10 && r != 11)
+                    ++wrong;
+            }
+            calls += n;
+        });
+    }
+
+    std::thread toggler([&] {
+        auto begin = std::chrono::steady_clock::now();
+        while(std::chrono::steady_clock::now() - begin < std::chrono::milliseconds(500))
+        {
+            a.make_call(add_one);
+            b.make_call(add_ten);
+            a.restore();
+            a.make_call(add_one);
+            b.restore();
+            a.restore();
+            ++toggles;
+            std::this_thread::yield();
+        }
+        stop = true;
+    });
+
+    toggler.join();
+    for(auto& t : callers) t.join();
+    CHECK(calls.load() > 0);
+    CHECK(toggles.load() > 0);
+    CHECK(wrong.load() == 0);
+    CHECK(fn(1) == 2);
+
+    // Every replaced chain gets freed once nobody is calling
+    hook_epoch_manager::singleton().synchronize();
+    CHECK(hook_epoch_manager::singleton().get_statistics().pending == 0);
+    CHECK(hook_epoch_manager::singleton().get_statistics().reclaimed > 0);
+
+    std::printf("%zu calls, %zu toggles\n", calls.load(), toggles.load());
+    return test::result();
+}
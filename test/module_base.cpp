@@ -0,0 +1,52 @@
+// module_base_table knowing the main executable upfront and listing the other modules lazily
+#include <injector/injector.hpp>
+#include <dlfcn.h>
+#include <cstdlib>
+#include "test.hpp"
+using namespace injector;
+
+static int in_main;
+
+int main()
+{
+    Dl_info exe, libc;
+    CHECK(dladdr((void*)(&in_main), &exe) != 0);
+    CHECK(dladdr((void*)(&std::abort), &libc) != 0);
+    const uintptr_t exe_base = uintptr_t(exe.dli_fbase);
+
+    // The fast path agrees with the table, without the table having been built
+    const uintptr_t delta = module_base_table::main_delta();
+    module_base_table table;
+    CHECK(table.main_module().actual == exe_base);
+    CHECK(table.main_module().delta() == delta);
+    CHECK(table.main_module().size != 0);
+
+    // Main executable lookups
+    const uintptr_t preferred = uintptr_t(&in_main) - delta;
+    CHECK(table.find(preferred) == &table.main_module());
+    CHECK(table.translate((void*)(preferred)) == (void*)(&in_main));
+    CHECK(table.find_loaded(uintptr_t(&in_main)) == &table.main_module());
+    CHECK(table.translate((void*)(preferred), nullptr) == (void*)(&in_main));
+
+    // Other modules, listed on first use
+    const module_base_table::module* m = table.find_loaded(uintptr_t(&std::abort));
+    CHECK(m != nullptr && m != &table.main_module());
+    CHECK(m && m->actual == uintptr_t(libc.dli_fbase));
+    CHECK(m && table.translate((void*)(uintptr_t(&std::abort) - m->delta()), libc.dli_fbase) == (void*)(&std::abort));
+    const size_t modules = table.size();
+    CHECK(modules > 1);
+
+    // The main executable is listed once
+    size_t mains = 0;
+    for(uintptr_t p = exe_base; p < exe_base + table.main_module().size; p += 4096)
+        mains += table.find_loaded(p) == &table.main_module();
+    CHECK(mains == (table.main_module().size + 4095) / 4096);
+
+    // Listed again after a refresh
+    table.refresh();
+    CHECK(table.size() == modules);
+    CHECK(table.find_loaded(uintptr_t(&std::abort)) != nullptr);
+    CHECK(module_base_table::singleton().main_module().delta() == delta);
+
+    return test::result();
+}
@@ -0,0 +1,113 @@
+// FindPattern, with each of the scanning kernels, against a naive matcher
+#include <injector/injector.hpp>
+#include <injector/pattern.hpp>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sys/mman.h>
+#include "test.hpp"
+using namespace injector;
+
+// First place in [@first, @last) where the bytes and masks given match, the simplest way
+static const uint8_t* naive(const uint8_t* first, const uint8_t* last, const std::vector<uint8_t>& bytes, const std::vector<uint8_t>& mask)
+{
+    for(const uint8_t* p = first; p + bytes.size() <= last; ++p)
+    {
+        size_t i = 0;
+        while(i < bytes.size() && (p[i] & mask[i]) == bytes[i]) ++i;
+        if(i == bytes.size()) return p;
+    }
+    return nullptr;
+}
+
+static uint32_t seed = 1;
+static uint32_t next_random(uint32_t n)
+{
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 16) % n;
+}
+
+int main()
+{
+    std::vector<pattern_kernel> kernels = { pattern_kernel::automatic, pattern_kernel::scalar, pattern_kernel::horspool };
+#ifdef INJECTOR_PATTERN_SIMD
+    kernels.push_back(pattern_kernel::sse2);
+    if(injector_pattern::has_avx2())
+        kernels.push_back(pattern_kernel::avx2);
+#endif
+
+    // The memory scanned always ends right before a page which can't be read, so reading past it faults
+    uint8_t* page = (uint8_t*) mmap(nullptr, 8192, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    CHECK(page != MAP_FAILED);
+    if(page == MAP_FAILED)
+        return test::result();
+    mprotect(page + 4096, 4096, PROT_NONE);
+    uint8_t* const end = page + 4096;
+
+    auto check = [&](const uint8_t* first, const byte_pattern& pattern)
+    {
+        const uint8_t* expected = naive(first, end, pattern.bytes, pattern.mask);
+        for(pattern_kernel kernel : kernels)
+        {
+            const uint8_t* found = FindPattern(first, end, pattern, kernel).get<const uint8_t>();
+            CHECK(found == expected);
+            if(found != expected)
+                std::fprintf(stderr, "  kernel %d, %u bytes, pattern of %u bytes\n", int(kernel), unsigned(end - first), unsigned(pattern.size()));
+        }
+    };
+
+    // Fixed cases
+    {
+        uint8_t* first = end - 64;
+        for(size_t i = 0; i < 64; ++i) first[i] = uint8_t(0x40 + i);
+
+        check(first, byte_pattern("40 41 42 43"));                          // At the very beginning
+        check(first, byte_pattern("40 ? 42"));
+        check(first, byte_pattern("7C 7D 7E 7F"));                          // Ending at the last byte
+        check(first, byte_pattern("7C ? 7E 7F"));
+        check(first, byte_pattern("7F"));
+        check(first, byte_pattern("7E 7F 80"));                             // Would end past the last byte
+        check(first, byte_pattern("5? 51 ?2"));                             // Nibble wildcards
+        check(first, byte_pattern("41 ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? 65 66"));
+        check(first, byte_pattern("? ? ? ?"));                              // Matches anything
+        check(first, byte_pattern("? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ? ?"));
+        check(first, byte_pattern("40 42"));                                // Nowhere
+        check(first, byte_pattern("CC CC CC CC CC CC CC CC CC CC CC CC CC CC CC CC CC CC CC CC CC CC CC CC CC CC CC CC CC CC CC CC CC"));
+
+        // Longer than a 32 bytes block, at the beginning and at the end
+        std::string text;
+        char hex[4];
+        for(size_t i = 0; i < 40; ++i) { std::snprintf(hex, sizeof(hex), "%02X ", 0x40 + unsigned(i)); text += hex; }
+        check(first, byte_pattern(text.c_str()));
+        text.clear();
+        for(size_t i = 24; i < 64; ++i) { std::snprintf(hex, sizeof(hex), "%02X ", 0x40 + unsigned(i)); text += hex; }
+        check(first, byte_pattern(text.c_str()));
+    }
+
+    // Random memory and patterns from a few bytes, so matches (and near misses) are common
+    static const uint8_t alphabet[] = { 0x10, 0x11, 0x90, 0xCC };
+    for(int trial = 0; trial < 20000; ++trial)
+    {
+        const size_t length = next_random(300);
+        uint8_t* first = end - length;
+        for(size_t i = 0; i < length; ++i) first[i] = alphabet[next_random(sizeof(alphabet))];
+
+        const size_t n = 1 + next_random(trial % 4 == 0? 70 : 12);
+        std::vector<uint8_t> data(n);
+        std::string mask(n, 'x');
+        for(size_t i = 0; i < n; ++i)
+        {
+            data[i] = alphabet[next_random(sizeof(alphabet))];
+            if(next_random(4) == 0) mask[i] = '?';
+        }
+
+        // Plant it at the beginning or at the end every now and then
+        if(n <= length && next_random(3) == 0)
+            memcpy(next_random(2)? first : end - n, data.data(), n);
+
+        check(first, byte_pattern(data.data(), mask.c_str()));
+    }
+
+    munmap(page, 8192);
+    return test::result();
+}
@@ -0,0 +1,58 @@
+// pattern_batch with patterns found right before an unmapped page
+#include <injector/injector.hpp>
+#include <injector/pattern.hpp>
+#include <cstring>
+#include <sys/mman.h>
+#include "test.hpp"
+using namespace injector;
+
+int main()
+{
+    // A page followed by a page which can't be read
+    uint8_t* page = (uint8_t*) mmap(nullptr, 8192, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    CHECK(page != MAP_FAILED);
+    if(page == MAP_FAILED)
+        return test::result();
+    mprotect(page + 4096, 4096, PROT_NONE);
+
+    static const uint8_t short_bytes[] = { 0xA1, 0xB2, 0xC3, 0xD4, 0xE5 };
+    static const uint8_t long_bytes[]  = { 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xAA };
+    uint8_t* const end = page + 4096;
+
+    for(size_t threads : { 1, 4 })
+    {
+        // The short pattern ends on the last byte of the page, the long one right before it
+        memset(page, 0x90, 4096);
+        memcpy(end - sizeof(short_bytes), short_bytes, sizeof(short_bytes));
+        memcpy(end - sizeof(short_bytes) - sizeof(long_bytes), long_bytes, sizeof(long_bytes));
+
+        pattern_batch batch;
+        const size_t s = batch.add("A1 B2 C3 D4 E5");
+        const size_t w = batch.add("A1 B2 C3 ? E5");
+        const size_t l = batch.add("11 22 33 44 55 66 77 88 99 AA");
+        const size_t missing = batch.add("A1 B2 C3 D4 E5 00");
+
+        CHECK(!batch.scan(page, end, threads));
+        CHECK(batch.get(s).get<uint8_t>() == end - sizeof(short_bytes));
+        CHECK(batch.get(w).get<uint8_t>() == end - sizeof(short_bytes));
+        CHECK(batch.get(l).get<uint8_t>() == end - sizeof(short_bytes) - sizeof(long_bytes));
+        CHECK(batch.get(missing).is_null());
+
+        // Every length from the anchor to the end of the page
+        for(size_t n = 3; n <= 8; ++n)
+        {
+            memset(page, 0x90, 4096);
+            for(size_t i = 0; i < n; ++i) end[i - n] = uint8_t(0xC0 + i);
+
+            char text[64] = "";
+            for(size_t i = 0; i < n; ++i) std::snprintf(text + 3 * i, 4, "%02X ", 0xC0 + unsigned(i));
+            pattern_batch one;
+            one.add(text);
+            CHECK(one.scan(page, end, threads));
+            CHECK(one.get(0).get<uint8_t>() == end - n);
+        }
+    }
+
+    munmap(page, 8192);
+    return test::result();
+}
@@ -0,0 +1,134 @@
+// pattern_cache falls back to scanning when its file is for another build of the module or is damaged
+#include <injector/injector.hpp>
+#include <injector/pattern.hpp>
+#include <injector/pattern_cache.hpp>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <dlfcn.h>
+#include "test.hpp"
+using namespace injector;
+
+// Reads the whole file at @path
+static std::vector<uint8_t> read_file(const std::string& path)
+{
+    std::vector<uint8_t> data;
+    if(FILE* f = std::fopen(path.c_str(), "rb"))
+    {
+        uint8_t buffer[4096];
+        for(size_t n; (n = std::fread(buffer, 1, sizeof(buffer), f)) != 0; )
+            data.insert(data.end(), buffer, buffer + n);
+        std::fclose(f);
+    }
+    return data;
+}
+
+// Replaces the file at @path with @data
+static void write_file(const std::string& path, const std::vector<uint8_t>& data)
+{
+    if(FILE* f = std::fopen(path.c_str(), "wb"))
+    {
+        std::fwrite(data.data(), 1, data.size(), f);
+        std::fclose(f);
+    }
+}
+
+int main()
+{
+    typedef injector_pattern_cache::header header;
+    typedef injector_pattern_cache::record record;
+
+    // Patterns from the code of the C library, which has a build-id
+    Dl_info info;
+    CHECK(dladdr((void*)(&std::printf), &info) != 0);
+    const memory_pointer_raw module = raw_ptr(info.dli_fbase);
+
+    std::vector<byte_pattern> patterns;
+    for(auto& range : GetModuleSections(module))
+    {
+        const size_t size = size_t(range.end - range.begin);
+        for(size_t offset = 0; offset + 16 <= size && patterns.size() < 8; offset += size / 8 + 1)
+            patterns.emplace_back((const uint8_t*)(range.begin) + offset, "xxxx????xxxxxxxx");
+    }
+    CHECK(patterns.size() == 8);
+
+    std::vector<memory_pointer_raw> expected;
+    for(auto& p : patterns)
+    {
+        expected.push_back(FindPatternInModule(p, module));
+        CHECK(!expected.back().is_null());
+    }
+
+    const std::string path = "/tmp/injector_test_cache_" + std::to_string(getpid()) + ".bin";
+    std::remove(path.c_str());
+
+    // Resolves everything with a cache opened from the file as it is now, checking how many came from it
+    auto resolve_all = [&](bool loaded, size_t hits, size_t stale)
+    {
+        pattern_cache cache(path.c_str(), module);
+        CHECK(cache.loaded() == loaded);
+        for(size_t i = 0; i < patterns.size(); ++i)
+            CHECK(cache.resolve(patterns[i]) == expected[i]);
+        CHECK(cache.get_statistics().hits == hits);
+        CHECK(cache.get_statistics().misses == patterns.size() - hits);
+        CHECK(cache.get_statistics().stale == stale);
+        CHECK(cache.save());
+    };
+
+    resolve_all(false, 0, 0);                   // No file yet
+    resolve_all(true, patterns.size(), 0);      // All from the file
+    const std::vector<uint8_t> good = read_file(path);
+    CHECK(good.size() == sizeof(header) + patterns.size() * sizeof(record));
+
+    // Made for another build of the module
+    std::vector<uint8_t> data = good;
+    ((header*)(data.data()))->fingerprint ^= 1;
+    write_file(path, data);
+    resolve_all(false, 0, 0);
+    CHECK(read_file(path) == good);             // Saved again for this build
+
+    // Not even a cache file
+    data = good;
+    data[0] = 'X';
+    write_file(path, data);
+    resolve_all(false, 0, 0);
+
+    // Cut in the middle of a record, or of the header
+    data = good;
+    data.resize(data.size() - 3);
+    write_file(path, data);
+    resolve_all(false, 0, 0);
+    data.resize(sizeof(header) - 1);
+    write_file(path, data);
+    resolve_all(false, 0, 0);
+
+    // More records than the header says
+    data = good;
+    ((header*)(data.data()))->count -= 1;
+    write_file(path, data);
+    resolve_all(false, 0, 0);
+
+    // Records pointing somewhere else, or outside the module, are rescanned
+    data = good;
+    record* records = (record*)(data.data() + sizeof(header));
+    records[0].offset += 1;
+    records[1].offset = ~uint64_t(0);
+    write_file(path, data);
+    resolve_all(true, patterns.size() - 2, 2);
+
+    // The same with a batch
+    write_file(path, data);
+    {
+        pattern_cache cache(path.c_str(), module);
+        pattern_batch batch;
+        for(auto& p : patterns) batch.add(p);
+        CHECK(cache.resolve(batch));
+        for(size_t i = 0; i < patterns.size(); ++i)
+            CHECK(batch.get(i) == expected[i]);
+        CHECK(cache.get_statistics().misses == 2);
+    }
+
+    std::remove(path.c_str());
+    return test::result();
+}
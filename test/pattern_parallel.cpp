@@ -0,0 +1,70 @@
+// FindPatternParallel gives the same match FindPattern does, for any number of threads
+#include <injector/injector.hpp>
+#include <injector/pattern.hpp>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include "test.hpp"
+using namespace injector;
+
+int main()
+{
+    // Big enough to be split in many chunks, filled with noise
+    const size_t size = 8 * 1024 * 1024;
+    std::vector<uint8_t> memory(size);
+    uint32_t seed = 12345;
+    for(auto& b : memory) b = uint8_t((seed = seed * 1103515245 + 12345) >> 16);
+
+    const uint8_t* const begin = memory.data();
+    const uint8_t* const end   = begin + size;
+    const size_t thread_counts[] = { 1, 2, 4, 8 };
+
+    // Matches straddling every chunk border of every thread count, plus a few inside the chunks
+    static const uint8_t bytes[] = { 0x12, 0x34, 0x00, 0x56, 0x78, 0x9A, 0xBC, 0xDE };
+    byte_pattern pattern("12 34 ? 56 78 9A BC DE");
+    std::vector<size_t> offsets;
+    for(size_t threads : thread_counts)
+    {
+        const size_t count = injector_pattern::chunk_count(size, threads);
+        for(size_t k = 1; k < count; ++k)
+        {
+            offsets.push_back(size / count * k - 3);
+            offsets.push_back(size / count * k + 100);
+        }
+    }
+    offsets.push_back(size - sizeof(bytes));
+    std::sort(offsets.begin(), offsets.end());
+    offsets.erase(std::unique(offsets.begin(), offsets.end()), offsets.end());
+    CHECK(offsets.size() > 32);
+
+    for(size_t i = 0; i < offsets.size(); ++i)
+    {
+        memcpy(&memory[offsets[i]], bytes, sizeof(bytes));
+        memory[offsets[i] + 2] = uint8_t(i);
+    }
+
+    // Take the lowest match away each time, the next lowest must be the one found
+    for(size_t i = 0; i <= offsets.size(); ++i)
+    {
+        const uint8_t* expected = i < offsets.size()? begin + offsets[i] : nullptr;
+        CHECK(FindPattern(begin, end, pattern).get<const uint8_t>() == expected);
+        for(size_t threads : thread_counts)
+            CHECK(FindPatternParallel(begin, end, pattern, threads).get<const uint8_t>() == expected);
+        if(i < offsets.size())
+            memory[offsets[i]] = 0x00;
+    }
+
+    // A short pattern which the noise matches here and there
+    byte_pattern noise("C3 ? CC");
+    for(int i = 0; i < 8; ++i)
+    {
+        const uint8_t* serial = FindPattern(begin, end, noise).get<const uint8_t>();
+        CHECK(serial != nullptr);
+        for(size_t threads : thread_counts)
+            CHECK(FindPatternParallel(begin, end, noise, threads).get<const uint8_t>() == serial);
+        if(serial == nullptr) break;
+        memory[serial - begin] = 0x00;
+    }
+
+    return test::result();
+}
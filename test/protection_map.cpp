@@ -0,0 +1,71 @@
+// protection_map: the skipped system calls, and pages freed and mapped again by executable_arena
+#define INJECTOR_CACHE_PROTECTION
+#include <injector/injector.hpp>
+#include <injector/arena.hpp>
+#include <sys/mman.h>
+#include "test.hpp"
+using namespace injector;
+
+int main()
+{
+    protection_map& map = protection_map::singleton();
+    const size_t page_size = GetPageSize();
+
+    // Memory we don't know about is asked to the system, then the answer is remembered
+    {
+        uint8_t* code = test::map_code(page_size);
+        CHECK(code != nullptr);
+        protection_map::statistics before = map.get_statistics();
+
+        memory_protection old;
+        CHECK(UnprotectMemory(code, 16, old));
+        CHECK(old == (PROT_READ | PROT_EXEC));
+        code[0] = 0xC3;
+        CHECK(map.get_statistics().queries_avoided == before.queries_avoided);
+
+        // Already writable, nothing to ask nor to change
+        CHECK(UnprotectMemory(code + 32, 16, old));
+        CHECK(old == protection_rwx);
+        protection_map::statistics after = map.get_statistics();
+        CHECK(after.queries_avoided == before.queries_avoided + 1);
+        CHECK(after.protects_avoided == before.protects_avoided + 1);
+
+        // Protecting into the same protection twice changes it once
+        CHECK(ProtectMemory(code, 16, PROT_READ | PROT_EXEC));
+        CHECK(ProtectMemory(code, 16, PROT_READ | PROT_EXEC));
+        CHECK(map.get_statistics().protects_avoided == after.protects_avoided + 1);
+
+        // The cache must have followed the real protection
+        CHECK(UnprotectMemory(code, 16, old));
+        CHECK(old == (PROT_READ | PROT_EXEC));
+        code[1] = 0xC3;
+        munmap(code, page_size);
+        map.flush();
+    }
+
+    // An arena page remembered as writable, freed, then mapped again as read and execute only
+    {
+        executable_arena arena;
+        uint8_t* stub = (uint8_t*) arena.allocate(16);
+        CHECK(stub != nullptr);
+
+        memory_protection old;
+        CHECK(UnprotectMemory(stub, 16, old));
+        CHECK(old == protection_rwx);
+
+        arena.deallocate(stub, 16);
+        CHECK(arena.get_statistics().pages == 0);
+
+        uint8_t* code = test::map_code(page_size, uintptr_t(stub));
+        CHECK(code == stub);
+
+        // Must be read again, the page isn't writable anymore
+        CHECK(UnprotectMemory(code, 16, old));
+        CHECK(old == (PROT_READ | PROT_EXEC));
+        if(old == (PROT_READ | PROT_EXEC))
+            code[0] = 0xC3;
+        munmap(code, page_size);
+    }
+
+    return test::result();
+}
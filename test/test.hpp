@@ -0,0 +1,58 @@
+/*
+ *  Injectors - Test helpers
+ *
+ *  Copyright (C) 2014 LINK/2012 <dma_2012@hotmail.com>
+ *
+ *  This software is provided 'as-is', without any express or implied
+ *  warranty. In no event will the authors be held liable for any damages
+ *  arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *     1. The origin of this software must not be misrepresented; you must not
+ *     claim that you wrote the original software. If you use this software
+ *     in a product, an acknowledgment in the product documentation would be
+ *     appreciated but is not required.
+ *
+ *     2. Altered source versions must be plainly marked as such, and must not be
+ *     misrepresented as being the original software.
+ *
+ *     3. This notice may not be removed or altered from any source
+ *     distribution.
+ *
+ */
+#pragma once
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <sys/mman.h>
+
+namespace test
+{
+    inline int& failures()
+    {
+        static int count = 0;
+        return count;
+    }
+
+    // Maps @size bytes of code memory, left read and execute only, at @at if not zero
+    inline uint8_t* map_code(size_t size, uintptr_t at = 0)
+    {
+        void* p = mmap((void*)(at), size, PROT_READ|PROT_WRITE|PROT_EXEC, MAP_PRIVATE|MAP_ANONYMOUS|(at? MAP_FIXED : 0), -1, 0);
+        if(p == MAP_FAILED) return nullptr;
+        mprotect(p, size, PROT_READ|PROT_EXEC);
+        return (uint8_t*)(p);
+    }
+
+    // Exit code of the test
+    inline int result()
+    {
+        if(failures()) std::fprintf(stderr, "%d check(s) failed\n", failures());
+        return failures()? 1 : 0;
+    }
+}
+
+#define CHECK(cond) \
+    do { if(!(cond)) { std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); ++test::failures(); } } while(0)
@@ -0,0 +1,57 @@
+// address_manager::translate_address with a hand written translator whose answers change, with and without the translation cache
+#define INJECTOR_GVM_HAS_TRANSLATOR
+#include <injector/injector.hpp>
+#include <thread>
+#include "test.hpp"
+using namespace injector;
+
+static uintptr_t offset = 0x1000;
+static size_t calls = 0;
+
+namespace injector
+{
+    void* address_manager::translator(void* p)
+    {
+        ++calls;
+        return (void*)(uintptr_t(p) + offset);
+    }
+}
+
+static void* translate(uintptr_t p)
+{
+    return address_manager::translate_address((void*)(p));
+}
+
+int main()
+{
+    CHECK(translate(0x400000) == (void*)(0x401000));
+    CHECK(translate(0x400000) == (void*)(0x401000));
+
+    offset = 0x2000;
+#if INJECTOR_GVM_TRANSLATION_CACHE > 0
+    // Cached until invalidated
+    CHECK(calls == 1);
+    CHECK(translate(0x400000) == (void*)(0x401000));
+    CHECK(address_manager::get_cache_statistics().hits == 2);
+#else
+    // No cache by default, changes are seen right away
+    CHECK(calls == 2);
+    CHECK(translate(0x400000) == (void*)(0x402000));
+#endif
+
+    // Nothing from before the invalidation is served, in this thread or any other
+    address_manager::invalidate();
+    CHECK(translate(0x400000) == (void*)(0x402000));
+    for(uintptr_t p = 0x500000; p < 0x500000 + 4096 * 16; p += 16)
+        CHECK(translate(p) == (void*)(p + 0x2000));
+
+    offset = 0x3000;
+    address_manager::invalidate();
+    std::thread other([] { CHECK(translate(0x400000) == (void*)(0x403000)); });
+    other.join();
+    for(uintptr_t p = 0x500000; p < 0x500000 + 4096 * 16; p += 16)
+        CHECK(translate(p) == (void*)(p + 0x3000));
+    CHECK(translate(0x400000) == (void*)(0x403000));
+
+    return test::result();
+}
@@ -0,0 +1,323 @@
+// address_translator_manager with translators coming and going while other threads translate, ranges, and tables kept in files
+#define INJECTOR_GVM_HAS_TRANSLATOR
+#include <injector/injector.hpp>
+#include <injector/gvm/translator.hpp>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <unistd.h>
+#include "test.hpp"
+using namespace injector;
+
+namespace injector
+{
+    void* address_manager::translator(void* p)
+    {
+        return address_translator_manager::singleton().translator(p);
+    }
+}
+
+static const size_t entries = 1000;
+
+// Maps @entries addresses from @from into @to, 16 bytes apart
+struct test_translator : address_translator
+{
+    test_translator(uintptr_t from, uintptr_t to, bool enable_it) : address_translator(enable_it)
+    {
+        for(size_t i = 0; i < entries; ++i)
+            map[raw_ptr(from + i * 16)] = raw_ptr(to + i * 16);
+    }
+
+    ~test_translator()
+    {
+        this->remove();     // Readers may be calling into the fallback, see address_translator::remove
+    }
+};
+
+// A range with single entries inside it, another two right after each other, and an empty one
+struct range_translator final : address_translator
+{
+    range_translator() : address_translator(false)
+    {
+        map_range(raw_ptr(0x7200000), raw_ptr(0x7210000), raw_ptr(0xA000000));
+        map[raw_ptr(0x7208000)] = raw_ptr(0xB000000);
+        map[raw_ptr(0x720FFFC)] = raw_ptr(0xC000000);
+        map_range(raw_ptr(0x7300000), raw_ptr(0x7300100), raw_ptr(0xD000000));
+        map_range(raw_ptr(0x7300100), raw_ptr(0x7300200), raw_ptr(0xE000000));
+        map_range(raw_ptr(0x7400000), raw_ptr(0x7400000), raw_ptr(0xF000000));
+        enable();
+    }
+
+    ~range_translator()
+    {
+        this->remove();
+    }
+};
+
+// Covers part of an entry of the one above
+struct override_translator final : address_translator
+{
+    override_translator() : address_translator(false)
+    {
+        map_range(raw_ptr(0x7208000), raw_ptr(0x7208004), raw_ptr(0xF100000));
+        enable();
+    }
+
+    ~override_translator()
+    {
+        this->remove();
+    }
+};
+
+// Lookups in ranges, at their edges, and against single entries
+static void ranges()
+{
+    auto& mgr = address_translator_manager::singleton();
+    range_translator t;
+
+    static const uintptr_t probes[][2] = {
+        { 0x71FFFFF, 0 },           { 0x7200000, 0xA000000 },   { 0x7200001, 0xA000001 },   { 0x7204321, 0xA004321 },
+        { 0x7207FFF, 0xA007FFF },   { 0x7208000, 0xB000000 },   { 0x7208007, 0xB000007 },   { 0x7208008, 0xA008008 },
+        { 0x720FFFB, 0xA00FFFB },   { 0x720FFFC, 0xC000000 },   { 0x720FFFF, 0xC000003 },   { 0x7210000, 0xC000004 },
+        { 0x7210003, 0xC000007 },   { 0x7210004, 0 },           { 0x72FFFFF, 0 },           { 0x7300000, 0xD000000 },
+        { 0x73000FF, 0xD0000FF },   { 0x7300100, 0xE000000 },   { 0x73001FF, 0xE0000FF },   { 0x7300200, 0 },
+        { 0x7400000, 0 },
+    };
+    const size_t count = sizeof(probes) / sizeof(*probes);
+
+    std::vector<void*> in(count), out(count);
+    for(size_t i = 0; i < count; ++i)
+    {
+        in[i] = (void*)(probes[i][0]);
+        CHECK(mgr.translator(in[i]) == (void*)(probes[i][1]));
+        CHECK(mgr.find(in[i]) == (void*)(probes[i][1]));
+    }
+    mgr.translate_many(in.data(), out.data(), count, 0);
+    for(size_t i = 0; i < count; ++i)
+        CHECK(out[i] == (void*)(probes[i][1]));
+
+    // A newer translator wins over the entries of the older one, whatever their kind
+    {
+        override_translator over;
+        CHECK(mgr.translator((void*)(0x7208000)) == (void*)(0xF100000));
+        CHECK(mgr.translator((void*)(0x7208003)) == (void*)(0xF100003));
+        CHECK(mgr.translator((void*)(0x7208004)) == (void*)(0xB000004));
+        CHECK(mgr.translator((void*)(0x7207FFF)) == (void*)(0xA007FFF));
+    }
+    CHECK(mgr.translator((void*)(0x7208000)) == (void*)(0xB000000));
+
+    // Disabled, no range is left behind
+    t.disable();
+    for(size_t i = 0; i < count; ++i)
+        CHECK(mgr.translator(in[i]) == nullptr);
+}
+
+// Some entries, with a range in between them, to be saved into a file
+struct saved_translator final : address_translator
+{
+    saved_translator() : address_translator(false)
+    {
+        for(uintptr_t i = 0; i < 64; ++i)
+            map[raw_ptr(0x7000000 + i * 32)] = raw_ptr(0x8000000 + i * 64);
+        map_range(raw_ptr(0x7100000), raw_ptr(0x7180000), raw_ptr(0x9000000));
+        enable();
+    }
+
+    ~saved_translator()
+    {
+        this->remove();
+    }
+};
+
+// Reads the whole file at @path
+static std::vector<uint8_t> read_file(const std::string& path)
+{
+    std::vector<uint8_t> data;
+    if(FILE* f = std::fopen(path.c_str(), "rb"))
+    {
+        uint8_t buffer[4096];
+        for(size_t n; (n = std::fread(buffer, 1, sizeof(buffer), f)) != 0; )
+            data.insert(data.end(), buffer, buffer + n);
+        std::fclose(f);
+    }
+    return data;
+}
+
+// Replaces the file at @path with @data
+static void write_file(const std::string& path, const std::vector<uint8_t>& data)
+{
+    if(FILE* f = std::fopen(path.c_str(), "wb"))
+    {
+        std::fwrite(data.data(), 1, data.size(), f);
+        std::fclose(f);
+    }
+}
+
+// address_translator::save into mapped_address_translator, and the files the latter must refuse
+static void saved_tables()
+{
+    typedef injector_translator::file_header header;
+    auto& mgr = address_translator_manager::singleton();
+    const std::string path = "/tmp/injector_test_translator_" + std::to_string(getpid()) + ".bin";
+
+    static const uintptr_t probes[] = {
+        0x7000000, 0x7000003, 0x7000007, 0x7000008, 0x70007E0, 0x70007E7, 0x70007E8, 0x6FFFFFF,
+        0x7100000, 0x7100001, 0x717FFFF, 0x7180000, 0x7140000,
+    };
+    const size_t count = sizeof(probes) / sizeof(*probes);
+
+    void* expected[count];
+    {
+        saved_translator t;
+        for(size_t i = 0; i < count; ++i)
+            expected[i] = mgr.translator((void*)(probes[i]));
+        CHECK(t.save(path.c_str()));
+    }
+    CHECK(expected[1] == (void*)(0x8000003));
+    CHECK(expected[3] == nullptr);
+    CHECK(expected[5] == (void*)(0x8000FC7));
+    CHECK(expected[10] == (void*)(0x907FFFF));
+    CHECK(expected[11] == nullptr);
+
+    // The same translations from the file
+    const std::vector<uint8_t> good = read_file(path);
+    {
+        CHECK(mgr.translator((void*)(probes[0])) == nullptr);
+        mapped_address_translator t(path.c_str());
+        CHECK(t.loaded());
+        CHECK(t.is_enabled());
+        CHECK(t.size() > 64);
+        CHECK(good.size() == injector_translator::file_size(t.size()));
+        for(size_t i = 0; i < count; ++i)
+            CHECK(mgr.translator((void*)(probes[i])) == expected[i]);
+    }
+
+    // Every damaged file is refused, and translates nothing
+    auto refused = [&](const std::vector<uint8_t>& data)
+    {
+        write_file(path, data);
+        mapped_address_translator t(path.c_str());
+        CHECK(!t.loaded());
+        CHECK(!t.is_enabled());
+        CHECK(mgr.translator((void*)(probes[0])) == nullptr);
+    };
+
+    std::vector<uint8_t> data;
+    refused(data);                                                  // Empty
+    data.assign(good.begin(), good.begin() + sizeof(header) - 1);
+    refused(data);                                                  // Cut in the header
+    data.assign(good.begin(), good.end() - 1);
+    refused(data);                                                  // Cut in the table
+    data = good; data.push_back(0);
+    refused(data);                                                  // Longer than the header says
+    data = good; data[0] = 'X';
+    refused(data);                                                  // Bad magic
+    data = good; ((header*)(data.data()))->version += 1;
+    refused(data);                                                  // Another version
+    data = good; ((header*)(data.data()))->pointer_size = 12;
+    refused(data);                                                  // Another pointer size
+    data = good; ((header*)(data.data()))->count -= 1;
+    refused(data);                                                  // Count not matching the size
+    data = good; ((header*)(data.data()))->checksum ^= 1;
+    refused(data);                                                  // Bad checksum
+    data = good; data[sizeof(header) + 5] ^= 0x40;
+    refused(data);                                                  // Changed table
+
+    std::remove(path.c_str());
+    {
+        mapped_address_translator t(path.c_str());                  // Missing
+        CHECK(!t.loaded());
+    }
+
+    // The good one once more, after all of that
+    write_file(path, good);
+    {
+        mapped_address_translator t(path.c_str());
+        CHECK(t.loaded());
+        CHECK(mgr.translator((void*)(probes[12])) == expected[12]);
+    }
+    std::remove(path.c_str());
+}
+
+int main()
+{
+    auto& mgr = address_translator_manager::singleton();
+    ranges();
+    saved_tables();
+
+    // Constructed enabled, the map gets filled after the translator has been published
+    test_translator fixed(0x100000, 0x200000, true);
+    CHECK(address_manager::translate_address((void*)(0x100010)) == (void*)(0x200010));
+    CHECK(mgr.find((void*)(0x100000 + 16 * entries + 0x1000)) == nullptr);
+
+    // The toggled one is filled before being enabled, as it should when other threads are translating
+    test_translator toggled(0x300000, 0x400000, false);
+    toggled.enable();
+    CHECK(mgr.translator((void*)(0x300020)) == (void*)(0x400020));
+
+    std::atomic<bool> stop(false);
+    std::atomic<size_t> bad(0), translations(0);
+    std::vector<std::thread> readers;
+    for(int r = 0; r < 4; ++r)
+    {
+        readers.emplace_back([&, r] {
+            std::vector<void*> in(256), out(256);
+            size_t n = 0, k = size_t(r);
+            while(!stop.load(std::memory_order_relaxed))
+            {
+                const size_t i = (k++ * 7919) % entries;
+
+                // Always there
+                if(mgr.translator((void*)(0x100000 + i * 16)) != (void*)(0x200000 + i * 16)) ++bad;
+                if(address_manager::translate_address((void*)(0x100000 + i * 16 + 3)) != (void*)(0x200000 + i * 16 + 3)) ++bad;
+
+                // Either there or not translated at all, never anything else
+                void* t = mgr.translator((void*)(0x300000 + i * 16));
+                if(t != nullptr && t != (void*)(0x400000 + i * 16)) ++bad;
+                t = mgr.translator((void*)(0x500000 + i * 16));
+                if(t != nullptr && t != (void*)(0x600000 + i * 16)) ++bad;
+
+                // Same in batches
+                if((n & 63) == 0)
+                {
+                    for(size_t j = 0; j < in.size(); ++j)
+                        in[j] = (void*)(0x100000 + ((i + j) % entries) * 16);
+                    mgr.translate_many(in.data(), out.data(), in.size());
+                    for(size_t j = 0; j < in.size(); ++j)
+                        if(out[j] != (void*)(uintptr_t(in[j]) + 0x100000)) ++bad;
+                }
+                ++n;
+            }
+            translations += n;
+        });
+    }
+
+    // Keep changing the translators meanwhile
+    size_t changes = 0;
+    auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(500);
+    while(std::chrono::steady_clock::now() < end)
+    {
+        toggled.enable(changes & 1);
+        {
+            std::unique_ptr<test_translator> temp(new test_translator(0x500000, 0x600000, false));
+            temp->enable();
+            std::this_thread::yield();
+            if(changes & 2) temp->update();
+        }
+        ++changes;
+    }
+
+    stop = true;
+    for(auto& t : readers) t.join();
+
+    CHECK(bad.load() == 0);
+    CHECK(translations.load() > 0);
+    CHECK(changes > 0);
+    CHECK(mgr.translator((void*)(0x500000)) == nullptr);
+    CHECK(epoch_manager::singleton().get_statistics().pending <= 1);
+
+    return test::result();
+}
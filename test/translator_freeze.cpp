@@ -0,0 +1,104 @@
+// address_translator_manager::freeze, the frozen table against the translators it came from
+#define INJECTOR_GVM_HAS_TRANSLATOR
+#include <injector/injector.hpp>
+#include <injector/gvm/translator.hpp>
+#include "test.hpp"
+using namespace injector;
+
+namespace injector
+{
+    void* address_manager::translator(void* p)
+    {
+        return address_translator_manager::singleton().translator(p);
+    }
+}
+
+// Maps 0x100000 + 16i into 0x200000 + 16i, and [0x300000, 0x310000) into 0x400000, with 0x300800 mapped on its own
+struct map_translator final : address_translator
+{
+    map_translator() : address_translator(false)
+    {
+        for(uintptr_t i = 0; i < 100; ++i)
+            map[raw_ptr(0x100000 + i * 16)] = raw_ptr(0x200000 + i * 16);
+        map[raw_ptr(0x300800)] = raw_ptr(0x900000);
+        map_range(raw_ptr(0x300000), raw_ptr(0x310000), raw_ptr(0x400000));
+        enable();
+    }
+
+    ~map_translator()
+    {
+        this->remove();
+    }
+};
+
+// Overrides part of the one above, and gives 0xF00D for anything else
+struct override_translator final : address_translator
+{
+    override_translator() : address_translator(false)
+    {
+        map_range(raw_ptr(0x100000), raw_ptr(0x100100), raw_ptr(0x500000));
+        enable();
+    }
+
+    ~override_translator()
+    {
+        this->remove();
+    }
+
+    void* fallback(void*) const override
+    {
+        return (void*)(0xF00D);
+    }
+};
+
+int main()
+{
+    auto& mgr = address_translator_manager::singleton();
+    map_translator base;
+    override_translator* over = new override_translator();
+
+    static const uintptr_t probes[] = {
+        0x100000, 0x100004, 0x1000F8, 0x100100, 0x100104, 0x100630, 0x10063F, 0x100640, 0x2FFFFF,
+        0x300000, 0x3007FF, 0x300800, 0x300801, 0x300808, 0x30FFFF, 0x310000, 0x12345678,
+    };
+
+    void* expected[sizeof(probes) / sizeof(*probes)];
+    for(size_t i = 0; i < sizeof(probes) / sizeof(*probes); ++i)
+        expected[i] = mgr.translator((void*)(probes[i]));
+    CHECK(expected[0] == (void*)(0x500000));
+    CHECK(expected[4] == (void*)(0x200104));
+    CHECK(expected[9] == (void*)(0x400000));
+    CHECK(expected[11] == (void*)(0x900000));
+    CHECK(expected[16] == (void*)(0xF00D));
+
+    // The frozen table gives the same as the translators
+    CHECK(!address_manager::is_frozen());
+    CHECK(mgr.freeze());
+    CHECK(address_manager::is_frozen());
+    for(size_t i = 0; i < sizeof(probes) / sizeof(*probes); ++i)
+        CHECK(address_manager::translate_address((void*)(probes[i])) == expected[i]);
+
+    // There's no going back nor freezing into something else
+    CHECK(mgr.freeze());
+    static const address_manager::frozen_translation other = {};
+    CHECK(!address_manager::freeze(&other));
+    CHECK(!address_manager::freeze(nullptr));
+    CHECK(address_manager::is_frozen());
+
+    // A destroyed translator keeps its translations, but not its fallback
+    delete over;
+    CHECK(address_manager::translate_address((void*)(0x100000)) == (void*)(0x500000));
+    CHECK(address_manager::translate_address((void*)(0x12345678)) == nullptr);
+
+#ifdef NDEBUG
+    // Adding or changing translators is ignored (asserted in debug builds)
+    {
+        override_translator late;
+        CHECK(address_manager::translate_address((void*)(0x12345678)) == nullptr);
+        base.disable();
+        CHECK(address_manager::translate_address((void*)(0x300000)) == (void*)(0x400000));
+    }
+#endif
+
+    return test::result();
+}